@@ -0,0 +1,342 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "AuxiliaryTypes.h"
+#include "BigInteger.h"
+#include "Constants.h"
+#include "Decimal.h"
+#include "Functions.h"
+#include "FunctionTypes.h"
+#include "LookupTables.h"
+
+// INTEGER leaves hold an int, an int64_t when they don't fit in one, or a pointer to a BigInteger past 64 bits, owned by
+//   the AST holding the leaf (or by the tokenizer for tokens). REAL leaves hold a double, or the exact Decimal of the
+//   literal they were parsed from
+using LeafValue = std::variant<int,double,const BigInteger*,Decimal,int64_t>;
+
+struct ASTLeaf
+{
+  std::variant<AtomicTypes, Functions, AuxiliaryTypes> type;
+  LeafValue value; // Value may be interpreted in different forms (double, bool, ...) depending on the type
+  std::string toString() const
+  {
+    std::string result;
+    if (std::holds_alternative<AtomicTypes>(type))
+    {
+      switch (std::get<AtomicTypes>(type))
+      {
+        case AtomicTypes::REAL:
+        if (std::holds_alternative<Decimal>(value))
+        {
+          std::get<Decimal>(value).appendDecimal(result);
+          return result;
+        }
+        return std::to_string(std::get<double>(value));
+        case AtomicTypes::INTEGER:
+        if (std::holds_alternative<const BigInteger*>(value))
+        {
+          return std::get<const BigInteger*>(value)->toString();
+        }
+        if (std::holds_alternative<int64_t>(value))
+        {
+          return std::to_string(std::get<int64_t>(value));
+        }
+        return std::to_string(std::get<int>(value));
+        case AtomicTypes::CONSTANT:
+        if ((size_t)std::get<int>(value) < constantCount)
+        {
+          return (std::string)getName((Constants)std::get<int>(value));
+        }
+        return "#" + std::to_string(std::get<int>(value));
+        case AtomicTypes::VARIABLE:
+        result = "Variable '";
+        result += (char)std::get<int>(value);
+        return result + '\'';
+        case AtomicTypes::UNDEFINED:
+        return "undefined";
+        case AtomicTypes::UNDETERMINED:
+        return "undetermined";
+        case AtomicTypes::DNE:
+        return "does not exist";
+      }
+    }
+    else if (std::holds_alternative<Functions>(type))
+    {
+      result += "(f|" +  std::to_string((int)std::get<Functions>(type)) + "|";
+    }
+    else
+    {
+      result +=  "(x|" +  std::to_string((int)std::get<AuxiliaryTypes>(type)) + "|";
+    }
+    if (std::holds_alternative<int>(value))
+    {
+      return result + std::to_string(std::get<int>(value)) + ")";
+    }
+    else if (std::holds_alternative<double>(value))
+    {
+      return result + std::to_string(std::get<double>(value)) + ")";
+    }
+    else if (std::holds_alternative<const BigInteger*>(value))
+    {
+      return result + std::get<const BigInteger*>(value)->toString() + ")";
+    }
+    else if (std::holds_alternative<int64_t>(value))
+    {
+      return result + std::to_string(std::get<int64_t>(value)) + ")";
+    }
+    std::get<Decimal>(value).appendDecimal(result);
+    return result + ")";
+  }
+  ASTLeaf(std::variant<AtomicTypes,Functions,AuxiliaryTypes> type) : type(type){};
+  ASTLeaf(Constants constant) : type(AtomicTypes::CONSTANT)
+  {
+    value = (int)constant;
+  };
+  ASTLeaf(std::variant<AtomicTypes,Functions,AuxiliaryTypes> type,LeafValue value) : type(type), value(value){};
+  ASTLeaf() {};
+};
+
+// Writes two words that identify a leaf: its kind and type, then the bits of its value (packed for decimals), or the
+//   hash of its big integer. Two leaves are equal exactly when their words are and, for big integers, their values are
+//   (see sameValue), so the encoding only depends on what the leaf holds, never on where
+inline void encodeLeaf(const ASTLeaf& leaf, uint64_t* words)
+{
+  const uint64_t type = std::visit([](const auto type) { return (uint64_t)type; }, leaf.type);
+  words[0] = type << 8 | leaf.type.index() << 4 | leaf.value.index();
+  if (std::holds_alternative<int>(leaf.value))
+  {
+    words[1] = (uint64_t)(uint32_t)std::get<int>(leaf.value);
+  }
+  else if (std::holds_alternative<double>(leaf.value))
+  {
+    const double value = std::get<double>(leaf.value);
+    std::memcpy(&words[1], &value, sizeof(uint64_t));
+  }
+  else if (std::holds_alternative<const BigInteger*>(leaf.value))
+  {
+    words[1] = std::get<const BigInteger*>(leaf.value)->hash();
+  }
+  else if (std::holds_alternative<int64_t>(leaf.value))
+  {
+    words[1] = (uint64_t)std::get<int64_t>(leaf.value);
+  }
+  else
+  {
+    words[1] = (uint64_t)std::get<Decimal>(leaf.value).packed;
+  }
+}
+
+// Completes encodeLeaf: whether two leaves with the same words also hold the same big integer, if any
+inline bool sameValue(const ASTLeaf& a, const ASTLeaf& b)
+{
+  if (!std::holds_alternative<const BigInteger*>(a.value) || !std::holds_alternative<const BigInteger*>(b.value))
+  {
+    return true;
+  }
+  return *std::get<const BigInteger*>(a.value) == *std::get<const BigInteger*>(b.value);
+}
+
+// One round of a multiplicative hash over 64-bit words
+inline uint64_t mixHash(const uint64_t hash, const uint64_t word)
+{
+  const uint64_t mixed = (hash ^ word)*0x9E3779B97F4A7C15ull;
+  return mixed ^ (mixed >> 29);
+}
+
+// Position of a node inside the arena of its AST
+using NodeId = uint32_t;
+
+struct ASTNode
+{
+  ASTLeaf leaf; // The token of a leaf, or for interior nodes their function stored in leaf.type
+  uint32_t firstArg = 0; // Position of the first child id in AST::args
+  uint32_t argCount = 0;
+};
+
+// Contiguous view over the child ids of a node
+struct ASTArgs
+{
+  const NodeId* first;
+  const NodeId* last;
+
+  const NodeId* begin() const
+  {
+    return first;
+  }
+  const NodeId* end() const
+  {
+    return last;
+  }
+  size_t size() const
+  {
+    return last - first;
+  }
+  NodeId operator[](const size_t i) const
+  {
+    return first[i];
+  }
+};
+
+/*
+  Arena representation of an expression: every node lives in one contiguous vector and refers to its children by
+  32-bit indices, whose ids are stored contiguously per node in a second vector. Nodes are always added after their
+  children, so increasing ids are a valid bottom-up evaluation order. Building costs one push per node and dropping
+  the tree releases two buffers regardless of its size.
+
+  Big integers are copied in when their leaf is added, so the tree owns them and frees them with itself: leaves stay
+  trivially copyable, and nothing outlives the trees that use it. Copying a tree copies them too.
+*/
+class AST
+{
+  public:
+  std::vector<ASTNode> nodes;
+  std::vector<NodeId> args;
+  NodeId root = 0;
+
+  AST() {}
+
+  AST(const AST& other) : nodes(other.nodes), args(other.args), root(other.root)
+  {
+    ownIntegers();
+  }
+
+  AST& operator=(const AST& other)
+  {
+    if (this != &other)
+    {
+      nodes = other.nodes;
+      args = other.args;
+      root = other.root;
+      integers.clear();
+      ownIntegers();
+    }
+    return *this;
+  }
+
+  AST(AST&&) = default;
+  AST& operator=(AST&&) = default;
+
+  // Keeps the capacity of both buffers so the arena can be refilled without allocating
+  void clear()
+  {
+    nodes.clear();
+    args.clear();
+    integers.clear();
+    root = 0;
+  }
+
+  void reserve(const size_t nodeCount)
+  {
+    nodes.reserve(nodeCount);
+    args.reserve(nodeCount);
+  }
+
+  size_t size() const
+  {
+    return nodes.size();
+  }
+
+  NodeId addLeaf(const ASTLeaf& leaf)
+  {
+    // Read first, since leaf may be a node of this tree
+    const BigInteger* big = std::holds_alternative<const BigInteger*>(leaf.value) ? std::get<const BigInteger*>(leaf.value) : nullptr;
+    nodes.push_back({leaf, 0, 0});
+    if (big)
+    {
+      nodes.back().leaf.value = own(*big);
+    }
+    return (NodeId)(nodes.size()-1);
+  }
+
+  NodeId addNode(const Functions type, const NodeId* children, const uint32_t count)
+  {
+    const uint32_t firstArg = (uint32_t)args.size();
+    args.insert(args.end(), children, children + count);
+    nodes.push_back({ASTLeaf(type), firstArg, count});
+    return (NodeId)(nodes.size()-1);
+  }
+
+  bool isLeaf(const NodeId id) const
+  {
+    return !std::holds_alternative<Functions>(nodes[id].leaf.type);
+  }
+
+  const ASTLeaf& getLeaf(const NodeId id) const
+  {
+    return nodes[id].leaf;
+  }
+
+  Functions getType(const NodeId id) const
+  {
+    return std::get<Functions>(nodes[id].leaf.type);
+  }
+
+  ASTArgs getArgs(const NodeId id) const
+  {
+    const ASTNode& node = nodes[id];
+    return {args.data() + node.firstArg, args.data() + node.firstArg + node.argCount};
+  }
+
+  std::string toString() const
+  {
+    return toString(root);
+  }
+
+  std::string toString(const NodeId id) const
+  {
+    std::string res;
+    appendString(id, res);
+    return res;
+  }
+
+  // Appends to a single buffer, so the cost is linear in the size of the tree. JSON is written by JSONWriter
+  void appendString(const NodeId id, std::string& res) const
+  {
+    if (isLeaf(id))
+    {
+      res += getLeaf(id).toString();
+      return;
+    }
+    res += "{[";
+    res += std::to_string((int)getType(id));
+    res += "] ";
+    for (const NodeId arg : getArgs(id))
+    {
+      appendString(arg, res);
+      res += ' ';
+    }
+    res += '}';
+  }
+
+  private:
+  std::vector<std::unique_ptr<BigInteger>> integers; // Pointed to by the big integer leaves
+
+  const BigInteger* own(const BigInteger& value)
+  {
+    integers.push_back(std::make_unique<BigInteger>(value));
+    return integers.back().get();
+  }
+
+  // Points the big integer leaves copied from another tree to copies of their values
+  void ownIntegers()
+  {
+    for (ASTNode& node : nodes)
+    {
+      if (std::holds_alternative<const BigInteger*>(node.leaf.value))
+      {
+        node.leaf.value = own(*std::get<const BigInteger*>(node.leaf.value));
+      }
+    }
+  }
+};
+
+#endif
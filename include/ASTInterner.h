@@ -0,0 +1,169 @@
+#ifndef ASTINTERNER_H
+#define ASTINTERNER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "AST.h"
+#include "Functions.h"
+
+/*
+  Hash-consing front end for an arena AST: a node is only added if no node with the same leaf and the same child ids
+  exists yet, otherwise the id of the existing one is returned. Since children are interned before their parents,
+  identical subtrees collapse bottom-up into a single node, the AST becomes a DAG, and two subtrees of it are equal
+  exactly when their ids are. Evaluator walks the arena in id order, so every shared subexpression is computed once.
+
+  The index is an open-addressing table of node ids next to a vector of node hashes, both reused across resets.
+*/
+class ASTInterner
+{
+  public:
+  // Interns into target from now on. The nodes it already holds are indexed as they are, and only deduplicate
+  //   against later additions if they were themselves built through an interner
+  void reset(AST& target)
+  {
+    ast = &target;
+    hashes.clear();
+    shared = 0;
+    size_t capacity = 64;
+    while (capacity < 2*target.size())
+    {
+      capacity *= 2;
+    }
+    table.assign(capacity, emptySlot);
+    for (NodeId id = 0; id < target.size(); id++)
+    {
+      const ASTNode& node = target.nodes[id];
+      hashes.push_back(hash(node.leaf, target.args.data()+node.firstArg, node.argCount));
+      insert(id);
+    }
+  }
+
+  NodeId addLeaf(const ASTLeaf& leaf)
+  {
+    return intern(leaf, nullptr, 0);
+  }
+
+  NodeId addNode(const Functions type, const NodeId* children, const uint32_t count)
+  {
+    return intern(ASTLeaf(type), children, count);
+  }
+
+  // Interns every node of source, which may be any AST, and returns the id its root maps to
+  NodeId import(const AST& source)
+  {
+    remap.resize(source.size());
+    for (NodeId id = 0; id < source.size(); id++)
+    {
+      const ASTNode& node = source.nodes[id];
+      mapped.clear();
+      for (const NodeId child : source.getArgs(id))
+      {
+        mapped.push_back(remap[child]);
+      }
+      remap[id] = intern(node.leaf, mapped.data(), node.argCount);
+    }
+    return source.size() ? remap[source.root] : 0;
+  }
+
+  // Additions answered with an existing node since the last reset
+  size_t getSharedCount() const
+  {
+    return shared;
+  }
+
+  private:
+  static constexpr NodeId emptySlot = UINT32_MAX;
+
+  AST* ast = nullptr;
+  std::vector<NodeId> table;
+  std::vector<uint64_t> hashes; // Of every node of the AST, by id
+  std::vector<NodeId> remap; // Ids of the imported nodes in the target
+  std::vector<NodeId> mapped; // Children of the node being imported
+  size_t shared = 0;
+
+  static uint64_t hash(const ASTLeaf& leaf, const NodeId* children, const uint32_t count)
+  {
+    uint64_t words[2];
+    encodeLeaf(leaf, words);
+    uint64_t result = mixHash(mixHash(count, words[0]), words[1]);
+    for (uint32_t i = 0; i < count; i++)
+    {
+      result = mixHash(result, children[i]);
+    }
+    return result;
+  }
+
+  bool matches(const NodeId id, const ASTLeaf& leaf, const uint64_t* words, const NodeId* children, const uint32_t count) const
+  {
+    const ASTNode& node = ast->nodes[id];
+    if (node.argCount != count)
+    {
+      return false;
+    }
+    uint64_t nodeWords[2];
+    encodeLeaf(node.leaf, nodeWords);
+    if (nodeWords[0] != words[0] || nodeWords[1] != words[1] || !sameValue(node.leaf, leaf))
+    {
+      return false;
+    }
+    const NodeId* args = ast->args.data()+node.firstArg;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (args[i] != children[i])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  NodeId intern(const ASTLeaf& leaf, const NodeId* children, const uint32_t count)
+  {
+    const uint64_t result = hash(leaf, children, count);
+    uint64_t words[2];
+    encodeLeaf(leaf, words);
+    const size_t mask = table.size()-1;
+    for (size_t slot = result & mask; table[slot] != emptySlot; slot = (slot+1) & mask)
+    {
+      const NodeId candidate = table[slot];
+      if (hashes[candidate] == result && matches(candidate, leaf, words, children, count))
+      {
+        shared++;
+        return candidate;
+      }
+    }
+    const NodeId id = std::holds_alternative<Functions>(leaf.type) ? ast->addNode(std::get<Functions>(leaf.type), children, count)
+      : ast->addLeaf(leaf);
+    hashes.push_back(result);
+    if (2*hashes.size() > table.size())
+    {
+      grow();
+    }
+    insert(id);
+    return id;
+  }
+
+  void insert(const NodeId id)
+  {
+    const size_t mask = table.size()-1;
+    size_t slot = hashes[id] & mask;
+    while (table[slot] != emptySlot)
+    {
+      slot = (slot+1) & mask;
+    }
+    table[slot] = id;
+  }
+
+  // Doubles the table and reinserts every node but the newest one, which the caller inserts
+  void grow()
+  {
+    table.assign(2*table.size(), emptySlot);
+    for (NodeId id = 0; id+1 < hashes.size(); id++)
+    {
+      insert(id);
+    }
+  }
+};
+
+#endif
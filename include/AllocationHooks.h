@@ -0,0 +1,170 @@
+#ifndef ALLOCATIONHOOKS_H
+#define ALLOCATIONHOOKS_H
+
+// Replaces the global allocation functions so that Allocations can count them. Replacements may only be defined once
+//   per program, so this header belongs in the translation unit holding main and nowhere else
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "Allocations.h"
+
+#if MATHSOLVER_COUNT_ALLOCATIONS
+namespace AllocationHooks
+{
+  // Stored right before every pointer handed out, so frees know how many bytes they release and where the block starts
+  struct Header
+  {
+    size_t size;
+    size_t offset; // Distance from the start of the malloc'd block to the pointer handed out
+  };
+
+  constexpr size_t headerSpace = alignof(std::max_align_t) > sizeof(Header) ? alignof(std::max_align_t) : sizeof(Header);
+
+  inline void* allocate(const size_t size, size_t alignment) noexcept
+  {
+    if (alignment < alignof(std::max_align_t))
+    {
+      alignment = alignof(std::max_align_t);
+    }
+    const size_t extra = headerSpace+(alignment > alignof(std::max_align_t) ? alignment : 0);
+    char* block = (char*)std::malloc(size+extra);
+    if (!block)
+    {
+      return nullptr;
+    }
+    const uintptr_t aligned = ((uintptr_t)block+headerSpace+alignment-1) & ~(uintptr_t)(alignment-1);
+    char* pointer = (char*)aligned;
+    Header* header = (Header*)(pointer-sizeof(Header));
+    header->size = size;
+    header->offset = (size_t)(pointer-block);
+    Allocations::recordAllocation(size);
+    return pointer;
+  }
+
+  inline void* allocateOrThrow(const size_t size, const size_t alignment)
+  {
+    void* pointer = allocate(size, alignment);
+    if (!pointer)
+    {
+      throw std::bad_alloc();
+    }
+    return pointer;
+  }
+
+  inline void release(void* pointer) noexcept
+  {
+    if (!pointer)
+    {
+      return;
+    }
+    const Header* header = (const Header*)((char*)pointer-sizeof(Header));
+    Allocations::recordFree(header->size);
+    std::free((char*)pointer-header->offset);
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  return AllocationHooks::allocateOrThrow(size, 0);
+}
+
+void* operator new[](std::size_t size)
+{
+  return AllocationHooks::allocateOrThrow(size, 0);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return AllocationHooks::allocate(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return AllocationHooks::allocate(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return AllocationHooks::allocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return AllocationHooks::allocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return AllocationHooks::allocate(size, (size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return AllocationHooks::allocate(size, (size_t)alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  AllocationHooks::release(pointer);
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocation accounting is compiled in by default. Defining MATHSOLVER_COUNT_ALLOCATIONS as 0 removes the counters,
+//   turns every AllocationScope into an empty object and leaves the global operator new untouched
+#ifndef MATHSOLVER_COUNT_ALLOCATIONS
+#define MATHSOLVER_COUNT_ALLOCATIONS 1
+#endif
+
+// Stage of the pipeline an allocation is charged to; NONE covers everything outside the parser
+enum class AllocationPhases : uint8_t
+{
+  NONE,
+  TOKENIZE,
+  RPN,
+  RPN2AST,
+  TOJSON,
+};
+
+constexpr size_t allocationPhaseCount = (size_t)AllocationPhases::TOJSON + 1;
+
+struct AllocationCounters
+{
+  uint64_t allocations = 0;
+  uint64_t frees = 0;
+  uint64_t bytes = 0; // Requested by every allocation, freed or not
+  uint64_t freedBytes = 0;
+  int64_t liveBytes = 0; // Allocated minus freed by this thread, so memory freed by another thread moves to its balance
+  int64_t peakLiveBytes = 0;
+
+  void allocate(const size_t size)
+  {
+    allocations++;
+    bytes += size;
+    liveBytes += (int64_t)size;
+    if (liveBytes > peakLiveBytes) peakLiveBytes = liveBytes;
+  }
+
+  void free(const size_t size)
+  {
+    frees++;
+    freedBytes += size;
+    liveBytes -= (int64_t)size;
+  }
+
+  // Counters accumulated since before was taken. The peak is only meaningful if Allocations::resetPeak() was called
+  //   when before was taken, and is then the highest live balance reached above it
+  AllocationCounters operator-(const AllocationCounters& before) const
+  {
+    AllocationCounters delta;
+    delta.allocations = allocations-before.allocations;
+    delta.frees = frees-before.frees;
+    delta.bytes = bytes-before.bytes;
+    delta.freedBytes = freedBytes-before.freedBytes;
+    delta.liveBytes = liveBytes-before.liveBytes;
+    delta.peakLiveBytes = peakLiveBytes-before.liveBytes;
+    return delta;
+  }
+};
+
+struct AllocationSnapshot
+{
+  AllocationCounters total;
+  AllocationCounters phases[allocationPhaseCount];
+
+  AllocationSnapshot operator-(const AllocationSnapshot& before) const
+  {
+    AllocationSnapshot delta;
+    delta.total = total-before.total;
+    for (size_t i = 0; i < allocationPhaseCount; i++)
+    {
+      delta.phases[i] = phases[i]-before.phases[i];
+    }
+    return delta;
+  }
+};
+
+/*
+  Per-thread allocation counters, fed by the replacement allocation functions in AllocationHooks.h. Every thread only
+  ever touches its own counters, so counting needs no atomics and parallel parsers never race on them; an allocation
+  costs a handful of thread-local additions. Totals across threads are the sum of what each thread reports.
+*/
+class Allocations
+{
+  public:
+  static constexpr bool compiled = MATHSOLVER_COUNT_ALLOCATIONS;
+
+  static const AllocationCounters& thread()
+  {
+    return total;
+  }
+
+  static const AllocationCounters& phase(const AllocationPhases phase)
+  {
+    return phases[(size_t)phase];
+  }
+
+  static AllocationPhases currentPhase()
+  {
+    return current;
+  }
+
+  static AllocationSnapshot snapshot()
+  {
+    AllocationSnapshot result;
+    result.total = total;
+    for (size_t i = 0; i < allocationPhaseCount; i++)
+    {
+      result.phases[i] = phases[i];
+    }
+    return result;
+  }
+
+  // Starts a new peak measurement from the current live balance of this thread
+  static void resetPeak()
+  {
+    total.peakLiveBytes = total.liveBytes;
+    for (AllocationCounters& counters : phases)
+    {
+      counters.peakLiveBytes = counters.liveBytes;
+    }
+  }
+
+  static void reset()
+  {
+    total = AllocationCounters();
+    for (AllocationCounters& counters : phases)
+    {
+      counters = AllocationCounters();
+    }
+  }
+
+  static void recordAllocation(const size_t size)
+  {
+    total.allocate(size);
+    phases[(size_t)current].allocate(size);
+  }
+
+  static void recordFree(const size_t size)
+  {
+    total.free(size);
+    phases[(size_t)current].free(size);
+  }
+
+  static const char* phaseName(const AllocationPhases phase)
+  {
+    switch (phase)
+    {
+      case AllocationPhases::TOKENIZE:
+      return "tokenize";
+      case AllocationPhases::RPN:
+      return "rpn";
+      case AllocationPhases::RPN2AST:
+      return "rpn2ast";
+      case AllocationPhases::TOJSON:
+      return "json";
+      default:
+      return "none";
+    }
+  }
+
+  private:
+  friend class AllocationScope;
+
+  inline static thread_local AllocationCounters total;
+  inline static thread_local AllocationCounters phases[allocationPhaseCount];
+  inline static thread_local AllocationPhases current = AllocationPhases::NONE;
+};
+
+// Charges the allocations made during its lifetime to a phase; scopes nest, and the innermost one wins
+#if MATHSOLVER_COUNT_ALLOCATIONS
+class AllocationScope
+{
+  public:
+  explicit AllocationScope(const AllocationPhases phase) : previous(Allocations::current)
+  {
+    Allocations::current = phase;
+  }
+
+  ~AllocationScope()
+  {
+    Allocations::current = previous;
+  }
+
+  AllocationScope(const AllocationScope&) = delete;
+  AllocationScope& operator=(const AllocationScope&) = delete;
+
+  private:
+  AllocationPhases previous;
+};
+#else
+class AllocationScope
+{
+  public:
+  explicit AllocationScope(AllocationPhases) {}
+};
+#endif
+
+#endif
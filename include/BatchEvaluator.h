@@ -0,0 +1,484 @@
+#ifndef BATCHEVALUATOR_H
+#define BATCHEVALUATOR_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "Functions.h"
+#include "Evaluator.h"
+#include "Bytecode.h"
+
+// The SSE2 and AVX2 kernels need the GCC vector extensions and x86 runtime detection; elsewhere only the scalar ones exist
+#ifndef MATHSOLVER_BATCH_SIMD
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATHSOLVER_BATCH_SIMD 1
+#else
+#define MATHSOLVER_BATCH_SIMD 0
+#endif
+#endif
+
+enum class SIMDLevels
+{
+  SCALAR,
+  SSE2,
+  AVX2,
+};
+
+// Column kernels of one instruction set. Comparisons write 1.0 or 0.0 per lane
+struct BatchKernels
+{
+  using Binary = void (*)(const double* a, const double* b, double* out, size_t n);
+  using Unary = void (*)(const double* a, double* out, size_t n);
+
+  Binary add, sub, mul, div, eq, gt, lt, ge, le;
+  Unary neg, abs;
+  bool (*allFinite)(const double* a, size_t n);
+};
+
+namespace ScalarBatchKernels
+{
+  inline void add(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i]+b[i];
+    }
+  }
+
+  inline void sub(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i]-b[i];
+    }
+  }
+
+  inline void mul(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i]*b[i];
+    }
+  }
+
+  inline void div(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i]/b[i];
+    }
+  }
+
+  inline void eq(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i] == b[i] ? 1.0 : 0.0;
+    }
+  }
+
+  inline void gt(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i] > b[i] ? 1.0 : 0.0;
+    }
+  }
+
+  inline void lt(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i] < b[i] ? 1.0 : 0.0;
+    }
+  }
+
+  inline void ge(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i] >= b[i] ? 1.0 : 0.0;
+    }
+  }
+
+  inline void le(const double* a, const double* b, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = a[i] <= b[i] ? 1.0 : 0.0;
+    }
+  }
+
+  inline void neg(const double* a, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = -a[i];
+    }
+  }
+
+  inline void abs(const double* a, double* out, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      out[i] = std::fabs(a[i]);
+    }
+  }
+
+  inline bool allFinite(const double* a, const size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      if (!std::isfinite(a[i])) return false;
+    }
+    return true;
+  }
+
+  constexpr BatchKernels kernels = {add, sub, mul, div, eq, gt, lt, ge, le, neg, abs, allFinite};
+}
+
+#if MATHSOLVER_BATCH_SIMD
+// Broadcast constants loaded by the vector kernels, wide enough for the largest vector
+alignas(32) constexpr double batchOnes[4] = {1.0, 1.0, 1.0, 1.0};
+alignas(32) constexpr double batchZeros[4] = {0.0, 0.0, 0.0, 0.0};
+alignas(32) constexpr double batchSignBits[4] = {-0.0, -0.0, -0.0, -0.0};
+
+#define BATCH_NAMESPACE SSE2BatchKernels
+#define BATCH_TARGET __attribute__((target("sse2")))
+#define BATCH_WIDTH 2
+#include "BatchKernels.h"
+#undef BATCH_NAMESPACE
+#undef BATCH_TARGET
+#undef BATCH_WIDTH
+
+#define BATCH_NAMESPACE AVX2BatchKernels
+#define BATCH_TARGET __attribute__((target("avx2")))
+#define BATCH_WIDTH 4
+#include "BatchKernels.h"
+#undef BATCH_NAMESPACE
+#undef BATCH_TARGET
+#undef BATCH_WIDTH
+#endif
+
+// The widest instruction set supported by the running processor
+inline SIMDLevels detectSIMDLevel()
+{
+#if MATHSOLVER_BATCH_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return SIMDLevels::AVX2;
+  if (__builtin_cpu_supports("sse2")) return SIMDLevels::SSE2;
+#endif
+  return SIMDLevels::SCALAR;
+}
+
+// Levels that weren't compiled in fall back to the scalar kernels
+inline const BatchKernels& getBatchKernels(const SIMDLevels level)
+{
+  switch (level)
+  {
+#if MATHSOLVER_BATCH_SIMD
+    case SIMDLevels::AVX2:
+    return AVX2BatchKernels::kernels;
+    case SIMDLevels::SSE2:
+    return SSE2BatchKernels::kernels;
+#endif
+    default:
+    return ScalarBatchKernels::kernels;
+  }
+}
+
+inline const char* getSIMDLevelName(const SIMDLevels level)
+{
+  switch (level)
+  {
+    case SIMDLevels::SSE2:
+    return "sse2";
+    case SIMDLevels::AVX2:
+    return "avx2";
+    default:
+    return "scalar";
+  }
+}
+
+// Columns of variable values, indexed by the variable character like Bindings. Every column must hold at least as
+//   many values as the batch being evaluated
+class BatchBindings
+{
+  public:
+  void set(const char name, const double* column)
+  {
+    columns[(unsigned char)name & 0x7F] = column;
+  }
+
+  void unset(const char name)
+  {
+    columns[(unsigned char)name & 0x7F] = nullptr;
+  }
+
+  void clear()
+  {
+    columns.fill(nullptr);
+  }
+
+  // Null when the variable isn't bound
+  const double* get(const char name) const
+  {
+    return columns[(unsigned char)name & 0x7F];
+  }
+
+  private:
+  std::array<const double*, 128> columns{};
+};
+
+/*
+  Evaluates one bytecode program over columns of variable values. The input is processed in blocks of blockSize lanes,
+  and every value on the program stack becomes a register holding one block, so all live registers stay in L1/L2.
+
+  Arithmetic, ABS and the relational operators run as vector kernels while the operands of a block hold no error
+  state; if any lane then leaves the finite numbers, the block is recomputed lane by lane through the scalar kernels.
+  Everything else (exponentiation and the transcendental functions) always goes lane by lane through the kernel table,
+  so every lane gets exactly the value and error state that Evaluator would give it.
+*/
+class BatchEvaluator
+{
+  public:
+  static constexpr size_t blockSize = 256;
+
+  BatchEvaluator() : BatchEvaluator(detectSIMDLevel()) {}
+  explicit BatchEvaluator(const SIMDLevels level) : level(level), kernels(&getBatchKernels(level)) {}
+
+  SIMDLevels getSIMDLevel() const
+  {
+    return level;
+  }
+
+  // Writes the value of lane i to values[i] and its state to types[i] (if given); error lanes hold 0 as their value
+  void evaluate(const Bytecode& bytecode, const BatchBindings& columns, const size_t count, double* values, AtomicTypes* types = nullptr)
+  {
+    const size_t registerCount = bytecode.maxDepth+1; // One more than the stack depth, used as scratch by the vector kernels
+    if (registerValues.size() < registerCount*blockSize)
+    {
+      registerValues.resize(registerCount*blockSize);
+      registerTypes.resize(registerCount*blockSize);
+      slots.resize(registerCount);
+      clean.resize(registerCount);
+    }
+    for (size_t offset = 0; offset < count; offset += blockSize)
+    {
+      evaluateBlock(bytecode, columns, offset, std::min(blockSize, count-offset), values, types);
+    }
+  }
+
+  private:
+  SIMDLevels level;
+  const BatchKernels* kernels;
+  std::vector<double> registerValues;
+  std::vector<AtomicTypes> registerTypes;
+  std::vector<uint32_t> slots; // Physical register of every stack position, so results can be swapped in instead of copied
+  std::vector<uint8_t> clean; // True when no lane of the stack position holds an error state
+  std::vector<Evaluation> operands;
+
+  double* valuesAt(const size_t position)
+  {
+    return registerValues.data()+slots[position]*blockSize;
+  }
+
+  AtomicTypes* typesAt(const size_t position)
+  {
+    return registerTypes.data()+slots[position]*blockSize;
+  }
+
+  void evaluateBlock(const Bytecode& bytecode, const BatchBindings& columns, const size_t offset, const size_t n, double* values, AtomicTypes* types)
+  {
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+      slots[i] = (uint32_t)i;
+    }
+    size_t top = 0;
+    for (const Instruction& instruction : bytecode.code)
+    {
+      switch (instruction.opcode)
+      {
+        case Opcodes::CONSTANT:
+        {
+          const Evaluation constant = bytecode.pool[instruction.operand];
+          std::fill(valuesAt(top), valuesAt(top)+n, constant.value);
+          std::fill(typesAt(top), typesAt(top)+n, constant.type);
+          clean[top] = !constant.isError();
+          top++;
+        }
+        break;
+        case Opcodes::VARIABLE:
+        {
+          const double* column = columns.get((char)instruction.operand);
+          if (column)
+          {
+            std::memcpy(valuesAt(top), column+offset, n*sizeof(double));
+            std::fill(typesAt(top), typesAt(top)+n, AtomicTypes::REAL);
+            clean[top] = true;
+          }
+          else
+          {
+            std::fill(valuesAt(top), valuesAt(top)+n, 0.0);
+            std::fill(typesAt(top), typesAt(top)+n, AtomicTypes::UNDETERMINED);
+            clean[top] = false;
+          }
+          top++;
+        }
+        break;
+        case Opcodes::ADD:
+        top = vectorArithmetic(top, instruction.argCount, kernels->add, Functions::ADDITION, n);
+        break;
+        case Opcodes::SUB:
+        top = vectorArithmetic(top, 2, kernels->sub, Functions::SUBTRACTION, n);
+        break;
+        case Opcodes::MUL:
+        top = vectorArithmetic(top, instruction.argCount, kernels->mul, Functions::MULTIPLICATION, n);
+        break;
+        case Opcodes::DIV:
+        top = vectorArithmetic(top, 2, kernels->div, Functions::DIVISION, n);
+        break;
+        case Opcodes::NEG:
+        top = vectorUnary(top, kernels->neg, Functions::UNSUBTRACTION, n);
+        break;
+        case Opcodes::POW:
+        top = lanewise(top, 2, Functions::EXPONENTIATION, n);
+        break;
+        case Opcodes::CALL:
+        top = call(top, instruction.argCount, (Functions)instruction.operand, n);
+        break;
+        case Opcodes::RETURN:
+        std::memcpy(values+offset, valuesAt(top-1), n*sizeof(double));
+        if (types)
+        {
+          std::memcpy(types+offset, typesAt(top-1), n*sizeof(AtomicTypes));
+        }
+        return;
+        default:
+        return;
+      }
+    }
+  }
+
+  size_t call(const size_t top, const uint32_t argCount, const Functions function, const size_t n)
+  {
+    switch (function)
+    {
+      case Functions::ABS:
+      return vectorUnary(top, kernels->abs, function, n);
+      case Functions::EQUALS:
+      return vectorComparison(top, kernels->eq, function, n);
+      case Functions::GT:
+      return vectorComparison(top, kernels->gt, function, n);
+      case Functions::LT:
+      return vectorComparison(top, kernels->lt, function, n);
+      case Functions::GE:
+      return vectorComparison(top, kernels->ge, function, n);
+      case Functions::LE:
+      return vectorComparison(top, kernels->le, function, n);
+      default:
+      return lanewise(top, argCount, function, n);
+    }
+  }
+
+  // Folds argCount operands left to right into the scratch register, which then takes the place of the first operand
+  size_t vectorArithmetic(const size_t top, const uint32_t argCount, const BatchKernels::Binary kernel, const Functions function, const size_t n)
+  {
+    const size_t base = top-argCount;
+    if (argCount >= 2 && allClean(base, top))
+    {
+      kernel(valuesAt(base), valuesAt(base+1), valuesAt(top), n);
+      for (size_t i = base+2; i < top; i++)
+      {
+        kernel(valuesAt(top), valuesAt(i), valuesAt(top), n);
+      }
+      if (kernels->allFinite(valuesAt(top), n))
+      {
+        return accept(base, top, AtomicTypes::REAL, n);
+      }
+    }
+    return lanewise(top, argCount, function, n);
+  }
+
+  size_t vectorUnary(const size_t top, const BatchKernels::Unary kernel, const Functions function, const size_t n)
+  {
+    const size_t base = top-1;
+    if (clean[base])
+    {
+      kernel(valuesAt(base), valuesAt(top), n);
+      if (kernels->allFinite(valuesAt(top), n))
+      {
+        return accept(base, top, AtomicTypes::REAL, n);
+      }
+    }
+    return lanewise(top, 1, function, n);
+  }
+
+  size_t vectorComparison(const size_t top, const BatchKernels::Binary kernel, const Functions function, const size_t n)
+  {
+    const size_t base = top-2;
+    if (allClean(base, top))
+    {
+      kernel(valuesAt(base), valuesAt(base+1), valuesAt(top), n);
+      return accept(base, top, AtomicTypes::PROPOSITION, n);
+    }
+    return lanewise(top, 2, function, n);
+  }
+
+  bool allClean(const size_t base, const size_t top) const
+  {
+    for (size_t i = base; i < top; i++)
+    {
+      if (!clean[i]) return false;
+    }
+    return true;
+  }
+
+  // Moves the result in the scratch register to stack position base
+  size_t accept(const size_t base, const size_t top, const AtomicTypes type, const size_t n)
+  {
+    std::swap(slots[base], slots[top]);
+    std::fill(typesAt(base), typesAt(base)+n, type);
+    clean[base] = true;
+    return base+1;
+  }
+
+  // Evaluates every lane through the scalar kernel, writing each result over the first operand of its lane
+  size_t lanewise(const size_t top, const uint32_t argCount, const Functions function, const size_t n)
+  {
+    const size_t base = top-argCount;
+    if (operands.size() < argCount)
+    {
+      operands.resize(argCount);
+    }
+    const Kernel kernel = getKernel(function);
+    double* resultValues = valuesAt(base);
+    AtomicTypes* resultTypes = typesAt(base);
+    bool resultClean = true;
+    for (size_t lane = 0; lane < n; lane++)
+    {
+      Evaluation propagated;
+      for (uint32_t i = 0; i < argCount; i++)
+      {
+        operands[i] = {typesAt(base+i)[lane], valuesAt(base+i)[lane]};
+        if (operands[i].isError() && !propagated.isError())
+        {
+          propagated = operands[i];
+        }
+      }
+      const Evaluation result = propagated.isError() ? propagated : kernel(operands.data(), argCount);
+      resultValues[lane] = result.value;
+      resultTypes[lane] = result.type;
+      resultClean = resultClean && !result.isError();
+    }
+    clean[base] = resultClean;
+    return base+1;
+  }
+};
+
+#endif
@@ -0,0 +1,99 @@
+// No include guard: BatchEvaluator.h includes this file once per instruction set after defining BATCH_NAMESPACE (namespace
+//   of the kernels), BATCH_TARGET (target attribute of every function) and BATCH_WIDTH (doubles per vector register).
+//   The kernels use the GCC vector extensions, so each copy compiles to the instructions of its own target
+
+namespace BATCH_NAMESPACE
+{
+  typedef double Vector __attribute__((vector_size(BATCH_WIDTH*sizeof(double))));
+  typedef long long Mask __attribute__((vector_size(BATCH_WIDTH*sizeof(double))));
+
+  BATCH_TARGET inline Vector load(const double* p)
+  {
+    Vector v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  BATCH_TARGET inline void store(double* p, const Vector v)
+  {
+    std::memcpy(p, &v, sizeof(v));
+  }
+
+  // Comparison masks are all ones or all zeros per lane, so and-ing them with the bits of 1.0 yields 1.0 or 0.0
+  BATCH_TARGET inline Vector toNumber(const Mask m)
+  {
+    const Vector one = load(batchOnes);
+    return (Vector)(m & (Mask)one);
+  }
+
+  #define BATCH_BINARY(name, vectorOperation, scalarOperation) \
+    BATCH_TARGET inline void name(const double* a, const double* b, double* out, const size_t n) \
+    { \
+      size_t i = 0; \
+      for (; i+BATCH_WIDTH <= n; i += BATCH_WIDTH) \
+      { \
+        const Vector x = load(a+i), y = load(b+i); \
+        store(out+i, vectorOperation); \
+      } \
+      for (; i < n; i++) \
+      { \
+        const double x = a[i], y = b[i]; \
+        out[i] = scalarOperation; \
+      } \
+    }
+
+  #define BATCH_UNARY(name, vectorOperation, scalarOperation) \
+    BATCH_TARGET inline void name(const double* a, double* out, const size_t n) \
+    { \
+      size_t i = 0; \
+      for (; i+BATCH_WIDTH <= n; i += BATCH_WIDTH) \
+      { \
+        const Vector x = load(a+i); \
+        store(out+i, vectorOperation); \
+      } \
+      for (; i < n; i++) \
+      { \
+        const double x = a[i]; \
+        out[i] = scalarOperation; \
+      } \
+    }
+
+  BATCH_BINARY(add, x+y, x+y)
+  BATCH_BINARY(sub, x-y, x-y)
+  BATCH_BINARY(mul, x*y, x*y)
+  BATCH_BINARY(div, x/y, x/y)
+  BATCH_BINARY(eq, toNumber(x == y), x == y ? 1.0 : 0.0)
+  BATCH_BINARY(gt, toNumber(x > y), x > y ? 1.0 : 0.0)
+  BATCH_BINARY(lt, toNumber(x < y), x < y ? 1.0 : 0.0)
+  BATCH_BINARY(ge, toNumber(x >= y), x >= y ? 1.0 : 0.0)
+  BATCH_BINARY(le, toNumber(x <= y), x <= y ? 1.0 : 0.0)
+  BATCH_UNARY(neg, -x, -x)
+  BATCH_UNARY(abs, (Vector)((Mask)x & ~(Mask)load(batchSignBits)), std::fabs(x))
+
+  #undef BATCH_BINARY
+  #undef BATCH_UNARY
+
+  // x-x is 0 for finite x and NaN for infinities and NaNs, and a NaN survives any sum of the differences
+  BATCH_TARGET inline bool allFinite(const double* a, const size_t n)
+  {
+    Vector accumulated = load(batchZeros);
+    size_t i = 0;
+    for (; i+BATCH_WIDTH <= n; i += BATCH_WIDTH)
+    {
+      const Vector x = load(a+i);
+      accumulated += x-x;
+    }
+    double total = 0;
+    for (size_t lane = 0; lane < BATCH_WIDTH; lane++)
+    {
+      total += accumulated[lane];
+    }
+    for (; i < n; i++)
+    {
+      total += a[i]-a[i];
+    }
+    return total == 0;
+  }
+
+  constexpr BatchKernels kernels = {add, sub, mul, div, eq, gt, lt, ge, le, neg, abs, allFinite};
+}
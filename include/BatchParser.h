@@ -0,0 +1,254 @@
+#ifndef BATCHPARSER_H
+#define BATCHPARSER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryAST.h"
+#include "Diagnostics.h"
+#include "ExpressionCache.h"
+#include "JSONWriter.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+#include "Allocations.h"
+
+enum class BatchFormats : uint8_t
+{
+  JSON, // One line per input line
+  BINARY, // One BinaryAST record per input line, empty for the lines that threw
+  DIAGNOSTICS, // One JSON array of the errors of each input line, without building ASTs
+};
+
+struct BatchStatistics
+{
+  size_t lines = 0;
+  size_t failures = 0; // Lines with diagnostics or that threw while parsing
+  size_t chunks = 0;
+  double seconds = 0;
+  uint64_t allocations = 0; // Summed over the workers, zero when allocation counting is compiled out
+  uint64_t allocatedBytes = 0;
+};
+
+/*
+  Parses newline-delimited expressions across a thread pool. The input is streamed in blocks that are cut at their last
+  newline into chunks, and each chunk becomes one task that parses its lines with the Parser of the worker running it
+  and serializes them into the chunk's own output buffer. Chunks are written out strictly in input order as soon as
+  the oldest one finishes; at most a few chunks per worker are kept in flight, so memory stays bounded for any input size.
+*/
+class BatchParser
+{
+  public:
+  static constexpr size_t chunkBytes = 1 << 18;
+
+  // With a cache, repeated expressions are served from it instead of being parsed again
+  explicit BatchParser(const size_t threadCount = std::thread::hardware_concurrency(), ExpressionCache* cache = nullptr,
+    const BatchFormats format = BatchFormats::JSON)
+    : cache(cache), format(format), parsers(threadCount ? threadCount : 1), writers(threadCount ? threadCount : 1),
+    jsonWriters(threadCount ? threadCount : 1), pool(threadCount ? threadCount : 1)
+  {
+  }
+
+  // Writes one line per input line to output: the JSON of its AST, or {"error":message} if parsing threw. In binary
+  //   format, writes one record per input line instead, and in diagnostics format the array of its errors
+  BatchStatistics run(FILE* input, FILE* output)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    BatchStatistics statistics;
+    std::deque<std::unique_ptr<Chunk>> inFlight;
+    const size_t maxInFlight = 4*pool.size();
+    std::string pending;
+    while (true)
+    {
+      const size_t previous = pending.size();
+      pending.resize(previous+chunkBytes);
+      const size_t read = std::fread(&pending[previous], 1, chunkBytes, input);
+      pending.resize(previous+read);
+      if (read == 0)
+      {
+        break;
+      }
+      const size_t lastNewline = pending.rfind('\n');
+      // A line longer than a block keeps accumulating until its newline shows up
+      if (lastNewline == std::string::npos)
+      {
+        continue;
+      }
+      std::unique_ptr<Chunk> chunk(new Chunk());
+      chunk->text.swap(pending);
+      pending.assign(chunk->text, lastNewline+1, std::string::npos);
+      chunk->text.resize(lastNewline+1);
+      dispatch(std::move(chunk), inFlight);
+      writeFinished(inFlight, output, statistics, maxInFlight);
+    }
+    if (!pending.empty())
+    {
+      std::unique_ptr<Chunk> chunk(new Chunk());
+      chunk->text.swap(pending);
+      dispatch(std::move(chunk), inFlight);
+    }
+    writeFinished(inFlight, output, statistics, 0);
+    std::fflush(output);
+    statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return statistics;
+  }
+
+  size_t getThreadCount() const
+  {
+    return pool.size();
+  }
+
+  private:
+  struct Chunk
+  {
+    std::string text;
+    std::string output;
+    size_t lines = 0;
+    size_t failures = 0;
+    AllocationCounters allocations; // Made by the worker while parsing and serializing this chunk
+    bool done = false;
+  };
+
+  ExpressionCache* cache;
+  BatchFormats format;
+  // Declared before the pool so that the workers are joined before the parsers and the condition go away
+  std::vector<Parser> parsers;
+  std::vector<BinaryASTWriter> writers;
+  std::vector<JSONWriter> jsonWriters;
+  std::mutex doneMutex;
+  std::condition_variable doneCondition;
+  ThreadPool pool;
+
+  void dispatch(std::unique_ptr<Chunk> chunk, std::deque<std::unique_ptr<Chunk>>& inFlight)
+  {
+    Chunk* task = chunk.get();
+    inFlight.push_back(std::move(chunk));
+    pool.submit([this, task](const size_t worker)
+    {
+      if (format == BatchFormats::DIAGNOSTICS)
+      {
+        validateChunk(*task, parsers[worker]);
+      }
+      else
+      {
+        parseChunk(*task, parsers[worker], format == BatchFormats::BINARY ? &writers[worker] : nullptr, jsonWriters[worker], cache);
+      }
+      // Notified under the lock, so run can't return and destroy the condition while it is being signalled
+      std::lock_guard<std::mutex> lock(doneMutex);
+      task->done = true;
+      doneCondition.notify_all();
+    });
+  }
+
+  // Cuts the next line off text, without its line terminator
+  static std::string_view nextLine(std::string_view& text)
+  {
+    const size_t newline = text.find('\n');
+    std::string_view line = text.substr(0, newline);
+    text = newline == std::string_view::npos ? std::string_view() : text.substr(newline+1);
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.remove_suffix(1);
+    }
+    return line;
+  }
+
+  // Without a binary writer the chunk is serialized as JSON
+  static void parseChunk(Chunk& chunk, Parser& parser, BinaryASTWriter* writer, JSONWriter& json, ExpressionCache* cache)
+  {
+    const AllocationCounters before = Allocations::thread();
+    chunk.output.reserve(chunk.text.size()*2);
+    std::string_view text = chunk.text;
+    while (!text.empty())
+    {
+      const std::string_view line = nextLine(text);
+      chunk.lines++;
+      try
+      {
+        std::shared_ptr<const AST> cached;
+        const AST& ast = cache ? *(cached = cache->Parse(line, parser)) : parser.Parse(line);
+        if (!parser.getDiagnostics().empty())
+        {
+          chunk.failures++;
+        }
+        if (writer)
+        {
+          writer->write(ast, chunk.output);
+          continue;
+        }
+        json.write(ast, chunk.output);
+      }
+      catch (const std::exception& e)
+      {
+        chunk.failures++;
+        if (writer)
+        {
+          writer->writeEmpty(chunk.output);
+          continue;
+        }
+        chunk.output += "{\"error\":";
+        JSONWriter::appendString(e.what(), chunk.output);
+        chunk.output += '}';
+      }
+      chunk.output += '\n';
+    }
+    chunk.allocations = Allocations::thread()-before;
+  }
+
+  // Validation never throws: every line gets its array of diagnostics, empty when it is well formed
+  static void validateChunk(Chunk& chunk, Parser& parser)
+  {
+    const AllocationCounters before = Allocations::thread();
+    chunk.output.reserve(chunk.text.size()/4);
+    std::string_view text = chunk.text;
+    while (!text.empty())
+    {
+      const Diagnostics& diagnostics = parser.Validate(nextLine(text));
+      chunk.lines++;
+      if (!diagnostics.empty())
+      {
+        chunk.failures++;
+      }
+      JSONWriter::appendDiagnostics(diagnostics, chunk.output);
+      chunk.output += '\n';
+    }
+    chunk.allocations = Allocations::thread()-before;
+  }
+
+  // Writes the finished chunks at the front of the queue, waiting for the oldest one while more than limit are in flight
+  void writeFinished(std::deque<std::unique_ptr<Chunk>>& inFlight, FILE* output, BatchStatistics& statistics, const size_t limit)
+  {
+    while (!inFlight.empty())
+    {
+      Chunk& oldest = *inFlight.front();
+      {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        if (!oldest.done)
+        {
+          if (inFlight.size() <= limit)
+          {
+            return;
+          }
+          doneCondition.wait(lock, [&oldest]() { return oldest.done; });
+        }
+      }
+      std::fwrite(oldest.output.data(), 1, oldest.output.size(), output);
+      statistics.lines += oldest.lines;
+      statistics.failures += oldest.failures;
+      statistics.chunks++;
+      statistics.allocations += oldest.allocations.allocations;
+      statistics.allocatedBytes += oldest.allocations.bytes;
+      inFlight.pop_front();
+    }
+  }
+};
+
+#endif
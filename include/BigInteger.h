@@ -0,0 +1,696 @@
+#ifndef BIGINTEGER_H
+#define BIGINTEGER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+  Arbitrary-precision integer in sign-magnitude form over 32-bit limbs, least significant first. The size field holds
+  the number of limbs with the sign of the number, like GMP, so the object takes 16 bytes: values that fit in 64 bits
+  keep their limbs inline and never allocate, larger ones own a heap buffer that only grows.
+
+  Multiplication is schoolbook below karatsubaThreshold limbs and Karatsuba above, with all of its temporaries carved
+  out of one scratch buffer per product. Decimal literals are parsed nine digits per limb operation, and long ones by
+  splitting them around a power 10^(9*2^j) and multiplying the halves back, which makes parsing as fast as a product.
+  Conversion back to decimal divides by 10^9 repeatedly, quadratic but fine for the sizes results are capped at.
+*/
+class BigInteger
+{
+  public:
+  using Limb = uint32_t;
+  static constexpr size_t karatsubaThreshold = 32;
+
+  BigInteger() : local{0, 0} {}
+
+  explicit BigInteger(const int64_t value) : local{0, 0}
+  {
+    uint64_t magnitude = value < 0 ? 0-(uint64_t)value : (uint64_t)value;
+    int32_t length = 0;
+    while (magnitude != 0)
+    {
+      local[length++] = (Limb)magnitude;
+      magnitude >>= 32;
+    }
+    size = value < 0 ? -length : length;
+  }
+
+  BigInteger(const BigInteger& other) : local{0, 0}
+  {
+    assign(other);
+  }
+
+  BigInteger(BigInteger&& other) noexcept : local{0, 0}
+  {
+    steal(other);
+  }
+
+  BigInteger& operator=(const BigInteger& other)
+  {
+    if (this != &other)
+    {
+      assign(other);
+    }
+    return *this;
+  }
+
+  BigInteger& operator=(BigInteger&& other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      steal(other);
+    }
+    return *this;
+  }
+
+  ~BigInteger()
+  {
+    release();
+  }
+
+  // Parses a run of decimal digits, returning false if text is empty or holds anything else
+  static bool parse(const std::string_view text, BigInteger& result)
+  {
+    if (text.empty() || !std::all_of(text.begin(), text.end(), [](const char c) { return c >= '0' && c <= '9'; }))
+    {
+      return false;
+    }
+    const size_t first = std::min(text.find_first_not_of('0'), text.size());
+    std::vector<BigInteger> powers;
+    result = parseDigits(text.substr(first), powers);
+    return true;
+  }
+
+  std::string toString() const
+  {
+    std::string result;
+    appendDecimal(result);
+    return result;
+  }
+
+  void appendDecimal(std::string& out) const
+  {
+    if (isZero())
+    {
+      out += '0';
+      return;
+    }
+    // Base 10^9 chunks, least significant first
+    BigInteger quotient = abs();
+    std::vector<Limb> chunks;
+    while (!quotient.isZero())
+    {
+      chunks.push_back(quotient.divideSmall(1000000000));
+    }
+    if (isNegative())
+    {
+      out += '-';
+    }
+    char digits[10];
+    out.append(digits, std::to_chars(digits, digits+sizeof(digits), chunks.back()).ptr);
+    for (size_t i = chunks.size()-1; i-- > 0;)
+    {
+      // Zero-padded to nine digits
+      Limb chunk = chunks[i];
+      for (size_t j = 9; j-- > 0;)
+      {
+        digits[j] = (char)('0' + chunk%10);
+        chunk /= 10;
+      }
+      out.append(digits, 9);
+    }
+  }
+
+  bool isZero() const
+  {
+    return size == 0;
+  }
+
+  bool isNegative() const
+  {
+    return size < 0;
+  }
+
+  size_t limbCount() const
+  {
+    return (size_t)std::abs(size);
+  }
+
+  const Limb* limbs() const
+  {
+    return isInline() ? local : heap;
+  }
+
+  size_t bitLength() const
+  {
+    const size_t length = limbCount();
+    if (length == 0)
+    {
+      return 0;
+    }
+    size_t bits = 32*(length-1);
+    for (Limb top = limbs()[length-1]; top != 0; top >>= 1)
+    {
+      bits++;
+    }
+    return bits;
+  }
+
+  // Returns false if the value doesn't fit
+  bool toInt64(int64_t& value) const
+  {
+    const size_t length = limbCount();
+    if (length > 2)
+    {
+      return false;
+    }
+    uint64_t magnitude = 0;
+    for (size_t i = length; i-- > 0;)
+    {
+      magnitude = magnitude << 32 | limbs()[i];
+    }
+    if (magnitude > (isNegative() ? (uint64_t)INT64_MAX+1 : (uint64_t)INT64_MAX))
+    {
+      return false;
+    }
+    value = isNegative() ? (int64_t)(0-magnitude) : (int64_t)magnitude;
+    return true;
+  }
+
+  bool toInt(int& value) const
+  {
+    int64_t wide;
+    if (!toInt64(wide) || wide < INT32_MIN || wide > INT32_MAX)
+    {
+      return false;
+    }
+    value = (int)wide;
+    return true;
+  }
+
+  // Nearest double from the top 96 bits, infinite past the range of doubles
+  // Correctly rounded: the top 64 bits go through one conversion, with the bits below folded into a sticky bit
+  double toDouble() const
+  {
+    const size_t length = limbCount();
+    if (length <= 2)
+    {
+      const double result = (double)(length == 2 ? (uint64_t)limbs()[1] << 32 | limbs()[0] : length ? limbs()[0] : 0);
+      return isNegative() ? -result : result;
+    }
+    const unsigned __int128 window = (unsigned __int128)limbs()[length-1] << 64 | (uint64_t)limbs()[length-2] << 32 | limbs()[length-3];
+    const int shift = 32-__builtin_clz(limbs()[length-1]);
+    const uint64_t top = (uint64_t)(window >> shift);
+    bool sticky = (window & (((unsigned __int128)1 << shift)-1)) != 0;
+    for (size_t i = 0; i < length-3 && !sticky; i++)
+    {
+      sticky = limbs()[i] != 0;
+    }
+    // 64 bits hold 11 more than a double, so the lowest one only ever breaks ties
+    const double result = std::ldexp((double)(top | (sticky ? 1 : 0)), (int)std::min<size_t>(32*(length-3)+shift, 4096));
+    return isNegative() ? -result : result;
+  }
+
+  // Mixes the sign and every limb, for hash tables and hash-consing
+  uint64_t hash() const
+  {
+    uint64_t result = (uint64_t)(int64_t)size;
+    for (size_t i = 0; i < limbCount(); i++)
+    {
+      result = (result ^ limbs()[i])*0x9E3779B97F4A7C15ull;
+      result ^= result >> 29;
+    }
+    return result;
+  }
+
+  int compare(const BigInteger& other) const
+  {
+    if (size != other.size)
+    {
+      return size < other.size ? -1 : 1;
+    }
+    const int magnitude = compareMagnitudes(limbs(), limbCount(), other.limbs(), other.limbCount());
+    return isNegative() ? -magnitude : magnitude;
+  }
+
+  bool operator==(const BigInteger& other) const
+  {
+    return compare(other) == 0;
+  }
+
+  bool operator!=(const BigInteger& other) const
+  {
+    return compare(other) != 0;
+  }
+
+  bool operator<(const BigInteger& other) const
+  {
+    return compare(other) < 0;
+  }
+
+  BigInteger operator-() const
+  {
+    BigInteger result(*this);
+    result.size = -result.size;
+    return result;
+  }
+
+  BigInteger abs() const
+  {
+    BigInteger result(*this);
+    result.size = (int32_t)result.limbCount();
+    return result;
+  }
+
+  BigInteger& operator+=(const BigInteger& other)
+  {
+    addSigned(other, other.isNegative());
+    return *this;
+  }
+
+  BigInteger& operator-=(const BigInteger& other)
+  {
+    addSigned(other, !other.isNegative());
+    return *this;
+  }
+
+  BigInteger& operator*=(const BigInteger& other)
+  {
+    *this = *this*other;
+    return *this;
+  }
+
+  friend BigInteger operator+(BigInteger a, const BigInteger& b)
+  {
+    a += b;
+    return a;
+  }
+
+  friend BigInteger operator-(BigInteger a, const BigInteger& b)
+  {
+    a -= b;
+    return a;
+  }
+
+  friend BigInteger operator*(const BigInteger& a, const BigInteger& b)
+  {
+    BigInteger result;
+    const size_t length = a.limbCount()+b.limbCount();
+    if (a.isZero() || b.isZero())
+    {
+      return result;
+    }
+    result.reserve(length);
+    multiplyMagnitudes(result.data(), a.limbs(), a.limbCount(), b.limbs(), b.limbCount());
+    result.size = (int32_t)length;
+    result.normalize(a.isNegative() != b.isNegative());
+    return result;
+  }
+
+  // The number with count limbs of magnitude, least significant first, given by limb(i)
+  template <typename LimbAt>
+  static BigInteger fromLimbs(const size_t count, const bool negative, LimbAt&& limb)
+  {
+    BigInteger result;
+    result.reserve(count);
+    Limb* digits = result.data();
+    for (size_t i = 0; i < count; i++)
+    {
+      digits[i] = limb(i);
+    }
+    result.size = (int32_t)count;
+    result.normalize(negative);
+    return result;
+  }
+
+  // this = this*factor+addend, on the magnitude
+  void multiplySmall(const Limb factor, const Limb addend = 0)
+  {
+    const size_t length = limbCount();
+    const bool negative = isNegative();
+    reserve(length+1);
+    Limb* digits = data();
+    uint64_t carry = addend;
+    for (size_t i = 0; i < length; i++)
+    {
+      carry += (uint64_t)digits[i]*factor;
+      digits[i] = (Limb)carry;
+      carry >>= 32;
+    }
+    digits[length] = (Limb)carry;
+    size = (int32_t)length+1;
+    normalize(negative);
+  }
+
+  // Divides the magnitude in place and returns the remainder
+  Limb divideSmall(const Limb divisor)
+  {
+    const bool negative = isNegative();
+    Limb* digits = data();
+    uint64_t remainder = 0;
+    for (size_t i = limbCount(); i-- > 0;)
+    {
+      remainder = remainder << 32 | digits[i];
+      digits[i] = (Limb)(remainder/divisor);
+      remainder %= divisor;
+    }
+    normalize(negative);
+    return (Limb)remainder;
+  }
+
+  private:
+  static constexpr uint32_t inlineLimbs = 2;
+
+  int32_t size = 0; // Number of limbs in use, negative for negative numbers
+  uint32_t capacity = inlineLimbs;
+  union
+  {
+    Limb local[inlineLimbs];
+    Limb* heap;
+  };
+
+  bool isInline() const
+  {
+    return capacity <= inlineLimbs;
+  }
+
+  Limb* data()
+  {
+    return isInline() ? local : heap;
+  }
+
+  // Grows the buffer to hold at least length limbs, keeping the ones in use
+  void reserve(const size_t length)
+  {
+    if (length <= capacity)
+    {
+      return;
+    }
+    const size_t grown = std::max<size_t>(length, 2*(size_t)capacity);
+    Limb* buffer = new Limb[grown];
+    std::memcpy(buffer, limbs(), limbCount()*sizeof(Limb));
+    release();
+    heap = buffer;
+    capacity = (uint32_t)grown;
+  }
+
+  void release()
+  {
+    if (!isInline())
+    {
+      delete[] heap;
+      capacity = inlineLimbs;
+    }
+  }
+
+  void assign(const BigInteger& other)
+  {
+    size = 0;
+    reserve(other.limbCount());
+    std::memcpy(data(), other.limbs(), other.limbCount()*sizeof(Limb));
+    size = other.size;
+  }
+
+  void steal(BigInteger& other)
+  {
+    size = other.size;
+    capacity = other.capacity;
+    if (other.isInline())
+    {
+      local[0] = other.local[0];
+      local[1] = other.local[1];
+    }
+    else
+    {
+      heap = other.heap;
+    }
+    other.size = 0;
+    other.capacity = inlineLimbs;
+  }
+
+  // Drops leading zero limbs and applies the sign
+  void normalize(const bool negative)
+  {
+    size_t length = limbCount();
+    const Limb* digits = limbs();
+    while (length > 0 && digits[length-1] == 0)
+    {
+      length--;
+    }
+    size = negative ? -(int32_t)length : (int32_t)length;
+  }
+
+  // Adds the magnitude of other with the sign given by otherNegative
+  void addSigned(const BigInteger& other, const bool otherNegative)
+  {
+    if (this == &other)
+    {
+      const BigInteger copy(other);
+      addSigned(copy, otherNegative);
+      return;
+    }
+    const bool negative = isNegative();
+    const size_t length = limbCount(), otherLength = other.limbCount();
+    if (negative == otherNegative || length == 0)
+    {
+      reserve(std::max(length, otherLength)+1);
+      const size_t sum = addMagnitudes(data(), limbs(), length, other.limbs(), otherLength);
+      size = (int32_t)sum;
+      normalize(length == 0 ? otherNegative : negative);
+      return;
+    }
+    // Opposite signs: the larger magnitude keeps its sign
+    if (compareMagnitudes(limbs(), length, other.limbs(), otherLength) >= 0)
+    {
+      subtractMagnitudes(data(), limbs(), length, other.limbs(), otherLength);
+      size = (int32_t)length;
+      normalize(negative);
+    }
+    else
+    {
+      reserve(otherLength);
+      subtractMagnitudes(data(), other.limbs(), otherLength, limbs(), length);
+      size = (int32_t)otherLength;
+      normalize(otherNegative);
+    }
+  }
+
+  static int compareMagnitudes(const Limb* a, const size_t aLength, const Limb* b, const size_t bLength)
+  {
+    if (aLength != bLength)
+    {
+      return aLength < bLength ? -1 : 1;
+    }
+    for (size_t i = aLength; i-- > 0;)
+    {
+      if (a[i] != b[i])
+      {
+        return a[i] < b[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+
+  // result = a+b, with room for max(aLength, bLength)+1 limbs; result may alias a or b. Returns the length used
+  static size_t addMagnitudes(Limb* result, const Limb* a, const size_t aLength, const Limb* b, const size_t bLength)
+  {
+    const size_t length = std::max(aLength, bLength);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+      carry += (uint64_t)(i < aLength ? a[i] : 0)+(i < bLength ? b[i] : 0);
+      result[i] = (Limb)carry;
+      carry >>= 32;
+    }
+    result[length] = (Limb)carry;
+    return length+1;
+  }
+
+  // result = a-b for a >= b, over aLength limbs; result may alias a or b
+  static void subtractMagnitudes(Limb* result, const Limb* a, const size_t aLength, const Limb* b, const size_t bLength)
+  {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < aLength; i++)
+    {
+      borrow += (int64_t)a[i]-(i < bLength ? b[i] : 0);
+      result[i] = (Limb)borrow;
+      borrow >>= 32;
+    }
+  }
+
+  // target[0, targetLength) += value[0, valueLength), propagating the carry through the rest of target
+  static void addInto(Limb* target, const size_t targetLength, const Limb* value, const size_t valueLength)
+  {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < valueLength; i++)
+    {
+      carry += (uint64_t)target[i]+value[i];
+      target[i] = (Limb)carry;
+      carry >>= 32;
+    }
+    for (; carry != 0 && i < targetLength; i++)
+    {
+      carry += target[i];
+      target[i] = (Limb)carry;
+      carry >>= 32;
+    }
+  }
+
+  static void subtractFrom(Limb* target, const size_t targetLength, const Limb* value, const size_t valueLength)
+  {
+    int64_t borrow = 0;
+    size_t i = 0;
+    for (; i < valueLength; i++)
+    {
+      borrow += (int64_t)target[i]-value[i];
+      target[i] = (Limb)borrow;
+      borrow >>= 32;
+    }
+    for (; borrow != 0 && i < targetLength; i++)
+    {
+      borrow += target[i];
+      target[i] = (Limb)borrow;
+      borrow >>= 32;
+    }
+  }
+
+  // result[0, aLength+bLength) = a*b
+  static void schoolbook(Limb* result, const Limb* a, const size_t aLength, const Limb* b, const size_t bLength)
+  {
+    std::fill(result, result+aLength+bLength, 0);
+    for (size_t i = 0; i < aLength; i++)
+    {
+      uint64_t carry = 0;
+      const uint64_t digit = a[i];
+      for (size_t j = 0; j < bLength; j++)
+      {
+        carry += digit*b[j]+result[i+j];
+        result[i+j] = (Limb)carry;
+        carry >>= 32;
+      }
+      result[i+bLength] = (Limb)carry;
+    }
+  }
+
+  // Limbs of scratch used by karatsuba on two n-limb operands
+  static size_t scratchSize(const size_t n)
+  {
+    if (n < karatsubaThreshold)
+    {
+      return 0;
+    }
+    const size_t high = n-n/2;
+    return 4*(high+1)+scratchSize(high+1);
+  }
+
+  // result[0, 2n) = a*b for two n-limb operands: z0 = a0*b0 and z2 = a1*b1 go straight into result, and
+  //   (a0+a1)(b0+b1)-z0-z2 is added in the middle
+  static void karatsuba(Limb* result, const Limb* a, const Limb* b, const size_t n, Limb* scratch)
+  {
+    if (n < karatsubaThreshold)
+    {
+      schoolbook(result, a, n, b, n);
+      return;
+    }
+    const size_t low = n/2, high = n-low;
+    karatsuba(result, a, b, low, scratch);
+    karatsuba(result+2*low, a+low, b+low, high, scratch);
+    Limb* aSum = scratch;
+    Limb* bSum = aSum+high+1;
+    Limb* middle = bSum+high+1;
+    addMagnitudes(aSum, a+low, high, a, low);
+    addMagnitudes(bSum, b+low, high, b, low);
+    karatsuba(middle, aSum, bSum, high+1, middle+2*(high+1));
+    subtractFrom(middle, 2*(high+1), result, 2*low);
+    subtractFrom(middle, 2*(high+1), result+2*low, 2*high);
+    // The middle term is below 2^(32*(n+1)), so only the limbs that can be non-zero are added
+    addInto(result+low, 2*n-low, middle, std::min(2*(high+1), 2*n-low));
+  }
+
+  // result[0, aLength+bLength) = a*b; result must not alias the operands
+  static void multiplyMagnitudes(Limb* result, const Limb* a, size_t aLength, const Limb* b, size_t bLength)
+  {
+    if (aLength < bLength)
+    {
+      std::swap(a, b);
+      std::swap(aLength, bLength);
+    }
+    if (bLength < karatsubaThreshold)
+    {
+      schoolbook(result, a, aLength, b, bLength);
+      return;
+    }
+    if (aLength >= 2*bLength)
+    {
+      // Lopsided: slices of a as long as b, each one balanced
+      std::fill(result, result+aLength+bLength, 0);
+      std::vector<Limb> partial(2*bLength);
+      for (size_t i = 0; i < aLength; i += bLength)
+      {
+        const size_t slice = std::min(bLength, aLength-i);
+        multiplyMagnitudes(partial.data(), a+i, slice, b, bLength);
+        addInto(result+i, aLength+bLength-i, partial.data(), slice+bLength);
+      }
+      return;
+    }
+    // Close enough in length to pad b with zeros up to a
+    std::vector<Limb> buffer(aLength+2*aLength+scratchSize(aLength));
+    Limb* padded = buffer.data();
+    Limb* product = padded+aLength;
+    std::copy(b, b+bLength, padded);
+    karatsuba(product, a, padded, aLength, product+2*aLength);
+    std::copy(product, product+aLength+bLength, result);
+  }
+
+  // Chunks of nine digits below the threshold, and around a cached power of 10^9 above it
+  static BigInteger parseDigits(const std::string_view digits, std::vector<BigInteger>& powers)
+  {
+    constexpr size_t chunkDigits = 9;
+    BigInteger result;
+    if (digits.size() <= chunkDigits*karatsubaThreshold)
+    {
+      size_t position = 0;
+      size_t chunk = digits.size()%chunkDigits;
+      if (chunk == 0)
+      {
+        chunk = chunkDigits;
+      }
+      for (; position < digits.size(); position += chunk, chunk = chunkDigits)
+      {
+        Limb value = 0;
+        for (size_t i = position; i < position+chunk; i++)
+        {
+          value = value*10+(Limb)(digits[i]-'0');
+        }
+        result.multiplySmall(position == 0 ? 1 : 1000000000, value);
+      }
+      return result;
+    }
+    // The low half holds 9*2^level digits, the largest such count below the length
+    size_t level = 0;
+    while (chunkDigits << (level+1) < digits.size())
+    {
+      level++;
+    }
+    while (powers.size() <= level)
+    {
+      powers.push_back(powers.empty() ? BigInteger(1000000000) : powers.back()*powers.back());
+    }
+    const size_t split = digits.size()-(chunkDigits << level);
+    result = parseDigits(digits.substr(0, split), powers)*powers[level];
+    result += parseDigits(digits.substr(split), powers);
+    return result;
+  }
+};
+
+#endif
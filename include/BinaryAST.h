@@ -0,0 +1,616 @@
+#ifndef BINARYAST_H
+#define BINARYAST_H
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "AtomicTypes.h"
+#include "AuxiliaryTypes.h"
+#include "BigInteger.h"
+#include "Decimal.h"
+#include "Functions.h"
+#include "FunctionTypes.h"
+#include "LookupTables.h"
+
+/*
+  Versioned binary form of an AST, compact enough to store parsed formulas by the million and readable in place: a
+  BinaryASTView walks the bytes of a record, e.g. straight out of a memory-mapped file, without building anything.
+
+  A record is a 12-byte header followed by the node table and the numeric pool, all little-endian:
+    0   magic "MB", version, flags (bit 0: the table holds references)
+    4   uint32 size of the whole record, so records can be appended back to back and skipped without decoding
+    8   uint32 offset of the pool from the start of the record, where the node table ends
+  The node table lists the tree in preorder. Every entry starts with a varint tag whose two low bits give its kind:
+    FUNCTION   tag>>2 is the Functions id, followed by as many argument subtrees as the default arity of its
+               FunctionTypes (2 for BINARY and INTERVAL, 1 for UNARYLEFT and UNARYRIGHT, 0 otherwise)
+    COUNTED    the same with any other argument count, written as a varint after the tag
+    LEAF       tag>>2 is the leaf type: bit 0 set for AuxiliaryTypes, bits 1-2 the kind of value (int, double, big
+               integer, decimal) and the rest the type itself. An int value, 64-bit ones included, follows as a zigzag
+               varint, and a decimal
+               as one varint holding its zigzag significand shifted left by 5 over its scale; doubles (8 bytes) and
+               big integers (int32 limb count carrying the sign, then 32-bit limbs) live in the pool, and the entry
+               holds their pool offset as a varint
+    REFERENCE  tag>>2 is the index of an earlier entry whose whole subtree appears again at this point, so hash-consed
+               ASTs (simplified trees, derivatives) stay as small as their arena instead of repeating shared subtrees
+  A function entry whose argument count is outside what its function takes (BinaryASTFormat::minimumArity and
+  maximumArity), a COUNTED entry for a function with a single arity, or a leaf value of a kind its type never holds makes
+  the record malformed.
+  Functions ids and the default arities are part of the version: changing either means bumping it.
+*/
+enum class BinaryEntryKinds : uint8_t
+{
+  FUNCTION,
+  COUNTED,
+  LEAF,
+  REFERENCE,
+};
+
+struct BinaryASTEntry
+{
+  BinaryEntryKinds kind = BinaryEntryKinds::LEAF; // COUNTED entries are reported as FUNCTION
+  Functions function = Functions::IDENTITY;
+  uint32_t argCount = 0; // The next argCount subtrees are the arguments of a FUNCTION
+  ASTLeaf leaf; // Big integers are left out of leaf.value, see BinaryASTView::bigInteger
+  uint32_t poolOffset = 0; // Of a big integer leaf
+  uint32_t target = 0; // Entry repeated by a REFERENCE
+};
+
+namespace BinaryASTFormat
+{
+  constexpr char magic[2] = {'M', 'B'};
+  constexpr uint8_t version = 1;
+  constexpr uint8_t hasReferences = 1;
+  constexpr size_t headerSize = 12;
+
+  // Leaf values in the tag, in the order of LeafValue. int64_t values are written as ints
+  constexpr uint32_t intValue = 0;
+  constexpr uint32_t doubleValue = 1;
+  constexpr uint32_t bigValue = 2;
+  constexpr uint32_t decimalValue = 3;
+
+  constexpr uint32_t defaultArity(const Functions function)
+  {
+    switch (getFunctionType(function))
+    {
+      case FunctionTypes::BINARY:
+      case FunctionTypes::INTERVAL:
+      return 2;
+      case FunctionTypes::UNARYLEFT:
+      case FunctionTypes::UNARYRIGHT:
+      return 1;
+      default:
+      return 0;
+    }
+  }
+
+  // Argument counts a node of function takes in the ASTs the parser, Simplifier and Differentiator build. Sums and
+  //   products are n-ary once simplified; the null operator never builds a node
+  constexpr uint32_t minimumArity(const Functions function)
+  {
+    switch (getFunctionType(function))
+    {
+      case FunctionTypes::BINARY:
+      case FunctionTypes::INTERVAL:
+      return 2;
+      default:
+      return 1;
+    }
+  }
+
+  constexpr uint32_t maximumArity(const Functions function)
+  {
+    if (function == Functions::ADDITION || function == Functions::MULTIPLICATION)
+    {
+      return UINT32_MAX;
+    }
+    switch (getFunctionType(function))
+    {
+      case FunctionTypes::BINARY:
+      case FunctionTypes::INTERVAL:
+      return 2;
+      case FunctionTypes::UNARYLEFT:
+      case FunctionTypes::UNARYRIGHT:
+      return 1;
+      case FunctionTypes::BIGOPERATOR:
+      return 3; // Content, subscript and superscript
+      case FunctionTypes::OPTIONALARGUMENTS:
+      return 2;
+      case FunctionTypes::ARRAYARGUMENTS:
+      case FunctionTypes::MATRIXARGUMENTS:
+      return UINT32_MAX;
+      default:
+      return function == Functions::IDENTITY ? 1 : 0;
+    }
+  }
+
+  inline void appendVarint(uint64_t value, std::string& out)
+  {
+    while (value >= 0x80)
+    {
+      out += (char)((value & 0x7F) | 0x80);
+      value >>= 7;
+    }
+    out += (char)value;
+  }
+
+  inline void writeUint32(const uint32_t value, char* out)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      out[i] = (char)(value >> 8*i);
+    }
+  }
+
+  inline uint32_t readUint32(const char* in)
+  {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+      value |= (uint32_t)(uint8_t)in[i] << 8*i;
+    }
+    return value;
+  }
+}
+
+/*
+  Appends records to a caller's buffer, which is only ever appended to: reserved up front, or reused across records
+  after clear(), it's written in place. The writer keeps its scratch buffers between records, so once they are warm
+  serializing allocates nothing.
+*/
+class BinaryASTWriter
+{
+  public:
+  void write(const AST& ast, std::string& out)
+  {
+    write(ast, ast.root, out);
+  }
+
+  // Appends the record of the subtree at id
+  void write(const AST& ast, const NodeId id, std::string& out)
+  {
+    using namespace BinaryASTFormat;
+    const size_t start = out.size();
+    out.append(headerSize, '\0');
+    pool.clear();
+    entries.assign(ast.size(), noEntry);
+    stack.clear();
+    stack.push_back(id);
+    uint32_t count = 0;
+    bool references = false;
+    while (!stack.empty())
+    {
+      const NodeId node = stack.back();
+      stack.pop_back();
+      if (ast.isLeaf(node))
+      {
+        writeLeaf(ast.getLeaf(node), out);
+        count++;
+        continue;
+      }
+      if (entries[node] != noEntry)
+      {
+        appendVarint((uint64_t)entries[node] << 2 | (uint64_t)BinaryEntryKinds::REFERENCE, out);
+        references = true;
+        count++;
+        continue;
+      }
+      entries[node] = count++;
+      const Functions function = ast.getType(node);
+      const ASTArgs args = ast.getArgs(node);
+      if (args.size() == defaultArity(function))
+      {
+        appendVarint((uint64_t)function << 2 | (uint64_t)BinaryEntryKinds::FUNCTION, out);
+      }
+      else
+      {
+        appendVarint((uint64_t)function << 2 | (uint64_t)BinaryEntryKinds::COUNTED, out);
+        appendVarint(args.size(), out);
+      }
+      for (size_t i = args.size(); i-- > 0;)
+      {
+        stack.push_back(args[i]);
+      }
+    }
+    const size_t poolOffset = out.size()-start;
+    out += pool;
+    char* header = &out[start];
+    std::memcpy(header, magic, sizeof(magic));
+    header[2] = (char)version;
+    header[3] = (char)(references ? hasReferences : 0);
+    writeUint32((uint32_t)(out.size()-start), header+4);
+    writeUint32((uint32_t)poolOffset, header+8);
+  }
+
+  // A record without entries, which batch mode writes for the lines that failed so that records stay aligned with lines
+  void writeEmpty(std::string& out)
+  {
+    using namespace BinaryASTFormat;
+    const size_t start = out.size();
+    out.append(headerSize, '\0');
+    char* header = &out[start];
+    std::memcpy(header, magic, sizeof(magic));
+    header[2] = (char)version;
+    writeUint32((uint32_t)headerSize, header+4);
+    writeUint32((uint32_t)headerSize, header+8);
+  }
+
+  private:
+  static constexpr uint32_t noEntry = UINT32_MAX;
+
+  std::string pool;
+  std::vector<uint32_t> entries; // Entry index of every function node already written
+  std::vector<NodeId> stack;
+
+  void writeLeaf(const ASTLeaf& leaf, std::string& out)
+  {
+    using namespace BinaryASTFormat;
+    const uint64_t type = std::visit([](const auto type) { return (uint64_t)type; }, leaf.type);
+    const uint64_t auxiliary = std::holds_alternative<AuxiliaryTypes>(leaf.type) ? 1 : 0;
+    const bool large = std::holds_alternative<int64_t>(leaf.value);
+    const uint64_t kind = large ? intValue : (uint64_t)leaf.value.index();
+    appendVarint((type << 3 | kind << 1 | auxiliary) << 2 | (uint64_t)BinaryEntryKinds::LEAF, out);
+    if (large || std::holds_alternative<int>(leaf.value))
+    {
+      const int64_t value = large ? std::get<int64_t>(leaf.value) : std::get<int>(leaf.value);
+      appendVarint((uint64_t)value << 1 ^ (uint64_t)(value >> 63), out);
+      return;
+    }
+    if (std::holds_alternative<Decimal>(leaf.value))
+    {
+      const Decimal value = std::get<Decimal>(leaf.value);
+      const uint64_t significand = (uint64_t)value.significand() << 1 ^ (uint64_t)(value.significand() >> 63);
+      appendVarint(significand << 5 | value.scale(), out);
+      return;
+    }
+    appendVarint(pool.size(), out);
+    if (std::holds_alternative<double>(leaf.value))
+    {
+      uint64_t bits;
+      const double value = std::get<double>(leaf.value);
+      std::memcpy(&bits, &value, sizeof(bits));
+      writeUint32((uint32_t)bits, appendBytes(8));
+      writeUint32((uint32_t)(bits >> 32), &pool[pool.size()-4]);
+      return;
+    }
+    const BigInteger& value = *std::get<const BigInteger*>(leaf.value);
+    const int32_t size = value.isNegative() ? -(int32_t)value.limbCount() : (int32_t)value.limbCount();
+    writeUint32((uint32_t)size, appendBytes(4));
+    char* limbs = appendBytes(4*value.limbCount());
+    for (size_t i = 0; i < value.limbCount(); i++)
+    {
+      writeUint32(value.limbs()[i], limbs+4*i);
+    }
+  }
+
+  char* appendBytes(const size_t count)
+  {
+    pool.append(count, '\0');
+    return &pool[pool.size()-count];
+  }
+};
+
+/*
+  Reads one record in place. The view only points into the bytes it was opened on, which must outlive it; next()
+  decodes the entries in preorder one at a time and checks every offset against the record, so a truncated or
+  corrupted record ends the walk with failed() set instead of reading out of bounds. read() rebuilds an AST arena
+  for callers that need one, e.g. to evaluate it.
+*/
+class BinaryASTView
+{
+  public:
+  // False unless bytes starts with a complete record of this version
+  bool open(const std::string_view bytes)
+  {
+    using namespace BinaryASTFormat;
+    data = bytes.data();
+    size = 0;
+    error = true;
+    if (bytes.size() < headerSize || std::memcmp(data, magic, sizeof(magic)) != 0 || (uint8_t)data[2] != version)
+    {
+      return false;
+    }
+    const uint32_t recordSize = readUint32(data+4);
+    poolOffset = readUint32(data+8);
+    if (recordSize > bytes.size() || poolOffset < headerSize || poolOffset > recordSize)
+    {
+      return false;
+    }
+    size = recordSize;
+    rewind();
+    return true;
+  }
+
+  // Bytes taken by the record, where the next one starts in a stream of them
+  size_t recordSize() const
+  {
+    return size;
+  }
+
+  bool hasReferences() const
+  {
+    return ((uint8_t)data[3] & BinaryASTFormat::hasReferences) != 0;
+  }
+
+  bool failed() const
+  {
+    return error;
+  }
+
+  void rewind()
+  {
+    position = BinaryASTFormat::headerSize;
+    index = 0;
+    error = size == 0;
+  }
+
+  // Decodes the next entry; false at the end of the table or on a malformed entry
+  bool next(BinaryASTEntry& entry)
+  {
+    using namespace BinaryASTFormat;
+    uint64_t tag;
+    if (error || position == poolOffset)
+    {
+      return false;
+    }
+    if (!readVarint(tag))
+    {
+      return fail();
+    }
+    const BinaryEntryKinds kind = (BinaryEntryKinds)(tag & 3);
+    tag >>= 2;
+    switch (kind)
+    {
+      case BinaryEntryKinds::FUNCTION:
+      case BinaryEntryKinds::COUNTED:
+      {
+        if (tag >= functionCount)
+        {
+          return fail();
+        }
+        entry.kind = BinaryEntryKinds::FUNCTION;
+        entry.function = (Functions)tag;
+        uint64_t count = defaultArity(entry.function);
+        // Every argument takes at least a byte of the table
+        if (kind == BinaryEntryKinds::COUNTED && (!readVarint(count) || count > poolOffset-position))
+        {
+          return fail();
+        }
+        // Kernels, derivatives and the JSON writer index the arguments a function takes, so a corrupted count must not
+        //   get past here. Functions with a single arity are always written without one
+        const uint32_t minimum = minimumArity(entry.function), maximum = maximumArity(entry.function);
+        if (count < minimum || count > maximum || (kind == BinaryEntryKinds::COUNTED && minimum == maximum))
+        {
+          return fail();
+        }
+        entry.argCount = (uint32_t)count;
+        break;
+      }
+      case BinaryEntryKinds::LEAF:
+      if (!readLeaf(tag, entry))
+      {
+        return fail();
+      }
+      break;
+      default:
+      if (tag >= index)
+      {
+        return fail();
+      }
+      entry.kind = BinaryEntryKinds::REFERENCE;
+      entry.target = (uint32_t)tag;
+      break;
+    }
+    index++;
+    return true;
+  }
+
+  // The value of a big integer leaf, read from the pool
+  BigInteger bigInteger(const BinaryASTEntry& entry) const
+  {
+    using namespace BinaryASTFormat;
+    const char* bytes = data+poolOffset+entry.poolOffset;
+    const int32_t signedCount = (int32_t)readUint32(bytes);
+    const uint32_t count = signedCount < 0 ? 0u-(uint32_t)signedCount : (uint32_t)signedCount;
+    return BigInteger::fromLimbs(count, signedCount < 0, [bytes](const size_t i) { return readUint32(bytes+4+4*i); });
+  }
+
+  // Rebuilds the record into ast, with references sharing their node like in a hash-consed arena
+  bool read(AST& ast)
+  {
+    ast.clear();
+    rewind();
+    ids.clear();
+    frames.clear();
+    children.clear();
+    BinaryASTEntry entry;
+    for (uint32_t i = 0; next(entry); i++)
+    {
+      NodeId id;
+      ids.push_back(noNode);
+      if (entry.kind == BinaryEntryKinds::FUNCTION && entry.argCount != 0)
+      {
+        frames.push_back({i, entry.function, entry.argCount, children.size()});
+        continue;
+      }
+      else if (entry.kind == BinaryEntryKinds::FUNCTION)
+      {
+        id = ast.addNode(entry.function, nullptr, 0);
+      }
+      else if (entry.kind == BinaryEntryKinds::LEAF)
+      {
+        if (entry.leaf.value.index() == BinaryASTFormat::bigValue)
+        {
+          // The AST copies the value when adding the leaf
+          const BigInteger value = bigInteger(entry);
+          entry.leaf.value = &value;
+          id = ast.addLeaf(entry.leaf);
+        }
+        else
+        {
+          id = ast.addLeaf(entry.leaf);
+        }
+      }
+      else if (ids[entry.target] != noNode)
+      {
+        id = ids[entry.target];
+      }
+      else
+      {
+        // Only complete subtrees can be repeated
+        return fail();
+      }
+      ids[i] = id;
+      children.push_back(id);
+      // The last argument of a node completes it, and possibly its parents with it
+      while (!frames.empty() && children.size()-frames.back().firstChild == frames.back().argCount)
+      {
+        const Frame frame = frames.back();
+        frames.pop_back();
+        id = ast.addNode(frame.function, children.data()+frame.firstChild, frame.argCount);
+        ids[frame.entry] = id;
+        children.resize(frame.firstChild);
+        children.push_back(id);
+      }
+    }
+    if (error || !frames.empty() || children.size() != 1)
+    {
+      return fail();
+    }
+    ast.root = children[0];
+    return true;
+  }
+
+  private:
+  struct Frame
+  {
+    uint32_t entry;
+    Functions function;
+    uint32_t argCount;
+    size_t firstChild;
+  };
+
+  static constexpr NodeId noNode = UINT32_MAX;
+
+  const char* data = nullptr;
+  size_t size = 0;
+  uint32_t poolOffset = 0;
+  size_t position = 0;
+  uint32_t index = 0;
+  bool error = true;
+  std::vector<NodeId> ids; // Node of every entry, for references
+  std::vector<Frame> frames;
+  std::vector<NodeId> children;
+
+  bool fail()
+  {
+    error = true;
+    return false;
+  }
+
+  bool readVarint(uint64_t& value)
+  {
+    value = 0;
+    for (int shift = 0; shift < 64 && position < poolOffset; shift += 7)
+    {
+      const uint8_t byte = (uint8_t)data[position++];
+      value |= (uint64_t)(byte & 0x7F) << shift;
+      if (byte < 0x80)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool readLeaf(const uint64_t type, BinaryASTEntry& entry)
+  {
+    using namespace BinaryASTFormat;
+    const uint32_t valueKind = (uint32_t)(type >> 1 & 3);
+    const uint64_t value = type >> 3;
+    entry.kind = BinaryEntryKinds::LEAF;
+    // Integers are ints, int64_ts or big integers and reals decimals or doubles, as the tokenizer makes them; every other
+    //   leaf holds an int. The JSON writer and the kernels read the alternative the type implies
+    const bool integer = !(type & 1) && value == (uint64_t)AtomicTypes::INTEGER;
+    const bool real = !(type & 1) && value == (uint64_t)AtomicTypes::REAL;
+    if (type & 1)
+    {
+      if (value > (uint64_t)AuxiliaryTypes::SUPERSCRIPT) return false;
+      entry.leaf.type = (AuxiliaryTypes)value;
+    }
+    else
+    {
+      if (value > (uint64_t)AtomicTypes::PROPOSITION) return false;
+      entry.leaf.type = (AtomicTypes)value;
+    }
+    uint64_t payload;
+    if (!readVarint(payload))
+    {
+      return false;
+    }
+    if (valueKind == intValue)
+    {
+      // Read back into the same alternative the tokenizer would have produced
+      const int64_t value = (int64_t)(payload >> 1 ^ (0-(payload & 1)));
+      if (real)
+      {
+        return false;
+      }
+      if (value >= INT_MIN && value <= INT_MAX)
+      {
+        entry.leaf.value = (int)value;
+      }
+      else if (integer)
+      {
+        entry.leaf.value = value;
+      }
+      else
+      {
+        return false;
+      }
+      return true;
+    }
+    if (valueKind == decimalValue)
+    {
+      if (!real) return false;
+      const uint64_t significand = payload >> 5;
+      Decimal decimal;
+      if (!Decimal::make((int64_t)(significand >> 1 ^ (0-(significand & 1))), (uint32_t)(payload & 31), decimal))
+      {
+        return false;
+      }
+      entry.leaf.value = decimal;
+      return true;
+    }
+    const size_t poolSize = size-poolOffset;
+    if (valueKind == doubleValue)
+    {
+      if (!real || payload+8 > poolSize) return false;
+      const char* bytes = data+poolOffset+payload;
+      const uint64_t bits = readUint32(bytes) | (uint64_t)readUint32(bytes+4) << 32;
+      double real;
+      std::memcpy(&real, &bits, sizeof(real));
+      entry.leaf.value = real;
+      return true;
+    }
+    if (valueKind != bigValue || !integer || payload+4 > poolSize)
+    {
+      return false;
+    }
+    const int32_t signedCount = (int32_t)readUint32(data+poolOffset+payload);
+    const uint64_t count = signedCount < 0 ? 0u-(uint32_t)signedCount : (uint32_t)signedCount;
+    if (payload+4+4*count > poolSize)
+    {
+      return false;
+    }
+    entry.leaf.value = (const BigInteger*)nullptr;
+    entry.poolOffset = (uint32_t)payload;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "Functions.h"
+#include "AST.h"
+#include "Evaluator.h"
+
+enum class Opcodes : uint8_t
+{
+  NULLOPCODE,
+  CONSTANT, // Pushes pool[operand]
+  VARIABLE, // Pushes the binding of the variable named (char)operand
+  ADD, // argCount operands
+  SUB,
+  NEG,
+  MUL, // argCount operands
+  DIV,
+  POW,
+  CALL, // Calls the kernel of (Functions)operand on the top argCount operands
+  RETURN,
+};
+
+struct Instruction
+{
+  Opcodes opcode = Opcodes::NULLOPCODE;
+  uint32_t argCount = 0; // As wide as ASTNode::argCount, so no node has more operands than an instruction can take
+  uint32_t operand = 0;
+};
+
+// A compiled expression: postfix instructions for a stack machine and the pool of the values they push
+struct Bytecode
+{
+  std::vector<Instruction> code;
+  std::vector<Evaluation> pool;
+  uint32_t maxDepth = 0;
+};
+
+/*
+  Compiles an AST into bytecode by emitting its nodes in postfix order, which for ASTs built by Parser::RPN2AST is the
+  order of the RPN itself. Subexpressions without variables are folded while compiling: their operands are always the
+  last CONSTANT instructions emitted, so they're evaluated right away and replaced by a single pool entry
+*/
+class BytecodeCompiler
+{
+  public:
+  Bytecode compile(const AST& ast)
+  {
+    Bytecode bytecode;
+    if (ast.size() == 0)
+    {
+      bytecode.pool.push_back(Kernels::error(AtomicTypes::DNE));
+      bytecode.code.push_back({Opcodes::CONSTANT, 0, 0});
+      bytecode.code.push_back({Opcodes::RETURN, 0, 0});
+      bytecode.maxDepth = 1;
+      return bytecode;
+    }
+    // Iterative postorder walk: a node is emitted the second time it's reached, once all its children were emitted
+    pending.clear();
+    constant.clear();
+    pending.push_back({ast.root, false});
+    uint32_t depth = 0;
+    while (!pending.empty())
+    {
+      const Visit visit = pending.back();
+      pending.pop_back();
+      const ASTNode& node = ast.nodes[visit.id];
+      if (!std::holds_alternative<Functions>(node.leaf.type))
+      {
+        emitLeaf(bytecode, node.leaf);
+        depth++;
+      }
+      else if (!visit.childrenDone)
+      {
+        pending.push_back({visit.id, true});
+        for (uint32_t i = node.argCount; i > 0; i--)
+        {
+          pending.push_back({ast.args[node.firstArg+i-1], false});
+        }
+        continue;
+      }
+      else
+      {
+        emitFunction(bytecode, std::get<Functions>(node.leaf.type), node.argCount);
+        depth = depth-node.argCount+1;
+      }
+      if (depth > bytecode.maxDepth) bytecode.maxDepth = depth;
+    }
+    bytecode.code.push_back({Opcodes::RETURN, 0, 0});
+    return bytecode;
+  }
+
+  private:
+  struct Visit
+  {
+    NodeId id;
+    bool childrenDone;
+  };
+
+  std::vector<Visit> pending;
+  // One flag per value on the simulated stack, true when it was pushed by a CONSTANT instruction
+  std::vector<bool> constant;
+  std::vector<Evaluation> operands;
+
+  void emitConstant(Bytecode& bytecode, const Evaluation value)
+  {
+    bytecode.code.push_back({Opcodes::CONSTANT, 0, (uint32_t)bytecode.pool.size()});
+    bytecode.pool.push_back(value);
+    constant.push_back(true);
+  }
+
+  void emitLeaf(Bytecode& bytecode, const ASTLeaf& leaf)
+  {
+    if (std::holds_alternative<AtomicTypes>(leaf.type) && std::get<AtomicTypes>(leaf.type) == AtomicTypes::VARIABLE)
+    {
+      bytecode.code.push_back({Opcodes::VARIABLE, 0, (uint32_t)(unsigned char)std::get<int>(leaf.value)});
+      constant.push_back(false);
+      return;
+    }
+    // Every other leaf has the same value for any bindings
+    emitConstant(bytecode, Evaluator::evaluateLeaf(leaf, Bindings()));
+  }
+
+  void emitFunction(Bytecode& bytecode, const Functions function, const uint32_t argCount)
+  {
+    if (function == Functions::IDENTITY)
+    {
+      return;
+    }
+    if (argCount == 0)
+    {
+      emitConstant(bytecode, Kernels::error(AtomicTypes::DNE));
+      return;
+    }
+    const size_t base = constant.size()-argCount;
+    bool folded = true;
+    for (size_t i = base; i < constant.size(); i++)
+    {
+      folded = folded && constant[i];
+    }
+    if (folded)
+    {
+      // The operands are the last argCount pool entries, in order
+      const size_t first = bytecode.pool.size()-argCount;
+      operands.assign(bytecode.pool.begin()+first, bytecode.pool.end());
+      Evaluation result = propagate(operands.data(), argCount);
+      if (!result.isError())
+      {
+        result = getKernel(function)(operands.data(), argCount);
+      }
+      bytecode.pool.resize(first);
+      bytecode.code.resize(bytecode.code.size()-argCount);
+      constant.resize(base);
+      emitConstant(bytecode, result);
+      return;
+    }
+    Instruction instruction{Opcodes::CALL, argCount, (uint32_t)function};
+    switch (function)
+    {
+      case Functions::ADDITION:
+      instruction.opcode = Opcodes::ADD;
+      break;
+      case Functions::SUBTRACTION:
+      instruction.opcode = Opcodes::SUB;
+      break;
+      case Functions::UNSUBTRACTION:
+      instruction.opcode = Opcodes::NEG;
+      break;
+      case Functions::MULTIPLICATION:
+      instruction.opcode = Opcodes::MUL;
+      break;
+      case Functions::DIVISION:
+      instruction.opcode = Opcodes::DIV;
+      break;
+      case Functions::EXPONENTIATION:
+      instruction.opcode = Opcodes::POW;
+      break;
+      default:
+      break;
+    }
+    bytecode.code.push_back(instruction);
+    constant.resize(base);
+    constant.push_back(false);
+  }
+
+  // Same rule as the tree-walking evaluator: the first error among the operands becomes the result
+  static Evaluation propagate(const Evaluation* args, const uint32_t argCount)
+  {
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      if (args[i].isError()) return args[i];
+    }
+    return Evaluation();
+  }
+};
+
+inline Bytecode compileBytecode(const AST& ast)
+{
+  BytecodeCompiler compiler;
+  return compiler.compile(ast);
+}
+
+/*
+  Runs bytecode over a value stack sized once per program, so repeated runs don't allocate. The arithmetic opcodes
+  inline their kernels, and every opcode checks its operands for errors the same way the evaluator does, so both
+  always agree on the result
+*/
+class BytecodeInterpreter
+{
+  public:
+  Evaluation run(const Bytecode& bytecode, const Bindings& bindings)
+  {
+    if (stack.size() < bytecode.maxDepth)
+    {
+      stack.resize(bytecode.maxDepth);
+    }
+    Evaluation* top = stack.data(); // One past the last value
+    const Instruction* instruction = bytecode.code.data();
+    const Evaluation* pool = bytecode.pool.data();
+    while (true)
+    {
+      switch (instruction->opcode)
+      {
+        case Opcodes::CONSTANT:
+        *top++ = pool[instruction->operand];
+        break;
+        case Opcodes::VARIABLE:
+        {
+          const char name = (char)instruction->operand;
+          *top++ = bindings.isBound(name) ? Evaluation{AtomicTypes::REAL, bindings.get(name)} : Kernels::error(AtomicTypes::UNDETERMINED);
+        }
+        break;
+        case Opcodes::ADD:
+        top = apply(top, instruction->argCount, Kernels::addition);
+        break;
+        case Opcodes::SUB:
+        top = apply(top, 2, Kernels::subtraction);
+        break;
+        case Opcodes::NEG:
+        top = apply(top, 1, Kernels::unarySubtraction);
+        break;
+        case Opcodes::MUL:
+        top = apply(top, instruction->argCount, Kernels::multiplication);
+        break;
+        case Opcodes::DIV:
+        top = apply(top, 2, Kernels::division);
+        break;
+        case Opcodes::POW:
+        top = apply(top, 2, Kernels::exponentiation);
+        break;
+        case Opcodes::CALL:
+        top = apply(top, instruction->argCount, getKernel((Functions)instruction->operand));
+        break;
+        case Opcodes::RETURN:
+        return top[-1];
+        default:
+        return Kernels::error(AtomicTypes::DNE);
+      }
+      instruction++;
+    }
+  }
+
+  private:
+  std::vector<Evaluation> stack;
+
+  // Replaces the top argCount values with the result of the kernel on them
+  template <typename KernelFunction>
+  static Evaluation* apply(Evaluation* top, const uint32_t argCount, KernelFunction kernel)
+  {
+    Evaluation* args = top-argCount;
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      if (args[i].isError())
+      {
+        args[0] = args[i];
+        return args+1;
+      }
+    }
+    args[0] = kernel(args, argCount);
+    return args+1;
+  }
+};
+
+#endif
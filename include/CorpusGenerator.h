@@ -0,0 +1,235 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Shapes of generated expressions, each stressing a different part of the pipeline
+enum class CorpusShapes : uint8_t
+{
+  FLATSUM, // 1+x*3-y+... : long runs of tokens at a single depth
+  NESTEDPARENTHESES, // ((1+x)*2-y)... : the operator stack grows with the depth
+  NESTEDFRAC, // \frac{\frac{...}{1}}{x} : keys nested inside a construct the tokenizer keeps pending
+  BIGOPERATORS, // \sum_{i=1}^{n}{...}+\prod_{...}^{...}{...} : optional bounds and argument counting
+  MATRIX, // \matrix(1,x;...) : row counters and wide argument lists
+  INTERVAL, // \interval[0,x)+... : interval constructs with arbitrary endpoints
+};
+
+constexpr size_t corpusShapeCount = (size_t)CorpusShapes::INTERVAL + 1;
+
+inline const char* getCorpusShapeName(const CorpusShapes shape)
+{
+  switch (shape)
+  {
+    case CorpusShapes::FLATSUM:
+    return "flat-sum";
+    case CorpusShapes::NESTEDPARENTHESES:
+    return "nested-parentheses";
+    case CorpusShapes::NESTEDFRAC:
+    return "nested-frac";
+    case CorpusShapes::BIGOPERATORS:
+    return "big-operators";
+    case CorpusShapes::MATRIX:
+    return "matrix";
+    default:
+    return "interval";
+  }
+}
+
+// Returns false if name isn't the name of any shape
+inline bool getCorpusShape(const char* name, CorpusShapes& shape)
+{
+  for (size_t i = 0; i < corpusShapeCount; i++)
+  {
+    if (std::strcmp(name, getCorpusShapeName((CorpusShapes)i)) == 0)
+    {
+      shape = (CorpusShapes)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+  Generates expressions of a given shape whose size grows linearly with the size parameter: the number of terms of a
+  sum, the nesting depth of parentheses or fractions, the number of big operators or intervals, the number of matrix
+  elements. Operands and operators are drawn from a seeded generator, so a seed always yields the same corpus and
+  results stay comparable between commits, while the expressions of one corpus still differ from each other.
+*/
+class CorpusGenerator
+{
+  public:
+  explicit CorpusGenerator(const uint32_t seed = 1) : random(seed) {}
+
+  std::string generate(const CorpusShapes shape, const size_t size)
+  {
+    std::string result;
+    switch (shape)
+    {
+      case CorpusShapes::FLATSUM:
+      {
+        appendOperand(result);
+        for (size_t i = 1; i < size; i++)
+        {
+          appendOperator(result);
+          appendOperand(result);
+        }
+      }
+      break;
+      case CorpusShapes::NESTEDPARENTHESES:
+      {
+        result.append(size, '(');
+        appendOperand(result);
+        for (size_t i = 0; i < size; i++)
+        {
+          appendOperator(result);
+          appendOperand(result);
+          result += ')';
+        }
+      }
+      break;
+      case CorpusShapes::NESTEDFRAC:
+      {
+        // Alternates between nesting in the numerator and in the denominator
+        std::vector<bool> inNumerator(size);
+        for (size_t i = 0; i < size; i++)
+        {
+          inNumerator[i] = random() & 1;
+          result += "\\frac{";
+          if (!inNumerator[i])
+          {
+            appendOperand(result);
+            result += "}{";
+          }
+        }
+        appendOperand(result);
+        for (size_t i = size; i-- > 0;)
+        {
+          if (inNumerator[i])
+          {
+            result += "}{";
+            appendOperand(result);
+          }
+          result += '}';
+        }
+      }
+      break;
+      case CorpusShapes::BIGOPERATORS:
+      {
+        for (size_t i = 0; i < size; i++)
+        {
+          if (i != 0)
+          {
+            result += '+';
+          }
+          const char index = "ijkn"[random() % 4];
+          result += random() & 1 ? "\\sum_{" : "\\prod_{";
+          result += index;
+          result += '=';
+          result += std::to_string(random() % 10);
+          result += "}^{";
+          appendOperand(result);
+          result += "}{";
+          result += index;
+          appendOperator(result);
+          appendOperand(result);
+          result += '}';
+        }
+      }
+      break;
+      case CorpusShapes::MATRIX:
+      {
+        // As square as possible, with every row as long as the first
+        size_t columns = 1;
+        while (columns*columns < size)
+        {
+          columns++;
+        }
+        const size_t rows = (size+columns-1)/columns;
+        result += "\\matrix(";
+        for (size_t row = 0; row < rows; row++)
+        {
+          if (row != 0)
+          {
+            result += ';';
+          }
+          for (size_t column = 0; column < columns; column++)
+          {
+            if (column != 0)
+            {
+              result += ',';
+            }
+            appendOperand(result);
+          }
+        }
+        result += ')';
+      }
+      break;
+      case CorpusShapes::INTERVAL:
+      {
+        for (size_t i = 0; i < size; i++)
+        {
+          if (i != 0)
+          {
+            result += '+';
+          }
+          result += "\\interval";
+          result += random() & 1 ? '[' : '(';
+          appendOperand(result);
+          result += ',';
+          appendOperand(result);
+          appendOperator(result);
+          appendOperand(result);
+          result += random() & 1 ? ']' : ')';
+        }
+      }
+      break;
+    }
+    return result;
+  }
+
+  // count expressions of the same shape and size
+  std::vector<std::string> generate(const CorpusShapes shape, const size_t size, const size_t count)
+  {
+    std::vector<std::string> corpus;
+    corpus.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      corpus.push_back(generate(shape, size));
+    }
+    return corpus;
+  }
+
+  private:
+  // The raw output of mt19937 is fixed by the standard, unlike the distributions, so corpora match across libraries
+  std::mt19937 random;
+
+  // An integer, a decimal or a variable
+  void appendOperand(std::string& result)
+  {
+    switch (random() % 3)
+    {
+      case 0:
+      result += std::to_string(random() % 100);
+      break;
+      case 1:
+      result += std::to_string(random() % 10);
+      result += '.';
+      result += std::to_string(random() % 100);
+      break;
+      default:
+      result += "xyzabc"[random() % 6];
+      break;
+    }
+  }
+
+  void appendOperator(std::string& result)
+  {
+    result += "+-*+"[random() % 4];
+  }
+};
+
+#endif
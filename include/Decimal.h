@@ -0,0 +1,179 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+
+/*
+  Exact value of a decimal literal such as 0.1: a significand scaled down by a power of ten, packed into the 8 bytes of
+  a leaf value (significand in the high 59 bits, scale in the low 5). The significand stays below 2^53 and the scale at
+  most 22, the range where both are exact doubles, so toDouble is one correctly rounded division and agrees with
+  std::from_chars on the literal. Trailing zeros are stripped, so equal values always have equal representations.
+  Literals past that range are parsed straight into doubles.
+*/
+struct Decimal
+{
+  int64_t packed = 0;
+
+  static constexpr int64_t significandLimit = (int64_t)1 << 53;
+  static constexpr uint32_t maxScale = 22;
+
+  int64_t significand() const
+  {
+    return packed >> 5;
+  }
+
+  uint32_t scale() const
+  {
+    return (uint32_t)(packed & 31);
+  }
+
+  static constexpr int64_t powerOfTen(const uint32_t exponent)
+  {
+    int64_t power = 1;
+    for (uint32_t i = 0; i < exponent; i++)
+    {
+      power *= 10;
+    }
+    return power;
+  }
+
+  double toDouble() const
+  {
+    static constexpr double powers[maxScale+1] =
+    {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+      1e21, 1e22,
+    };
+    return (double)significand()/powers[scale()];
+  }
+
+  // Normalizes significand/10^scale into result, returning false if it falls outside the exact range
+  static bool make(int64_t significand, uint32_t scale, Decimal& result)
+  {
+    while (scale > 0 && significand%10 == 0)
+    {
+      significand /= 10;
+      scale--;
+    }
+    if (scale > maxScale || significand >= significandLimit || significand <= -significandLimit)
+    {
+      return false;
+    }
+    result.packed = (int64_t)((uint64_t)significand << 5) | scale;
+    return true;
+  }
+
+  static bool add(const Decimal a, const Decimal b, Decimal& result)
+  {
+    const uint32_t scale = a.scale() > b.scale() ? a.scale() : b.scale();
+    // 10^18 is the largest power of ten in an int64_t
+    if (scale-a.scale() > 18 || scale-b.scale() > 18)
+    {
+      return false;
+    }
+    int64_t left, right, sum;
+    if (__builtin_mul_overflow(a.significand(), powerOfTen(scale-a.scale()), &left)
+      || __builtin_mul_overflow(b.significand(), powerOfTen(scale-b.scale()), &right) || __builtin_add_overflow(left, right, &sum))
+    {
+      return false;
+    }
+    return make(sum, scale, result);
+  }
+
+  static bool multiply(const Decimal a, const Decimal b, Decimal& result)
+  {
+    int64_t product;
+    if (__builtin_mul_overflow(a.significand(), b.significand(), &product))
+    {
+      return false;
+    }
+    return make(product, a.scale()+b.scale(), result);
+  }
+
+  // Only quotients with a terminating expansion that fits are exact
+  static bool divide(const Decimal a, const Decimal b, Decimal& result)
+  {
+    if (b.significand() == 0)
+    {
+      return false;
+    }
+    // a/b = (sa*10^k/sb) / 10^(scale(a)-scale(b)+k), growing k until the division is exact
+    int64_t numerator = a.significand();
+    int32_t scale = (int32_t)a.scale()-(int32_t)b.scale();
+    while (numerator%b.significand() != 0)
+    {
+      if (scale >= (int32_t)maxScale || __builtin_mul_overflow(numerator, 10, &numerator))
+      {
+        return false;
+      }
+      scale++;
+    }
+    int64_t quotient = numerator/b.significand();
+    for (; scale < 0; scale++)
+    {
+      if (__builtin_mul_overflow(quotient, 10, &quotient))
+      {
+        return false;
+      }
+    }
+    return make(quotient, (uint32_t)scale, result);
+  }
+
+  static bool power(const Decimal base, uint32_t exponent, Decimal& result)
+  {
+    Decimal value, square = base;
+    make(1, 0, value);
+    for (; exponent; exponent >>= 1)
+    {
+      if ((exponent & 1) && !multiply(value, square, value))
+      {
+        return false;
+      }
+      if (exponent > 1 && !multiply(square, square, square))
+      {
+        return false;
+      }
+    }
+    result = value;
+    return true;
+  }
+
+  Decimal operator-() const
+  {
+    Decimal negated;
+    make(-significand(), scale(), negated);
+    return negated;
+  }
+
+  // The digits of the value with its decimal point, always followed by at least one digit (2.0, 0.125, -0.1)
+  void appendDecimal(std::string& out) const
+  {
+    const int64_t value = significand();
+    if (value < 0)
+    {
+      out += '-';
+    }
+    char digits[24];
+    const char* end = std::to_chars(digits, digits+sizeof(digits), value < 0 ? -value : value).ptr;
+    const uint32_t length = (uint32_t)(end-digits);
+    if (length <= scale())
+    {
+      out += "0.";
+      out.append(scale()-length, '0');
+      out.append(digits, length);
+      return;
+    }
+    out.append(digits, length-scale());
+    out += '.';
+    if (scale() == 0)
+    {
+      out += '0';
+      return;
+    }
+    out.append(end-scale(), scale());
+  }
+};
+
+#endif
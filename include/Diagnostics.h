@@ -0,0 +1,119 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ErrorTypes.h"
+
+// Half-open range of characters of an input
+struct TextRange
+{
+  size_t begin;
+  size_t end;
+};
+
+struct Diagnostic
+{
+  ErrorTypes type;
+  TextRange span; // Bytes of the input the error is about
+};
+
+/*
+  Errors found in one input, in the order they were reported. Stages recover from every error they report (dropping,
+  inserting or merging tokens at the nearest grouper or separator), so one input can report many, and none of them
+  throws or prints. At most limit diagnostics are kept and the rest are only counted, so malformed input costs the
+  same bounded work as any other; well formed input never touches the list at all.
+*/
+class Diagnostics
+{
+  public:
+  static constexpr size_t defaultLimit = 32;
+
+  // Keeps the capacity of the list, so a warm stage reports without allocating
+  void clear()
+  {
+    entries.clear();
+    dropped = 0;
+  }
+
+  void report(const ErrorTypes type, const TextRange span)
+  {
+    if (entries.size() < limit)
+    {
+      entries.push_back({type, span});
+      return;
+    }
+    dropped++;
+  }
+
+  // Adds the diagnostics of other, keeping the list sorted by the start of the spans if both lists were
+  void merge(const Diagnostics& other)
+  {
+    for (const Diagnostic& diagnostic : other.entries)
+    {
+      if (entries.size() == limit)
+      {
+        dropped++;
+        continue;
+      }
+      entries.push_back(diagnostic);
+      for (size_t i = entries.size()-1; i > 0 && entries[i-1].span.begin > entries[i].span.begin; i--)
+      {
+        std::swap(entries[i-1], entries[i]);
+      }
+    }
+    dropped += other.dropped;
+  }
+
+  bool empty() const
+  {
+    return entries.empty();
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  const Diagnostic& operator[](const size_t i) const
+  {
+    return entries[i];
+  }
+
+  std::vector<Diagnostic>::const_iterator begin() const
+  {
+    return entries.begin();
+  }
+
+  std::vector<Diagnostic>::const_iterator end() const
+  {
+    return entries.end();
+  }
+
+  // First error reported, NULLERROR if there is none
+  ErrorTypes first() const
+  {
+    return entries.empty() ? ErrorTypes::NULLERROR : entries[0].type;
+  }
+
+  // Diagnostics reported past the limit
+  size_t getDropped() const
+  {
+    return dropped;
+  }
+
+  void setLimit(const size_t newLimit)
+  {
+    limit = newLimit;
+  }
+
+  private:
+  std::vector<Diagnostic> entries;
+  size_t dropped = 0;
+  size_t limit = defaultLimit;
+};
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef DIFFERENTIATOR_H
+#define DIFFERENTIATOR_H
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "AST.h"
+#include "ASTInterner.h"
+#include "AtomicTypes.h"
+#include "Constants.h"
+#include "Functions.h"
+#include "Simplifier.h"
+
+struct DifferentiationStatistics
+{
+  size_t nodesBefore = 0;
+  size_t nodesAfter = 0; // Of the simplified derivative
+  size_t unsupported = 0; // Nodes depending on the variable whose function has no derivative rule, derived as DNE
+};
+
+/*
+  Symbolic differentiation of an AST with respect to one variable. The source is interned into a working arena and
+  every node is derived once, bottom-up in id order, from its own operands and the derivatives of its children: a
+  subtree shared by several parents, or appearing both in a function and in its derivative (the sin of d cos), is
+  referenced by id instead of being copied. Each derivative is therefore a DAG linear in the size of the one it was
+  derived from, so a given order grows linearly with the input, where naive product and chain rules would duplicate
+  whole subtrees at each application.
+
+  The derivative is built with a few local rules (0*u, 1*u, u+0, u^1) and then goes through Simplifier, which folds
+  numbers and flattens sums and products. Sums and products with several parents, such as the prefix and suffix
+  products of the product rule, stay nested (Simplifier::setKeepShared): flattening them would copy their operands
+  into every parent, and the second derivative of a product of n factors would hold O(n^2) child ids. Higher orders
+  derive the simplified result again.
+  Functions without a rule (relational, combinatorial and big operators) derive to 0 when they don't depend on the
+  variable and to DNE otherwise.
+*/
+class Differentiator
+{
+  public:
+  Differentiator()
+  {
+    simplifier.setKeepShared(true);
+  }
+
+  // Writes the order-th derivative of source with respect to variable into target, which is cleared
+  const DifferentiationStatistics& differentiate(const AST& source, const char variable, AST& target, const unsigned order = 1)
+  {
+    statistics = DifferentiationStatistics();
+    statistics.nodesBefore = source.size();
+    const AST* current = &source;
+    for (unsigned i = 0; i < order; i++)
+    {
+      derive(*current, variable);
+      simplifier.simplify(work, i+1 == order ? target : intermediate);
+      current = &intermediate;
+    }
+    if (order == 0)
+    {
+      target = source;
+    }
+    statistics.nodesAfter = target.size();
+    return statistics;
+  }
+
+  AST differentiate(const AST& source, const char variable, const unsigned order = 1)
+  {
+    AST target;
+    differentiate(source, variable, target, order);
+    return target;
+  }
+
+  const DifferentiationStatistics& getStatistics() const
+  {
+    return statistics;
+  }
+
+  private:
+  AST work;
+  AST intermediate; // Simplified result of the previous order
+  ASTInterner interner;
+  Simplifier simplifier;
+  std::vector<NodeId> remap; // Work id of every source node
+  std::vector<NodeId> derivatives; // Work id of the derivative of every source node
+  std::vector<NodeId> operands;
+  std::vector<NodeId> terms;
+  NodeId zero = 0;
+  NodeId one = 0;
+  DifferentiationStatistics statistics;
+
+  // Fills work with source and its derivative, which becomes the root
+  void derive(const AST& source, const char variable)
+  {
+    work.clear();
+    interner.reset(work);
+    zero = number(0);
+    one = number(1);
+    remap.resize(source.size());
+    derivatives.resize(source.size());
+    for (NodeId id = 0; id < source.size(); id++)
+    {
+      const ASTNode& node = source.nodes[id];
+      if (!std::holds_alternative<Functions>(node.leaf.type))
+      {
+        remap[id] = interner.addLeaf(node.leaf);
+        const bool isVariable = std::holds_alternative<AtomicTypes>(node.leaf.type) && std::get<AtomicTypes>(node.leaf.type) == AtomicTypes::VARIABLE
+          && std::holds_alternative<int>(node.leaf.value) && std::get<int>(node.leaf.value) == variable;
+        derivatives[id] = isVariable ? one : zero;
+        continue;
+      }
+      operands.clear();
+      for (const NodeId child : source.getArgs(id))
+      {
+        operands.push_back(remap[child]);
+      }
+      remap[id] = interner.addNode(std::get<Functions>(node.leaf.type), operands.data(), (uint32_t)operands.size());
+      derivatives[id] = deriveNode(source, id);
+    }
+    work.root = source.size() ? derivatives[source.root] : zero;
+  }
+
+  NodeId number(const double value)
+  {
+    if (value == std::floor(value) && value >= INT_MIN && value <= INT_MAX)
+    {
+      return interner.addLeaf(ASTLeaf(AtomicTypes::INTEGER, (int)value));
+    }
+    return interner.addLeaf(ASTLeaf(AtomicTypes::REAL, value));
+  }
+
+  NodeId apply(const Functions function, const NodeId a)
+  {
+    return interner.addNode(function, &a, 1);
+  }
+
+  NodeId apply(const Functions function, const NodeId a, const NodeId b)
+  {
+    const NodeId args[2] = {a, b};
+    return interner.addNode(function, args, 2);
+  }
+
+  NodeId add(const NodeId a, const NodeId b)
+  {
+    if (a == zero) return b;
+    if (b == zero) return a;
+    return apply(Functions::ADDITION, a, b);
+  }
+
+  NodeId subtract(const NodeId a, const NodeId b)
+  {
+    if (b == zero) return a;
+    if (a == zero) return negate(b);
+    return apply(Functions::SUBTRACTION, a, b);
+  }
+
+  NodeId negate(const NodeId a)
+  {
+    if (a == zero) return zero;
+    if (!work.isLeaf(a) && work.getType(a) == Functions::UNSUBTRACTION) return work.getArgs(a)[0];
+    return apply(Functions::UNSUBTRACTION, a);
+  }
+
+  NodeId multiply(const NodeId a, const NodeId b)
+  {
+    if (a == zero || b == zero) return zero;
+    if (a == one) return b;
+    if (b == one) return a;
+    return apply(Functions::MULTIPLICATION, a, b);
+  }
+
+  NodeId divide(const NodeId a, const NodeId b)
+  {
+    if (a == zero) return zero;
+    if (b == one) return a;
+    return apply(Functions::DIVISION, a, b);
+  }
+
+  NodeId power(const NodeId a, const NodeId b)
+  {
+    if (b == one) return a;
+    return apply(Functions::EXPONENTIATION, a, b);
+  }
+
+  NodeId square(const NodeId a)
+  {
+    return power(a, number(2));
+  }
+
+  // 1/sqrt(a)
+  NodeId reciprocalRoot(const NodeId a)
+  {
+    return divide(one, apply(Functions::SQRT, a));
+  }
+
+  // 1/(|u|*sqrt(u^2-1)), the derivative of arcsec
+  NodeId arcsecantFactor(const NodeId u)
+  {
+    return divide(one, multiply(apply(Functions::ABS, u), apply(Functions::SQRT, subtract(square(u), one))));
+  }
+
+  bool isConstant(const NodeId id, const Constants constant) const
+  {
+    if (!work.isLeaf(id)) return false;
+    const ASTLeaf& leaf = work.getLeaf(id);
+    return std::holds_alternative<AtomicTypes>(leaf.type) && std::get<AtomicTypes>(leaf.type) == AtomicTypes::CONSTANT
+      && std::holds_alternative<int>(leaf.value) && std::get<int>(leaf.value) == (int)constant;
+  }
+
+  // Natural logarithm, with ln(e) written as 1
+  NodeId logarithm(const NodeId a)
+  {
+    return isConstant(a, Constants::e) ? one : apply(Functions::LOG, a);
+  }
+
+  NodeId deriveNode(const AST& source, const NodeId id)
+  {
+    const Functions function = source.getType(id);
+    const ASTArgs args = source.getArgs(id);
+    const NodeId self = remap[id];
+    bool dependent = false;
+    for (const NodeId child : args)
+    {
+      dependent = dependent || derivatives[child] != zero;
+    }
+    if (!dependent)
+    {
+      return zero;
+    }
+    switch (function)
+    {
+      case Functions::IDENTITY:
+      return args.size() == 1 ? derivatives[args[0]] : unsupported();
+      case Functions::ADDITION:
+      {
+        NodeId sum = zero;
+        for (const NodeId child : args)
+        {
+          sum = add(sum, derivatives[child]);
+        }
+        return sum;
+      }
+      case Functions::SUBTRACTION:
+      return subtract(derivatives[args[0]], derivatives[args[1]]);
+      case Functions::UNSUBTRACTION:
+      return negate(derivatives[args[0]]);
+      case Functions::MULTIPLICATION:
+      {
+        // Sum over every factor of its derivative times the product of the others. The products of the factors before
+        //   and after each one are built incrementally and shared, so n factors take O(n) nodes instead of O(n^2)
+        const size_t count = args.size();
+        terms.assign(count+1, one);
+        for (size_t i = count; i-- > 0;)
+        {
+          terms[i] = multiply(remap[args[i]], terms[i+1]);
+        }
+        NodeId prefix = one;
+        NodeId sum = zero;
+        for (size_t i = 0; i < count; i++)
+        {
+          sum = add(sum, multiply(multiply(prefix, derivatives[args[i]]), terms[i+1]));
+          prefix = multiply(prefix, remap[args[i]]);
+        }
+        return sum;
+      }
+      case Functions::DIVISION:
+      {
+        const NodeId u = remap[args[0]], v = remap[args[1]];
+        return divide(subtract(multiply(derivatives[args[0]], v), multiply(u, derivatives[args[1]])), square(v));
+      }
+      case Functions::EXPONENTIATION:
+      {
+        const NodeId u = remap[args[0]], v = remap[args[1]];
+        const NodeId du = derivatives[args[0]], dv = derivatives[args[1]];
+        if (dv == zero)
+        {
+          return multiply(multiply(v, power(u, subtract(v, one))), du);
+        }
+        // d(u^v) = u^v*(v'*ln(u)+v*u'/u)
+        return multiply(self, add(multiply(dv, logarithm(u)), divide(multiply(v, du), u)));
+      }
+      case Functions::SQRT:
+      {
+        if (args.size() == 1)
+        {
+          return divide(derivatives[args[0]], multiply(number(2), self));
+        }
+        // The n-th root of x is x^(1/n): its derivative is root*(x'/(n*x)-n'*ln(x)/n^2)
+        const NodeId n = remap[args[0]], x = remap[args[1]];
+        const NodeId dn = derivatives[args[0]], dx = derivatives[args[1]];
+        return multiply(self, subtract(divide(dx, multiply(n, x)), divide(multiply(dn, logarithm(x)), square(n))));
+      }
+      case Functions::LOG:
+      {
+        if (args.size() == 1)
+        {
+          return divide(derivatives[args[0]], remap[args[0]]);
+        }
+        // log_b(x) = ln(x)/ln(b)
+        const NodeId b = remap[args[0]], x = remap[args[1]];
+        const NodeId db = derivatives[args[0]], dx = derivatives[args[1]];
+        const NodeId lnb = logarithm(b);
+        return subtract(divide(dx, multiply(x, lnb)), divide(multiply(logarithm(x), db), multiply(b, square(lnb))));
+      }
+      case Functions::ATAN2:
+      {
+        if (args.size() != 2) return unsupported();
+        const NodeId y = remap[args[0]], x = remap[args[1]];
+        return divide(subtract(multiply(x, derivatives[args[0]]), multiply(y, derivatives[args[1]])), add(square(x), square(y)));
+      }
+      default:
+      break;
+    }
+    if (args.size() != 1)
+    {
+      return unsupported();
+    }
+    const NodeId factor = chainFactor(function, remap[args[0]]);
+    return factor == invalid ? unsupported() : multiply(factor, derivatives[args[0]]);
+  }
+
+  static constexpr NodeId invalid = UINT32_MAX;
+
+  // f'(u) for the unary functions, invalid for functions without a rule
+  NodeId chainFactor(const Functions function, const NodeId u)
+  {
+    const NodeId two = number(2);
+    switch (function)
+    {
+      case Functions::ABS:
+      return apply(Functions::SIGN, u);
+
+      // ELLIPTIC TRIG FUNCTIONS
+
+      case Functions::SIN:
+      return apply(Functions::COS, u);
+      case Functions::COS:
+      return negate(apply(Functions::SIN, u));
+      case Functions::TAN:
+      return square(apply(Functions::SEC, u));
+      case Functions::CSC:
+      return negate(multiply(apply(Functions::CSC, u), apply(Functions::COT, u)));
+      case Functions::SEC:
+      return multiply(apply(Functions::SEC, u), apply(Functions::TAN, u));
+      case Functions::COT:
+      return negate(square(apply(Functions::CSC, u)));
+      case Functions::ARCSIN:
+      return reciprocalRoot(subtract(one, square(u)));
+      case Functions::ARCCOS:
+      return negate(reciprocalRoot(subtract(one, square(u))));
+      case Functions::ARCTAN:
+      return divide(one, add(one, square(u)));
+      case Functions::ARCCSC:
+      return negate(arcsecantFactor(u));
+      case Functions::ARCSEC:
+      return arcsecantFactor(u);
+      case Functions::ARCCOT:
+      return negate(divide(one, add(one, square(u))));
+
+      // HYPERBOLIC TRIG FUNCTIONS
+
+      case Functions::SINH:
+      return apply(Functions::COSH, u);
+      case Functions::COSH:
+      return apply(Functions::SINH, u);
+      case Functions::TANH:
+      return square(apply(Functions::SECH, u));
+      case Functions::CSCH:
+      return negate(multiply(apply(Functions::CSCH, u), apply(Functions::COTH, u)));
+      case Functions::SECH:
+      return negate(multiply(apply(Functions::SECH, u), apply(Functions::TANH, u)));
+      case Functions::COTH:
+      return negate(square(apply(Functions::CSCH, u)));
+      case Functions::ARCSINH:
+      return reciprocalRoot(add(square(u), one));
+      case Functions::ARCCOSH:
+      return reciprocalRoot(subtract(square(u), one));
+      case Functions::ARCTANH:
+      case Functions::ARCCOTH:
+      return divide(one, subtract(one, square(u)));
+      case Functions::ARCCSCH:
+      return negate(divide(one, multiply(apply(Functions::ABS, u), apply(Functions::SQRT, add(one, square(u))))));
+      case Functions::ARCSECH:
+      return negate(divide(one, multiply(u, apply(Functions::SQRT, subtract(one, square(u))))));
+
+      // SPHERICAL TRIG FUNCTIONS
+
+      case Functions::VER:
+      return apply(Functions::SIN, u);
+      case Functions::CVS:
+      return negate(apply(Functions::COS, u));
+      case Functions::VCS:
+      return negate(apply(Functions::SIN, u));
+      case Functions::CVC:
+      return apply(Functions::COS, u);
+      case Functions::HV:
+      case Functions::SV:
+      return divide(apply(Functions::SIN, u), two);
+      case Functions::HCV:
+      case Functions::SCV:
+      return negate(divide(apply(Functions::COS, u), two));
+      case Functions::HVC:
+      return negate(divide(apply(Functions::SIN, u), two));
+      case Functions::HCC:
+      return divide(apply(Functions::COS, u), two);
+      case Functions::ARCVER: // acos(1-u)
+      return reciprocalRoot(subtract(one, square(subtract(one, u))));
+      case Functions::ARCVCS: // acos(u-1)
+      return negate(reciprocalRoot(subtract(one, square(subtract(u, one)))));
+      case Functions::ARCCVS: // asin(1-u)
+      return negate(reciprocalRoot(subtract(one, square(subtract(one, u)))));
+      case Functions::ARCCVC: // asin(u-1)
+      return reciprocalRoot(subtract(one, square(subtract(u, one))));
+      case Functions::ARCHV: // acos(1-2u)
+      return multiply(two, reciprocalRoot(subtract(one, square(subtract(one, multiply(two, u))))));
+      case Functions::ARCHVC: // acos(2u-1)
+      return negate(multiply(two, reciprocalRoot(subtract(one, square(subtract(multiply(two, u), one))))));
+      case Functions::ARCHCV: // asin(1-2u)
+      return negate(multiply(two, reciprocalRoot(subtract(one, square(subtract(one, multiply(two, u)))))));
+      case Functions::ARCHCC: // asin(2u-1)
+      return multiply(two, reciprocalRoot(subtract(one, square(subtract(multiply(two, u), one)))));
+
+      // SPECIAL TRIG FUNCTIONS
+
+      case Functions::SINC:
+      return divide(subtract(multiply(u, apply(Functions::COS, u)), apply(Functions::SIN, u)), square(u));
+      case Functions::GD:
+      return apply(Functions::SECH, u);
+      case Functions::CRD:
+      return apply(Functions::COS, divide(u, two));
+      case Functions::ACRD:
+      return reciprocalRoot(subtract(one, square(divide(u, two))));
+      case Functions::CCD:
+      return negate(apply(Functions::SIN, divide(u, two)));
+      case Functions::ACCD:
+      return negate(reciprocalRoot(subtract(one, square(divide(u, two)))));
+
+      // INTEGRAL TRIG FUNCTIONS
+
+      case Functions::SI:
+      case Functions::si:
+      return divide(apply(Functions::SIN, u), u);
+      case Functions::CIN:
+      return divide(subtract(one, apply(Functions::COS, u)), u);
+      case Functions::CI:
+      return divide(apply(Functions::COS, u), u);
+      case Functions::SHI:
+      return divide(apply(Functions::SINH, u), u);
+      case Functions::CHI:
+      return divide(apply(Functions::COSH, u), u);
+
+      // DEPRECATED TRIG FUNCTIONS
+
+      case Functions::CAS:
+      return subtract(apply(Functions::COS, u), apply(Functions::SIN, u));
+      case Functions::EXS:
+      return multiply(apply(Functions::SEC, u), apply(Functions::TAN, u));
+      case Functions::EXC:
+      return negate(multiply(apply(Functions::CSC, u), apply(Functions::COT, u)));
+      case Functions::ARCEXS:
+      return arcsecantFactor(add(u, one));
+      case Functions::ARCEXCS:
+      return negate(arcsecantFactor(add(u, one)));
+      default:
+      return invalid;
+    }
+  }
+
+  NodeId unsupported()
+  {
+    statistics.unsupported++;
+    return interner.addLeaf(ASTLeaf(AtomicTypes::DNE));
+  }
+};
+
+// Convenience entry point backed by one differentiator per thread
+inline AST differentiate(const AST& ast, const char variable, const unsigned order = 1)
+{
+  thread_local Differentiator differentiator;
+  return differentiator.differentiate(ast, variable, order);
+}
+
+#endif
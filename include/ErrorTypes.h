@@ -0,0 +1,60 @@
+#ifndef ERRORTYPES_H
+#define ERRORTYPES_H
+
+#include <string_view>
+
+enum class ErrorTypes
+{
+  // NULL ERROR
+
+  NULLERROR,
+
+  // TOKENIZATION ERRORS
+
+  UNBALANCEDGROUPER, // A closing grouper without its opening one, e.g. 1+2)
+  UNCLOSEDGROUPER, // An opening grouper still open at the end of the input, e.g. (1+2
+  MALFORMEDNUMBER, // A decimal point without digits or a second one in the same number, e.g. 1.2.3
+  MISMATCHEDGROUPER, // A closing grouper of another type than the group it closes, e.g. (1+2]
+  UNIDENTIFIEDCHARACTER, // A character no token starts with, e.g. @
+  UNKNOWNCOMMAND, // A command that names no function or constant, e.g. \ln
+  JAGGEDMATRIX, // Matrix rows of different lengths, e.g. \matrix(1,2;3)
+
+  // PARSING ERRORS
+
+  STRAYSEPARATOR, // A comma or semicolon outside every grouper, e.g. 1,2
+  MISSINGOPERAND, // An operator or an argument without enough operands, e.g. 1+ or \gcd(1,)
+  MISSINGOPERATOR, // Operands without an operator between them, e.g. 1 2
+};
+
+// Identifier of each error, as written in diagnostics
+constexpr std::string_view getName(const ErrorTypes type)
+{
+  switch (type)
+  {
+    case ErrorTypes::NULLERROR:
+    return "none";
+    case ErrorTypes::UNBALANCEDGROUPER:
+    return "unbalanced-grouper";
+    case ErrorTypes::UNCLOSEDGROUPER:
+    return "unclosed-grouper";
+    case ErrorTypes::MALFORMEDNUMBER:
+    return "malformed-number";
+    case ErrorTypes::MISMATCHEDGROUPER:
+    return "mismatched-grouper";
+    case ErrorTypes::UNIDENTIFIEDCHARACTER:
+    return "unidentified-character";
+    case ErrorTypes::UNKNOWNCOMMAND:
+    return "unknown-command";
+    case ErrorTypes::JAGGEDMATRIX:
+    return "jagged-matrix";
+    case ErrorTypes::STRAYSEPARATOR:
+    return "stray-separator";
+    case ErrorTypes::MISSINGOPERAND:
+    return "missing-operand";
+    case ErrorTypes::MISSINGOPERATOR:
+    return "missing-operator";
+  }
+  return "unknown";
+}
+
+#endif
@@ -0,0 +1,829 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <variant>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "Functions.h"
+#include "Constants.h"
+#include "LookupTables.h"
+#include "AST.h"
+#include "BigInteger.h"
+#include "IntegerKernels.h"
+#include "NumberTheory.h"
+
+/*
+  The result of evaluating an expression or any of its nodes. type is REAL for numbers, PROPOSITION for the outcome of
+  relational operators (value 1 or 0), or one of the AtomicTypes error states:
+    UNDEFINED     outside the domain of the operation, e.g. 1/0, \sqrt{-1}, \log{0}, \arcsin{2}
+    UNDETERMINED  indeterminate forms (0/0, 0^0), unbound variables and the unknown and indeterminate constants
+    DNE           no real value exists: overflow, complex results (i) and functions without a numeric kernel
+  An error in any argument propagates to every node above it.
+*/
+struct Evaluation
+{
+  AtomicTypes type = AtomicTypes::REAL;
+  double value = 0;
+
+  bool isError() const
+  {
+    return type == AtomicTypes::UNDEFINED || type == AtomicTypes::UNDETERMINED || type == AtomicTypes::DNE;
+  }
+};
+
+// Values of the VARIABLE leaves, indexed by their character
+class Bindings
+{
+  public:
+  void set(const char name, const double value)
+  {
+    values[(unsigned char)name & 0x7F] = value;
+    bound.set((unsigned char)name & 0x7F);
+  }
+
+  void unset(const char name)
+  {
+    bound.reset((unsigned char)name & 0x7F);
+  }
+
+  void clear()
+  {
+    bound.reset();
+  }
+
+  bool isBound(const char name) const
+  {
+    return bound.test((unsigned char)name & 0x7F);
+  }
+
+  double get(const char name) const
+  {
+    return values[(unsigned char)name & 0x7F];
+  }
+
+  private:
+  std::array<double, 128> values{};
+  std::bitset<128> bound;
+};
+
+// Numeric kernel of a function. Arguments are already evaluated and never hold an error state
+using Kernel = Evaluation (*)(const Evaluation* args, uint32_t argCount);
+
+namespace Kernels
+{
+  constexpr double pi = 3.14159265358979323846;
+  constexpr double eulerMascheroni = 0.57721566490153286061;
+
+  constexpr Evaluation error(const AtomicTypes type)
+  {
+    return {type, 0};
+  }
+
+  // Maps results that left the real numbers: NaN comes from domain errors and infinities from overflow or poles
+  inline Evaluation real(const double value)
+  {
+    if (std::isnan(value)) return error(AtomicTypes::UNDEFINED);
+    if (std::isinf(value)) return error(AtomicTypes::DNE);
+    return {AtomicTypes::REAL, value};
+  }
+
+  constexpr Evaluation proposition(const bool value)
+  {
+    return {AtomicTypes::PROPOSITION, value ? 1.0 : 0.0};
+  }
+
+  inline Evaluation reciprocal(const double value)
+  {
+    return value == 0 ? error(AtomicTypes::UNDEFINED) : real(1/value);
+  }
+
+  // Integers above 2^53 can't be told apart from their neighbours, so they're rejected by integer-only functions
+  inline bool isInteger(const double value)
+  {
+    return std::fabs(value) <= 9007199254740992.0 && value == std::trunc(value);
+  }
+
+  // Sine and cosine integrals of |x|: power series below 2, continued fraction for the exponential integral above
+  inline void cosineSineIntegrals(const double x, double& ci, double& si)
+  {
+    constexpr double epsilon = std::numeric_limits<double>::epsilon();
+    const double t = std::fabs(x);
+    if (t == 0)
+    {
+      si = 0;
+      ci = -std::numeric_limits<double>::infinity();
+      return;
+    }
+    if (t > 2)
+    {
+      std::complex<double> b(1, t);
+      std::complex<double> c(1/std::numeric_limits<double>::min(), 0);
+      std::complex<double> d = 1.0/b;
+      std::complex<double> h = d;
+      for (int i = 2; i < 100; i++)
+      {
+        const double a = -(double)(i-1)*(i-1);
+        b += 2.0;
+        d = 1.0/(a*d+b);
+        c = b+a/c;
+        const std::complex<double> delta = c*d;
+        h *= delta;
+        if (std::fabs(delta.real()-1)+std::fabs(delta.imag()) < epsilon) break;
+      }
+      h *= std::complex<double>(std::cos(t), -std::sin(t));
+      ci = -h.real();
+      si = pi/2+h.imag();
+    }
+    else
+    {
+      double sum = 0, sums = 0, sumc = 0, sign = 1, fact = 1;
+      bool odd = true;
+      for (int k = 1; k < 100; k++)
+      {
+        fact *= t/k;
+        const double term = fact/k;
+        sum += sign*term;
+        const double relative = term/std::fabs(sum);
+        if (odd)
+        {
+          sign = -sign;
+          sums = sum;
+          sum = sumc;
+        }
+        else
+        {
+          sumc = sum;
+          sum = sums;
+        }
+        if (relative < epsilon) break;
+        odd = !odd;
+      }
+      si = sums;
+      ci = sumc+std::log(t)+eulerMascheroni;
+    }
+    if (x < 0) si = -si;
+  }
+
+  // Both series only have positive terms, so they converge without cancellation for every x
+  inline double sinhIntegral(const double x)
+  {
+    double term = x, sum = x;
+    for (int k = 1; k < 500 && std::fabs(term) > std::fabs(sum)*std::numeric_limits<double>::epsilon(); k++)
+    {
+      term *= x*x/((2*k)*(2*k+1));
+      sum += term/(2*k+1);
+    }
+    return sum;
+  }
+
+  inline double coshIntegral(const double x)
+  {
+    double term = 1, sum = 0;
+    for (int k = 1; k < 500; k++)
+    {
+      term *= x*x/((2*k-1)*(2*k));
+      sum += term/(2*k);
+      if (term/(2*k) <= sum*std::numeric_limits<double>::epsilon()) break;
+    }
+    return eulerMascheroni+std::log(std::fabs(x))+sum;
+  }
+
+  inline Evaluation unsupported(const Evaluation*, uint32_t)
+  {
+    return error(AtomicTypes::DNE);
+  }
+
+  // BASIC ARITHMETIC OPERATORS
+
+  inline Evaluation identity(const Evaluation* args, uint32_t)
+  {
+    return args[0];
+  }
+
+  inline Evaluation addition(const Evaluation* args, const uint32_t argCount)
+  {
+    double result = 0;
+    for (uint32_t i = 0; i < argCount; i++) result += args[i].value;
+    return real(result);
+  }
+
+  inline Evaluation subtraction(const Evaluation* args, uint32_t)
+  {
+    return real(args[0].value-args[1].value);
+  }
+
+  inline Evaluation unarySubtraction(const Evaluation* args, uint32_t)
+  {
+    return real(-args[0].value);
+  }
+
+  inline Evaluation multiplication(const Evaluation* args, const uint32_t argCount)
+  {
+    double result = 1;
+    for (uint32_t i = 0; i < argCount; i++) result *= args[i].value;
+    return real(result);
+  }
+
+  inline Evaluation division(const Evaluation* args, uint32_t)
+  {
+    if (args[1].value == 0) return error(args[0].value == 0 ? AtomicTypes::UNDETERMINED : AtomicTypes::UNDEFINED);
+    return real(args[0].value/args[1].value);
+  }
+
+  inline Evaluation exponentiation(const Evaluation* args, uint32_t)
+  {
+    if (args[0].value == 0)
+    {
+      if (args[1].value == 0) return error(AtomicTypes::UNDETERMINED);
+      if (args[1].value < 0) return error(AtomicTypes::UNDEFINED);
+    }
+    return real(std::pow(args[0].value, args[1].value));
+  }
+
+  // \sqrt{x} or \sqrt[n]{x}; odd roots of negative numbers stay real
+  inline Evaluation squareRoot(const Evaluation* args, const uint32_t argCount)
+  {
+    if (argCount == 1)
+    {
+      return args[0].value < 0 ? error(AtomicTypes::UNDEFINED) : real(std::sqrt(args[0].value));
+    }
+    const double n = args[0].value, x = args[1].value;
+    if (n == 0) return error(AtomicTypes::UNDEFINED);
+    if (x < 0)
+    {
+      if (isInteger(n) && std::fmod(n, 2) != 0) return real(-std::pow(-x, 1/n));
+      return error(AtomicTypes::UNDEFINED);
+    }
+    return real(std::pow(x, 1/n));
+  }
+
+  // \log{x} is the natural logarithm, \log[b]{x} takes the base first
+  inline Evaluation logarithm(const Evaluation* args, const uint32_t argCount)
+  {
+    const double x = args[argCount-1].value;
+    if (x <= 0) return error(AtomicTypes::UNDEFINED);
+    if (argCount == 1) return real(std::log(x));
+    const double base = args[0].value;
+    if (base <= 0 || base == 1) return error(AtomicTypes::UNDEFINED);
+    return real(std::log(x)/std::log(base));
+  }
+
+  inline Evaluation absoluteValue(const Evaluation* args, uint32_t)
+  {
+    return real(std::fabs(args[0].value));
+  }
+
+  // RELATIONAL OPERATORS
+
+  inline Evaluation equals(const Evaluation* args, uint32_t)
+  {
+    return proposition(args[0].value == args[1].value);
+  }
+
+  inline Evaluation greaterThan(const Evaluation* args, uint32_t)
+  {
+    return proposition(args[0].value > args[1].value);
+  }
+
+  inline Evaluation lowerThan(const Evaluation* args, uint32_t)
+  {
+    return proposition(args[0].value < args[1].value);
+  }
+
+  inline Evaluation greaterOrEqual(const Evaluation* args, uint32_t)
+  {
+    return proposition(args[0].value >= args[1].value);
+  }
+
+  inline Evaluation lowerOrEqual(const Evaluation* args, uint32_t)
+  {
+    return proposition(args[0].value <= args[1].value);
+  }
+
+  // COMBINATORICS & NUMBER THEORY
+
+  inline Evaluation gcd(const Evaluation* args, const uint32_t argCount)
+  {
+    int64_t result = 0;
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      if (!isInteger(args[i].value)) return error(AtomicTypes::UNDEFINED);
+      result = std::gcd(result, (int64_t)args[i].value);
+    }
+    return real((double)result);
+  }
+
+  inline Evaluation lcm(const Evaluation* args, const uint32_t argCount)
+  {
+    double result = 1;
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      if (!isInteger(args[i].value)) return error(AtomicTypes::UNDEFINED);
+      const double x = std::fabs(args[i].value);
+      if (x == 0) return real(0);
+      // Computed in doubles so that results past 2^63 overflow into DNE instead of wrapping around
+      result = result/(double)std::gcd((int64_t)result, (int64_t)x)*x;
+      if (!isInteger(result)) return error(AtomicTypes::DNE);
+    }
+    return real(result);
+  }
+
+  inline Evaluation modulo(const Evaluation* args, uint32_t)
+  {
+    if (args[1].value == 0) return error(AtomicTypes::UNDEFINED);
+    // The result takes the sign of the divisor, so x mod n always lands in [0, n) for positive n
+    const double remainder = std::fmod(args[0].value, args[1].value);
+    return real(remainder != 0 && (remainder < 0) != (args[1].value < 0) ? remainder+args[1].value : remainder);
+  }
+
+  inline Evaluation factorial(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value;
+    if (!isInteger(n) || n < 0) return error(AtomicTypes::UNDEFINED);
+    if (n > 170) return error(AtomicTypes::DNE);
+    double result = 1;
+    for (int k = 2; k <= (int)n; k++) result *= k;
+    return real(result);
+  }
+
+  // Falling factorial n!/(n-k)!
+  inline Evaluation permutations(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value, k = args[1].value;
+    if (!isInteger(n) || !isInteger(k) || n < 0 || k < 0) return error(AtomicTypes::UNDEFINED);
+    if (k > n) return real(0);
+    double result = 1;
+    for (double i = n-k+1; i <= n && !std::isinf(result); i++) result *= i;
+    return real(result);
+  }
+
+  inline Evaluation binomial(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value;
+    double k = args[1].value;
+    if (!isInteger(n) || !isInteger(k) || n < 0 || k < 0) return error(AtomicTypes::UNDEFINED);
+    if (k > n) return real(0);
+    if (k > n-k) k = n-k;
+    // Every partial product is itself a binomial coefficient, so the division is exact while it fits in a double
+    double result = 1;
+    for (double i = 1; i <= k && !std::isinf(result); i++) result = result*(n-k+i)/i;
+    return real(std::round(result));
+  }
+
+  // Functions without a closed form in doubles, computed exactly by IntegerKernels just past the range of doubles
+  template <Functions function>
+  inline Evaluation exactInteger(const Evaluation* args, const uint32_t argCount)
+  {
+    if (argCount > 2) return error(AtomicTypes::DNE);
+    BigInteger operands[2];
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      if (!isInteger(args[i].value)) return error(AtomicTypes::UNDEFINED);
+      operands[i] = BigInteger((int64_t)args[i].value);
+    }
+    BigInteger result;
+    const AtomicTypes type = IntegerKernels::evaluate(function, operands, argCount, result, 1100);
+    if (type != AtomicTypes::INTEGER) return error(type == AtomicTypes::NULLTYPE ? AtomicTypes::DNE : type);
+    return real(result.toDouble());
+  }
+
+  // Arithmetic functions of positive integers, factored through the shared PrimeSieve
+  inline Evaluation totient(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value;
+    if (!isInteger(n) || n < 1) return error(AtomicTypes::UNDEFINED);
+    return real((double)NumberTheory::totient((uint64_t)n));
+  }
+
+  inline Evaluation divisorSum(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value;
+    if (!isInteger(n) || n < 1) return error(AtomicTypes::UNDEFINED);
+    return real((double)NumberTheory::divisorSum((uint64_t)n));
+  }
+
+  inline Evaluation mobius(const Evaluation* args, uint32_t)
+  {
+    const double n = args[0].value;
+    if (!isInteger(n) || n < 1) return error(AtomicTypes::UNDEFINED);
+    return real(NumberTheory::mobius((uint64_t)n));
+  }
+
+  // Defined for every real x as the number of primes up to it
+  inline Evaluation primeCounting(const Evaluation* args, uint32_t)
+  {
+    const double x = std::floor(args[0].value);
+    if (x < 2) return real(0);
+    if (x > (double)NumberTheory::primeCountingLimit) return error(AtomicTypes::DNE);
+    return real((double)NumberTheory::primeCount((uint64_t)x));
+  }
+
+  inline Evaluation ceiling(const Evaluation* args, uint32_t)
+  {
+    return real(std::ceil(args[0].value));
+  }
+
+  inline Evaluation floor(const Evaluation* args, uint32_t)
+  {
+    return real(std::floor(args[0].value));
+  }
+
+  inline Evaluation fractionalPart(const Evaluation* args, uint32_t)
+  {
+    return real(args[0].value-std::floor(args[0].value));
+  }
+
+  inline Evaluation round(const Evaluation* args, uint32_t)
+  {
+    return real(std::round(args[0].value));
+  }
+
+  inline Evaluation sign(const Evaluation* args, uint32_t)
+  {
+    return real((args[0].value > 0)-(args[0].value < 0));
+  }
+
+  // Table of the functions computed by a single expression of their only argument x
+  #define MATHSOLVER_UNARY_KERNEL(name, expression) \
+    inline Evaluation name(const Evaluation* args, uint32_t) \
+    { \
+      const double x = args[0].value; \
+      return real(expression); \
+    }
+
+  #define MATHSOLVER_RECIPROCAL_KERNEL(name, expression) \
+    inline Evaluation name(const Evaluation* args, uint32_t) \
+    { \
+      const double x = args[0].value; \
+      return reciprocal(expression); \
+    }
+
+  // ELLIPTIC TRIG FUNCTIONS
+
+  MATHSOLVER_UNARY_KERNEL(sin, std::sin(x))
+  MATHSOLVER_UNARY_KERNEL(cos, std::cos(x))
+  MATHSOLVER_UNARY_KERNEL(tan, std::tan(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(csc, std::sin(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(sec, std::cos(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(cot, std::tan(x))
+  MATHSOLVER_UNARY_KERNEL(arcsin, std::asin(x))
+  MATHSOLVER_UNARY_KERNEL(arccos, std::acos(x))
+  MATHSOLVER_UNARY_KERNEL(arctan, std::atan(x))
+  MATHSOLVER_UNARY_KERNEL(arccsc, x == 0 ? NAN : std::asin(1/x))
+  MATHSOLVER_UNARY_KERNEL(arcsec, x == 0 ? NAN : std::acos(1/x))
+  MATHSOLVER_UNARY_KERNEL(arccot, x == 0 ? pi/2 : std::atan(1/x))
+
+  // HYPERBOLIC TRIG FUNCTIONS
+
+  MATHSOLVER_UNARY_KERNEL(sinh, std::sinh(x))
+  MATHSOLVER_UNARY_KERNEL(cosh, std::cosh(x))
+  MATHSOLVER_UNARY_KERNEL(tanh, std::tanh(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(csch, std::sinh(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(sech, std::cosh(x))
+  MATHSOLVER_RECIPROCAL_KERNEL(coth, std::tanh(x))
+  MATHSOLVER_UNARY_KERNEL(arcsinh, std::asinh(x))
+  MATHSOLVER_UNARY_KERNEL(arccosh, std::acosh(x))
+  MATHSOLVER_UNARY_KERNEL(arctanh, std::fabs(x) == 1 ? NAN : std::atanh(x))
+  MATHSOLVER_UNARY_KERNEL(arccsch, x == 0 ? NAN : std::asinh(1/x))
+  MATHSOLVER_UNARY_KERNEL(arcsech, x <= 0 ? NAN : std::acosh(1/x))
+  MATHSOLVER_UNARY_KERNEL(arccoth, std::fabs(x) <= 1 ? NAN : std::atanh(1/x))
+
+  // SPHERICAL TRIG FUNCTIONS
+
+  MATHSOLVER_UNARY_KERNEL(versine, 1-std::cos(x))
+  MATHSOLVER_UNARY_KERNEL(coversine, 1-std::sin(x))
+  MATHSOLVER_UNARY_KERNEL(vercosine, 1+std::cos(x))
+  MATHSOLVER_UNARY_KERNEL(covercosine, 1+std::sin(x))
+  MATHSOLVER_UNARY_KERNEL(haversine, (1-std::cos(x))/2)
+  MATHSOLVER_UNARY_KERNEL(hacoversine, (1-std::sin(x))/2)
+  MATHSOLVER_UNARY_KERNEL(havercosine, (1+std::cos(x))/2)
+  MATHSOLVER_UNARY_KERNEL(hacovercosine, (1+std::sin(x))/2)
+  MATHSOLVER_UNARY_KERNEL(arcversine, std::acos(1-x))
+  MATHSOLVER_UNARY_KERNEL(arcvercosine, std::acos(x-1))
+  MATHSOLVER_UNARY_KERNEL(arccoversine, std::asin(1-x))
+  MATHSOLVER_UNARY_KERNEL(arccovercosine, std::asin(x-1))
+  MATHSOLVER_UNARY_KERNEL(archaversine, std::acos(1-2*x))
+  MATHSOLVER_UNARY_KERNEL(archavercosine, std::acos(2*x-1))
+  MATHSOLVER_UNARY_KERNEL(archacoversine, std::asin(1-2*x))
+  MATHSOLVER_UNARY_KERNEL(archacovercosine, std::asin(2*x-1))
+
+  // SPECIAL TRIG FUNCTIONS
+
+  inline Evaluation atan2(const Evaluation* args, const uint32_t argCount)
+  {
+    if (argCount != 2) return error(AtomicTypes::UNDEFINED);
+    return real(std::atan2(args[0].value, args[1].value));
+  }
+
+  MATHSOLVER_UNARY_KERNEL(sinc, x == 0 ? 1 : std::sin(x)/x)
+  MATHSOLVER_UNARY_KERNEL(gudermannian, 2*std::atan(std::tanh(x/2)))
+  MATHSOLVER_UNARY_KERNEL(chord, 2*std::sin(x/2))
+  MATHSOLVER_UNARY_KERNEL(antichord, 2*std::asin(x/2))
+  MATHSOLVER_UNARY_KERNEL(cochord, 2*std::cos(x/2))
+  MATHSOLVER_UNARY_KERNEL(anticochord, 2*std::acos(x/2))
+
+  // ELLIPTIC INTEGRAL TRIG FUNCTIONS
+
+  inline Evaluation sineIntegral(const Evaluation* args, uint32_t)
+  {
+    double ci, si;
+    cosineSineIntegrals(args[0].value, ci, si);
+    return real(si);
+  }
+
+  inline Evaluation shiftedSineIntegral(const Evaluation* args, uint32_t)
+  {
+    double ci, si;
+    cosineSineIntegrals(args[0].value, ci, si);
+    return real(si-pi/2);
+  }
+
+  // Cin is entire and even, unlike Ci which is only real for positive arguments
+  inline Evaluation entireCosineIntegral(const Evaluation* args, uint32_t)
+  {
+    const double x = std::fabs(args[0].value);
+    if (x == 0) return real(0);
+    double ci, si;
+    cosineSineIntegrals(x, ci, si);
+    return real(eulerMascheroni+std::log(x)-ci);
+  }
+
+  inline Evaluation cosineIntegral(const Evaluation* args, uint32_t)
+  {
+    if (args[0].value <= 0) return error(AtomicTypes::UNDEFINED);
+    double ci, si;
+    cosineSineIntegrals(args[0].value, ci, si);
+    return real(ci);
+  }
+
+  // HYPERBOLIC INTEGRAL TRIG FUNCTIONS
+
+  MATHSOLVER_UNARY_KERNEL(hyperbolicSineIntegral, sinhIntegral(x))
+  MATHSOLVER_UNARY_KERNEL(hyperbolicCosineIntegral, x <= 0 ? NAN : coshIntegral(x))
+
+  // DEPRECATED TRIG FUNCTIONS (cis and arccis are complex valued and keep the unsupported kernel)
+
+  MATHSOLVER_UNARY_KERNEL(cas, std::cos(x)+std::sin(x))
+  MATHSOLVER_UNARY_KERNEL(exsecant, std::cos(x) == 0 ? NAN : 1/std::cos(x)-1)
+  MATHSOLVER_UNARY_KERNEL(excosecant, std::sin(x) == 0 ? NAN : 1/std::sin(x)-1)
+  MATHSOLVER_UNARY_KERNEL(arcexsecant, x+1 == 0 ? NAN : std::acos(1/(x+1)))
+  MATHSOLVER_UNARY_KERNEL(arcexcosecant, x+1 == 0 ? NAN : std::asin(1/(x+1)))
+
+  #undef MATHSOLVER_UNARY_KERNEL
+  #undef MATHSOLVER_RECIPROCAL_KERNEL
+
+  struct KernelEntry
+  {
+    Functions function;
+    Kernel kernel;
+  };
+
+  constexpr KernelEntry kernelList[] = {
+    {Functions::IDENTITY, identity},
+    {Functions::ADDITION, addition},
+    {Functions::SUBTRACTION, subtraction},
+    {Functions::UNSUBTRACTION, unarySubtraction},
+    {Functions::MULTIPLICATION, multiplication},
+    {Functions::DIVISION, division},
+    {Functions::EXPONENTIATION, exponentiation},
+    {Functions::SQRT, squareRoot},
+    {Functions::LOG, logarithm},
+    {Functions::ABS, absoluteValue},
+    {Functions::EQUALS, equals},
+    {Functions::GT, greaterThan},
+    {Functions::LT, lowerThan},
+    {Functions::GE, greaterOrEqual},
+    {Functions::LE, lowerOrEqual},
+    {Functions::SIN, sin},
+    {Functions::COS, cos},
+    {Functions::TAN, tan},
+    {Functions::CSC, csc},
+    {Functions::SEC, sec},
+    {Functions::COT, cot},
+    {Functions::ARCSIN, arcsin},
+    {Functions::ARCCOS, arccos},
+    {Functions::ARCTAN, arctan},
+    {Functions::ARCCSC, arccsc},
+    {Functions::ARCSEC, arcsec},
+    {Functions::ARCCOT, arccot},
+    {Functions::SINH, sinh},
+    {Functions::COSH, cosh},
+    {Functions::TANH, tanh},
+    {Functions::CSCH, csch},
+    {Functions::SECH, sech},
+    {Functions::COTH, coth},
+    {Functions::ARCSINH, arcsinh},
+    {Functions::ARCCOSH, arccosh},
+    {Functions::ARCTANH, arctanh},
+    {Functions::ARCCSCH, arccsch},
+    {Functions::ARCSECH, arcsech},
+    {Functions::ARCCOTH, arccoth},
+    {Functions::VER, versine},
+    {Functions::CVS, coversine},
+    {Functions::VCS, vercosine},
+    {Functions::CVC, covercosine},
+    {Functions::HV, haversine},
+    {Functions::HCV, hacoversine},
+    {Functions::HVC, havercosine},
+    {Functions::HCC, hacovercosine},
+    {Functions::SV, haversine},
+    {Functions::SCV, hacoversine},
+    {Functions::ARCVER, arcversine},
+    {Functions::ARCVCS, arcvercosine},
+    {Functions::ARCCVS, arccoversine},
+    {Functions::ARCCVC, arccovercosine},
+    {Functions::ARCHV, archaversine},
+    {Functions::ARCHVC, archavercosine},
+    {Functions::ARCHCV, archacoversine},
+    {Functions::ARCHCC, archacovercosine},
+    {Functions::ATAN2, atan2},
+    {Functions::SINC, sinc},
+    {Functions::GD, gudermannian},
+    {Functions::CRD, chord},
+    {Functions::ACRD, antichord},
+    {Functions::CCD, cochord},
+    {Functions::ACCD, anticochord},
+    {Functions::SI, sineIntegral},
+    {Functions::si, shiftedSineIntegral},
+    {Functions::CIN, entireCosineIntegral},
+    {Functions::CI, cosineIntegral},
+    {Functions::SHI, hyperbolicSineIntegral},
+    {Functions::CHI, hyperbolicCosineIntegral},
+    {Functions::CAS, cas},
+    {Functions::EXS, exsecant},
+    {Functions::EXC, excosecant},
+    {Functions::ARCEXS, arcexsecant},
+    {Functions::ARCEXCS, arcexcosecant},
+    {Functions::GCD, gcd},
+    {Functions::LCM, lcm},
+    {Functions::MODULO, modulo},
+    {Functions::FACTORIAL, factorial},
+    {Functions::PERM, permutations},
+    {Functions::CHOOSE, binomial},
+    {Functions::FIB, exactInteger<Functions::FIB>},
+    {Functions::PHI, totient},
+    {Functions::PI, primeCounting},
+    {Functions::SIGMA, divisorSum},
+    {Functions::PARTITION, exactInteger<Functions::PARTITION>},
+    {Functions::MU, mobius},
+    {Functions::FKSTIRLING, exactInteger<Functions::FKSTIRLING>},
+    {Functions::UNGSTIRLING, exactInteger<Functions::UNGSTIRLING>},
+    {Functions::SKSTIRLING, exactInteger<Functions::SKSTIRLING>},
+    {Functions::PRIMORIAL, exactInteger<Functions::PRIMORIAL>},
+    {Functions::CEIL, ceiling},
+    {Functions::FLOOR, floor},
+    {Functions::FRAC, fractionalPart},
+    {Functions::ROUND, round},
+    {Functions::SIGN, sign},
+  };
+
+  // Dense table indexed by Functions; functions missing from kernelList evaluate to DNE
+  constexpr std::array<Kernel, functionCount> buildKernelTable()
+  {
+    std::array<Kernel, functionCount> table{};
+    for (size_t i = 0; i < functionCount; i++)
+    {
+      table[i] = unsupported;
+    }
+    for (const KernelEntry& entry : kernelList)
+    {
+      table[(size_t)entry.function] = entry.kernel;
+    }
+    return table;
+  }
+
+  constexpr std::array<Kernel, functionCount> kernelTable = buildKernelTable();
+
+  // Indexed by Constants
+  constexpr Evaluation constantValues[] = {
+    error(AtomicTypes::DNE), // NULLCONST
+    error(AtomicTypes::UNDETERMINED), // INDETERMINATE
+    error(AtomicTypes::UNDEFINED), // UNDEFINED
+    error(AtomicTypes::UNDETERMINED), // UNKNOWN
+    {AtomicTypes::REAL, pi},
+    {AtomicTypes::REAL, 2.71828182845904523536},
+    {AtomicTypes::REAL, 1.61803398874989484820},
+    error(AtomicTypes::DNE), // i isn't real
+    {AtomicTypes::REAL, eulerMascheroni},
+    {AtomicTypes::REAL, 0.56714329040978387300},
+    {AtomicTypes::REAL, 0.73908513321516064166},
+    {AtomicTypes::REAL, 0.91596559417721901505},
+  };
+  static_assert(std::size(constantValues) == constantCount, "Every constant needs a value");
+}
+
+inline Kernel getKernel(const Functions f)
+{
+  return Kernels::kernelTable[(size_t)f];
+}
+
+/*
+  Evaluates an arena AST in increasing id order, which visits every child before its parent, so no recursion or
+  explicit stack is needed. Results are kept per node in a buffer that only grows, and arguments are gathered into a
+  second reused buffer before calling their kernel: once both have reached the size of the largest expression seen,
+  evaluating allocates nothing.
+*/
+class Evaluator
+{
+  public:
+  Evaluation evaluate(const AST& ast, const Bindings& bindings)
+  {
+    if (ast.size() == 0)
+    {
+      return Kernels::error(AtomicTypes::DNE);
+    }
+    if (results.size() < ast.size())
+    {
+      results.resize(ast.size());
+    }
+    for (NodeId id = 0; id < ast.size(); id++)
+    {
+      const ASTNode& node = ast.nodes[id];
+      if (!std::holds_alternative<Functions>(node.leaf.type))
+      {
+        results[id] = evaluateLeaf(node.leaf, bindings);
+        continue;
+      }
+      if (operands.size() < node.argCount)
+      {
+        operands.resize(node.argCount);
+      }
+      const NodeId* args = ast.args.data()+node.firstArg;
+      Evaluation propagated;
+      for (uint32_t i = 0; i < node.argCount; i++)
+      {
+        operands[i] = results[args[i]];
+        if (operands[i].isError() && !propagated.isError())
+        {
+          propagated = operands[i];
+        }
+      }
+      results[id] = propagated.isError() ? propagated : getKernel(std::get<Functions>(node.leaf.type))(operands.data(), node.argCount);
+    }
+    return results[ast.root];
+  }
+
+  static Evaluation evaluateLeaf(const ASTLeaf& leaf, const Bindings& bindings)
+  {
+    if (!std::holds_alternative<AtomicTypes>(leaf.type))
+    {
+      return Kernels::error(AtomicTypes::DNE);
+    }
+    switch (std::get<AtomicTypes>(leaf.type))
+    {
+      case AtomicTypes::INTEGER:
+      if (std::holds_alternative<const BigInteger*>(leaf.value))
+      {
+        return Kernels::real(std::get<const BigInteger*>(leaf.value)->toDouble());
+      }
+      if (std::holds_alternative<int64_t>(leaf.value))
+      {
+        return {AtomicTypes::REAL, (double)std::get<int64_t>(leaf.value)};
+      }
+      return {AtomicTypes::REAL, (double)std::get<int>(leaf.value)};
+      case AtomicTypes::REAL:
+      if (std::holds_alternative<Decimal>(leaf.value))
+      {
+        return {AtomicTypes::REAL, std::get<Decimal>(leaf.value).toDouble()};
+      }
+      return {AtomicTypes::REAL, std::get<double>(leaf.value)};
+      case AtomicTypes::CONSTANT:
+      {
+        const size_t constant = (size_t)std::get<int>(leaf.value);
+        return constant < constantCount ? Kernels::constantValues[constant] : Kernels::error(AtomicTypes::DNE);
+      }
+      case AtomicTypes::VARIABLE:
+      {
+        const char name = (char)std::get<int>(leaf.value);
+        return bindings.isBound(name) ? Evaluation{AtomicTypes::REAL, bindings.get(name)} : Kernels::error(AtomicTypes::UNDETERMINED);
+      }
+      case AtomicTypes::UNDEFINED:
+      case AtomicTypes::UNDETERMINED:
+      case AtomicTypes::DNE:
+      return Kernels::error(std::get<AtomicTypes>(leaf.type));
+      default:
+      return Kernels::error(AtomicTypes::DNE);
+    }
+  }
+
+  private:
+  std::vector<Evaluation> results;
+  std::vector<Evaluation> operands;
+};
+
+// Convenience entry point backed by one evaluator per thread, so repeated calls don't allocate either
+inline Evaluation evaluate(const AST& ast, const Bindings& bindings)
+{
+  thread_local Evaluator evaluator;
+  return evaluator.evaluate(ast, bindings);
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef EXPRESSIONCACHE_H
+#define EXPRESSIONCACHE_H
+
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "Diagnostics.h"
+#include "Parser.h"
+
+struct ExpressionCacheStatistics
+{
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t insertions = 0;
+  uint64_t evictions = 0;
+  uint64_t uncacheable = 0; // Inputs with errors, parsed but never stored
+  size_t entries = 0;
+  size_t bytes = 0; // Estimated footprint of the stored tokens and ASTs
+};
+
+// Two words per token, as written by encodeLeaf, then the sign, length and limbs of every big integer among them, so
+//   two token streams are equal exactly when their keys are
+inline void encodeTokens(const std::vector<ASTLeaf>& tokens, std::vector<uint64_t>& key)
+{
+  key.resize(2*tokens.size());
+  for (size_t i = 0; i < tokens.size(); i++)
+  {
+    encodeLeaf(tokens[i], &key[2*i]);
+  }
+  for (const ASTLeaf& token : tokens)
+  {
+    if (std::holds_alternative<const BigInteger*>(token.value))
+    {
+      const BigInteger& value = *std::get<const BigInteger*>(token.value);
+      key.push_back(value.isNegative() ? ~(uint64_t)value.limbCount() : (uint64_t)value.limbCount());
+      key.insert(key.end(), value.limbs(), value.limbs()+value.limbCount());
+    }
+  }
+}
+
+inline uint64_t hashKey(const std::vector<uint64_t>& key)
+{
+  uint64_t hash = key.size();
+  for (const uint64_t word : key)
+  {
+    hash = mixHash(hash, word);
+  }
+  return hash;
+}
+
+/*
+  Cache of parsed expressions keyed by their token stream, so inputs that only differ in whitespace or in implicit
+  multiplications (2x and 2*x) share one entry. A hit still tokenizes the input but skips the shunting-yard and the AST
+  construction, and hands out the stored AST itself: entries are immutable and shared, so they stay valid for their
+  holders after being evicted. Memory is bounded by an estimate of the bytes held by every entry.
+
+  The cache is split into shards, each one with its own lock, LRU list and counters, so concurrent lookups only contend
+  when their hashes land on the same shard. Parsing on a miss happens outside the lock.
+*/
+class ExpressionCache
+{
+  public:
+  static constexpr size_t shardCount = 16;
+
+  explicit ExpressionCache(const size_t capacityBytes = 64 << 20) : capacity(capacityBytes)
+  {
+  }
+
+  ExpressionCache(const ExpressionCache&) = delete;
+  ExpressionCache& operator=(const ExpressionCache&) = delete;
+
+  // Returns the AST of input, parsing it with parser on a miss. The errors of input are left in parser.getDiagnostics()
+  //   as with Parser::Parse; inputs with errors are parsed every time and never stored, so a hit has none
+  std::shared_ptr<const AST> Parse(const std::string_view input, Parser& parser)
+  {
+    const std::vector<ASTLeaf>& tokens = parser.Tokenize(input);
+    thread_local std::vector<uint64_t> key;
+    encodeTokens(tokens, key);
+    const uint64_t hash = hashKey(key);
+    Shard& shard = shards[hash % shardCount];
+    if (!parser.getDiagnostics().empty())
+    {
+      {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.statistics.uncacheable++;
+      }
+      return std::make_shared<const AST>(parser.RPN2AST(parser.RPN(tokens, &parser.getTokenSpans())));
+    }
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (const auto entry = shard.find(hash, key); entry != shard.entries.end())
+      {
+        shard.statistics.hits++;
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+        return entry->ast;
+      }
+      shard.statistics.misses++;
+    }
+
+    std::shared_ptr<const AST> ast = std::make_shared<const AST>(parser.RPN2AST(parser.RPN(tokens, &parser.getTokenSpans())));
+    if (!parser.getDiagnostics().empty())
+    {
+      // Errors only shunting-yard finds
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.statistics.uncacheable++;
+      return ast;
+    }
+    Entry entry{hash, key, ast, 0};
+    entry.bytes = footprint(entry);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another thread may have parsed the same expression meanwhile, in which case its entry is kept
+    if (const auto existing = shard.find(hash, entry.key); existing != shard.entries.end())
+    {
+      return existing->ast;
+    }
+    shard.statistics.insertions++;
+    shard.statistics.bytes += entry.bytes;
+    shard.entries.push_front(std::move(entry));
+    shard.index.emplace(hash, shard.entries.begin());
+    shard.statistics.entries++;
+    // The newest entry is always kept, even if it doesn't fit on its own
+    while (shard.statistics.bytes > capacity/shardCount && shard.entries.size() > 1)
+    {
+      shard.evict();
+    }
+    return ast;
+  }
+
+  // Summed over the shards; every shard is read under its own lock, so the totals aren't a single atomic snapshot
+  ExpressionCacheStatistics getStatistics() const
+  {
+    ExpressionCacheStatistics total;
+    for (const Shard& shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      total.hits += shard.statistics.hits;
+      total.misses += shard.statistics.misses;
+      total.insertions += shard.statistics.insertions;
+      total.evictions += shard.statistics.evictions;
+      total.uncacheable += shard.statistics.uncacheable;
+      total.entries += shard.statistics.entries;
+      total.bytes += shard.statistics.bytes;
+    }
+    return total;
+  }
+
+  size_t getCapacity() const
+  {
+    return capacity;
+  }
+
+  // Drops every entry but keeps the counters
+  void clear()
+  {
+    for (Shard& shard : shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.index.clear();
+      shard.entries.clear();
+      shard.statistics.entries = 0;
+      shard.statistics.bytes = 0;
+    }
+  }
+
+  private:
+  struct Entry
+  {
+    uint64_t hash;
+    std::vector<uint64_t> key; // Compared on every hit, since different token streams may share a hash
+    std::shared_ptr<const AST> ast;
+    size_t bytes;
+  };
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+    ExpressionCacheStatistics statistics;
+
+    std::list<Entry>::iterator find(const uint64_t hash, const std::vector<uint64_t>& key)
+    {
+      const auto range = index.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->second->key == key)
+        {
+          return it->second;
+        }
+      }
+      return entries.end();
+    }
+
+    void evict()
+    {
+      const auto last = std::prev(entries.end());
+      const auto range = index.equal_range(last->hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        if (it->second == last)
+        {
+          index.erase(it);
+          break;
+        }
+      }
+      statistics.bytes -= last->bytes;
+      statistics.entries--;
+      statistics.evictions++;
+      entries.pop_back();
+    }
+  };
+
+  const size_t capacity;
+  Shard shards[shardCount];
+
+  // Buffers of the entry plus a rough allowance for the list node, the index node and the shared AST control block
+  static size_t footprint(const Entry& entry)
+  {
+    return sizeof(Entry)+entry.key.capacity()*sizeof(uint64_t)+sizeof(AST)+entry.ast->nodes.capacity()*sizeof(ASTNode)
+      +entry.ast->args.capacity()*sizeof(NodeId)+96;
+  }
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 enum class FunctionTypes
 {
+  NULLFUNCTIONTYPE, // Functions that can't appear in the input by themselves (e.g. the interval types)
   BINARY,
   UNARYLEFT,
   UNARYRIGHT,
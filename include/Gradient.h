@@ -0,0 +1,543 @@
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+#include "AST.h"
+#include "AtomicTypes.h"
+#include "Evaluator.h"
+#include "Functions.h"
+
+enum class DifferentiationModes : uint8_t
+{
+  FORWARD, // Dual numbers carrying one tangent per variable: work grows with the number of variables
+  REVERSE, // A tape of local partials swept backwards once: work is independent of the number of variables
+};
+
+// Value of an expression and its partial derivatives with respect to every variable it contains
+struct Gradient
+{
+  Evaluation value;
+  std::vector<char> variables; // Sorted by character
+  std::vector<Evaluation> derivatives; // Same order as variables
+
+  // Variables that don't appear in the expression have a zero derivative
+  Evaluation get(const char name) const
+  {
+    for (size_t i = 0; i < variables.size(); i++)
+    {
+      if (variables[i] == name)
+      {
+        return derivatives[i];
+      }
+    }
+    return value.isError() ? value : Evaluation{AtomicTypes::REAL, 0};
+  }
+};
+
+namespace Kernels
+{
+  // Writes the partial derivative of function with respect to each of its arguments, at a point where its kernel gave
+  //   value. Returns false for the functions without a rule: comparisons, integer functions and rounding
+  inline bool partials(const Functions function, const Evaluation* args, const uint32_t argCount, const double value, double* out)
+  {
+    const double x = args[0].value;
+    switch (function)
+    {
+      case Functions::IDENTITY:
+      out[0] = 1;
+      return true;
+      case Functions::ADDITION:
+      for (uint32_t i = 0; i < argCount; i++) out[i] = 1;
+      return true;
+      case Functions::SUBTRACTION:
+      out[0] = 1;
+      out[1] = -1;
+      return true;
+      case Functions::UNSUBTRACTION:
+      out[0] = -1;
+      return true;
+      case Functions::MULTIPLICATION:
+      {
+        // Product of every other argument, from prefix and suffix products so zero arguments need no special case
+        double product = 1;
+        for (uint32_t i = 0; i < argCount; i++)
+        {
+          out[i] = product;
+          product *= args[i].value;
+        }
+        product = 1;
+        for (uint32_t i = argCount; i-- > 0;)
+        {
+          out[i] *= product;
+          product *= args[i].value;
+        }
+      }
+      return true;
+      case Functions::DIVISION:
+      out[0] = 1/args[1].value;
+      out[1] = -value/args[1].value;
+      return true;
+      case Functions::EXPONENTIATION:
+      {
+        const double y = args[1].value;
+        out[0] = y == 0 ? 0 : y*std::pow(x, y-1);
+        out[1] = x > 0 ? value*std::log(x) : x == 0 && y > 0 ? 0 : NAN;
+      }
+      return true;
+      case Functions::SQRT:
+      if (argCount == 1)
+      {
+        out[0] = 1/(2*value);
+        return true;
+      }
+      {
+        // \sqrt[n]{x}, including the odd roots of negative numbers
+        const double n = x, radicand = args[1].value;
+        out[0] = radicand == 0 ? 0 : -value*std::log(std::fabs(radicand))/(n*n);
+        out[1] = std::pow(std::fabs(radicand), 1/n-1)/n;
+      }
+      return true;
+      case Functions::LOG:
+      if (argCount == 1)
+      {
+        out[0] = 1/x;
+        return true;
+      }
+      out[0] = -value/(x*std::log(x));
+      out[1] = 1/(args[1].value*std::log(x));
+      return true;
+      // Subgradient 0 at the origin, like the SIGN factor of Differentiator
+      case Functions::ABS:
+      out[0] = (x > 0)-(x < 0);
+      return true;
+      case Functions::SIN:
+      out[0] = std::cos(x);
+      return true;
+      case Functions::COS:
+      out[0] = -std::sin(x);
+      return true;
+      case Functions::TAN:
+      out[0] = 1+value*value;
+      return true;
+      case Functions::CSC:
+      out[0] = -value/std::tan(x);
+      return true;
+      case Functions::SEC:
+      out[0] = value*std::tan(x);
+      return true;
+      case Functions::COT:
+      out[0] = -1-value*value;
+      return true;
+      case Functions::ARCSIN:
+      out[0] = 1/std::sqrt(1-x*x);
+      return true;
+      case Functions::ARCCOS:
+      out[0] = -1/std::sqrt(1-x*x);
+      return true;
+      case Functions::ARCTAN:
+      case Functions::ARCCOT:
+      out[0] = (function == Functions::ARCTAN ? 1 : -1)/(1+x*x);
+      return true;
+      case Functions::ARCCSC:
+      out[0] = -1/(std::fabs(x)*std::sqrt(x*x-1));
+      return true;
+      case Functions::ARCSEC:
+      out[0] = 1/(std::fabs(x)*std::sqrt(x*x-1));
+      return true;
+      case Functions::SINH:
+      out[0] = std::cosh(x);
+      return true;
+      case Functions::COSH:
+      out[0] = std::sinh(x);
+      return true;
+      case Functions::TANH:
+      out[0] = 1-value*value;
+      return true;
+      case Functions::CSCH:
+      out[0] = -value/std::tanh(x);
+      return true;
+      case Functions::SECH:
+      out[0] = -value*std::tanh(x);
+      return true;
+      case Functions::COTH:
+      out[0] = 1-value*value;
+      return true;
+      case Functions::ARCSINH:
+      out[0] = 1/std::sqrt(x*x+1);
+      return true;
+      case Functions::ARCCOSH:
+      out[0] = 1/std::sqrt(x*x-1);
+      return true;
+      case Functions::ARCTANH:
+      case Functions::ARCCOTH:
+      out[0] = 1/(1-x*x);
+      return true;
+      case Functions::ARCCSCH:
+      out[0] = -1/(std::fabs(x)*std::sqrt(1+x*x));
+      return true;
+      case Functions::ARCSECH:
+      out[0] = -1/(x*std::sqrt(1-x*x));
+      return true;
+      case Functions::VER:
+      out[0] = std::sin(x);
+      return true;
+      case Functions::CVS:
+      out[0] = -std::cos(x);
+      return true;
+      case Functions::VCS:
+      out[0] = -std::sin(x);
+      return true;
+      case Functions::CVC:
+      out[0] = std::cos(x);
+      return true;
+      case Functions::HV:
+      case Functions::SV:
+      out[0] = std::sin(x)/2;
+      return true;
+      case Functions::HCV:
+      case Functions::SCV:
+      out[0] = -std::cos(x)/2;
+      return true;
+      case Functions::HVC:
+      out[0] = -std::sin(x)/2;
+      return true;
+      case Functions::HCC:
+      out[0] = std::cos(x)/2;
+      return true;
+      case Functions::ARCVER: // acos(1-x)
+      case Functions::ARCCVC: // asin(x-1)
+      out[0] = 1/std::sqrt(1-(1-x)*(1-x));
+      return true;
+      case Functions::ARCVCS: // acos(x-1)
+      case Functions::ARCCVS: // asin(1-x)
+      out[0] = -1/std::sqrt(1-(1-x)*(1-x));
+      return true;
+      case Functions::ARCHV: // acos(1-2x)
+      case Functions::ARCHCC: // asin(2x-1)
+      out[0] = 2/std::sqrt(1-(1-2*x)*(1-2*x));
+      return true;
+      case Functions::ARCHVC: // acos(2x-1)
+      case Functions::ARCHCV: // asin(1-2x)
+      out[0] = -2/std::sqrt(1-(1-2*x)*(1-2*x));
+      return true;
+      case Functions::ATAN2:
+      {
+        const double y = x, abscissa = args[1].value, radius = y*y+abscissa*abscissa;
+        out[0] = abscissa/radius;
+        out[1] = -y/radius;
+      }
+      return true;
+      case Functions::SINC:
+      out[0] = x == 0 ? 0 : (std::cos(x)-value)/x;
+      return true;
+      case Functions::GD:
+      out[0] = 1/std::cosh(x);
+      return true;
+      case Functions::CRD:
+      out[0] = std::cos(x/2);
+      return true;
+      case Functions::ACRD:
+      out[0] = 1/std::sqrt(1-x*x/4);
+      return true;
+      case Functions::CCD:
+      out[0] = -std::sin(x/2);
+      return true;
+      case Functions::ACCD:
+      out[0] = -1/std::sqrt(1-x*x/4);
+      return true;
+      case Functions::SI:
+      case Functions::si:
+      out[0] = x == 0 ? 1 : std::sin(x)/x;
+      return true;
+      case Functions::CIN:
+      out[0] = x == 0 ? 0 : (1-std::cos(x))/x;
+      return true;
+      case Functions::CI:
+      out[0] = std::cos(x)/x;
+      return true;
+      case Functions::SHI:
+      out[0] = x == 0 ? 1 : std::sinh(x)/x;
+      return true;
+      case Functions::CHI:
+      out[0] = std::cosh(x)/x;
+      return true;
+      case Functions::CAS:
+      out[0] = std::cos(x)-std::sin(x);
+      return true;
+      case Functions::EXS:
+      out[0] = std::tan(x)/std::cos(x);
+      return true;
+      case Functions::EXC:
+      out[0] = -1/(std::sin(x)*std::tan(x));
+      return true;
+      case Functions::ARCEXS:
+      out[0] = 1/(std::fabs(x+1)*std::sqrt((x+1)*(x+1)-1));
+      return true;
+      case Functions::ARCEXCS:
+      out[0] = -1/(std::fabs(x+1)*std::sqrt((x+1)*(x+1)-1));
+      return true;
+      default:
+      return false;
+    }
+  }
+}
+
+/*
+  Numeric value and gradient of an AST in one pass over its arena, with respect to every VARIABLE leaf, for fitting
+  parameters where symbolic derivatives (see Differentiator) would be rebuilt for nothing. Values come from the same
+  kernels as Evaluator, so both agree exactly, and Kernels::partials gives the local derivative of every node.
+
+  Forward mode carries a dual number per node whose tangent holds one component per variable, so the gradient comes
+  out of the same sweep as the value. Reverse mode records the local partials on a tape laid out like AST::args, one
+  double per edge, and then sweeps the arena from the root down accumulating adjoints, which costs one multiply-add
+  per edge whatever the number of variables. In both modes a product with a zero factor is skipped, so branches that
+  can't affect the result (unreachable nodes, or the other operand of a multiplication by 0) don't spread their
+  singularities. Only at a singular point reached along several paths, like \sqrt{y-y}, can the modes disagree,
+  since each one meets the infinite partial at a different stage of the sum.
+
+  A derivative is UNDEFINED where the function isn't differentiable or has no rule, and DNE where it's infinite, as
+  in \sqrt{x} at 0. If the value is an error, every derivative holds that error. All buffers only grow, so once they
+  have reached the size of the largest expression seen, evaluating allocates nothing.
+*/
+class GradientEvaluator
+{
+  public:
+  const Gradient& evaluate(const AST& ast, const Bindings& bindings, const DifferentiationModes mode = DifferentiationModes::REVERSE)
+  {
+    findVariables(ast);
+    if (ast.size() == 0)
+    {
+      result.value = Kernels::error(AtomicTypes::DNE);
+    }
+    else if (mode == DifferentiationModes::FORWARD)
+    {
+      forward(ast, bindings);
+    }
+    else
+    {
+      reverse(ast, bindings);
+    }
+    for (Evaluation& derivative : result.derivatives)
+    {
+      derivative = result.value.isError() ? result.value : Kernels::real(derivative.value);
+    }
+    return result;
+  }
+
+  const Gradient& getResult() const
+  {
+    return result;
+  }
+
+  private:
+  Gradient result;
+  std::array<uint8_t, 128> slots{}; // Index of every variable in result.variables, by character; only read for variables found
+  std::vector<Evaluation> values; // Per node
+  std::vector<Evaluation> operands;
+  std::vector<double> tape; // Local partials, indexed like AST::args
+  std::vector<double> adjoints; // Per node, in reverse mode
+  std::vector<double> tangents; // Per node and variable, in forward mode
+
+  void findVariables(const AST& ast)
+  {
+    // A bit per character marks the variables already listed; the few found are sorted afterwards
+    uint64_t found[2] = {0, 0};
+    result.variables.clear();
+    for (const ASTNode& node : ast.nodes)
+    {
+      if (isVariable(node.leaf))
+      {
+        const unsigned name = (unsigned char)std::get<int>(node.leaf.value) & 0x7F;
+        const uint64_t bit = (uint64_t)1 << (name & 63);
+        if ((found[name >> 6] & bit) == 0)
+        {
+          found[name >> 6] |= bit;
+          result.variables.push_back((char)name);
+        }
+      }
+    }
+    std::sort(result.variables.begin(), result.variables.end());
+    for (size_t i = 0; i < result.variables.size(); i++)
+    {
+      slots[(size_t)result.variables[i]] = (uint8_t)i;
+    }
+    result.derivatives.assign(result.variables.size(), Evaluation{AtomicTypes::REAL, 0});
+  }
+
+  static bool isVariable(const ASTLeaf& leaf)
+  {
+    return std::holds_alternative<AtomicTypes>(leaf.type) && std::get<AtomicTypes>(leaf.type) == AtomicTypes::VARIABLE
+      && std::holds_alternative<int>(leaf.value);
+  }
+
+  uint8_t getSlot(const ASTLeaf& leaf) const
+  {
+    return slots[(unsigned char)std::get<int>(leaf.value) & 0x7F];
+  }
+
+  // Evaluates node id like Evaluator does, leaving its arguments in operands. Returns false if the node is a leaf
+  bool evaluateNode(const AST& ast, const NodeId id, const Bindings& bindings)
+  {
+    const ASTNode& node = ast.nodes[id];
+    if (!std::holds_alternative<Functions>(node.leaf.type))
+    {
+      values[id] = Evaluator::evaluateLeaf(node.leaf, bindings);
+      return false;
+    }
+    if (operands.size() < node.argCount)
+    {
+      operands.resize(node.argCount);
+    }
+    const NodeId* args = ast.args.data()+node.firstArg;
+    Evaluation propagated;
+    for (uint32_t i = 0; i < node.argCount; i++)
+    {
+      operands[i] = values[args[i]];
+      if (operands[i].isError() && !propagated.isError())
+      {
+        propagated = operands[i];
+      }
+    }
+    values[id] = propagated.isError() ? propagated : getKernel(std::get<Functions>(node.leaf.type))(operands.data(), node.argCount);
+    return true;
+  }
+
+  // Writes the local partials of function node id at tape[firstArg...], NaN if it has no rule
+  void recordPartials(const AST& ast, const NodeId id)
+  {
+    const ASTNode& node = ast.nodes[id];
+    double* partials = tape.data()+node.firstArg;
+    if (values[id].isError() || !Kernels::partials(std::get<Functions>(node.leaf.type), operands.data(), node.argCount, values[id].value, partials))
+    {
+      for (uint32_t i = 0; i < node.argCount; i++)
+      {
+        partials[i] = NAN;
+      }
+    }
+  }
+
+  void forward(const AST& ast, const Bindings& bindings)
+  {
+    const size_t width = result.variables.size();
+    if (values.size() < ast.size())
+    {
+      values.resize(ast.size());
+    }
+    if (tape.size() < ast.args.size())
+    {
+      tape.resize(ast.args.size());
+    }
+    if (tangents.size() < ast.size()*width)
+    {
+      tangents.resize(ast.size()*width);
+    }
+    for (NodeId id = 0; id < ast.size(); id++)
+    {
+      double* tangent = tangents.data()+(size_t)id*width;
+      std::fill(tangent, tangent+width, 0.0);
+      if (!evaluateNode(ast, id, bindings))
+      {
+        if (isVariable(ast.nodes[id].leaf))
+        {
+          tangent[getSlot(ast.nodes[id].leaf)] = 1;
+        }
+        continue;
+      }
+      recordPartials(ast, id);
+      const ASTNode& node = ast.nodes[id];
+      for (uint32_t i = 0; i < node.argCount; i++)
+      {
+        const double partial = tape[node.firstArg+i];
+        if (partial == 0)
+        {
+          continue;
+        }
+        const double* argument = tangents.data()+(size_t)ast.args[node.firstArg+i]*width;
+        for (size_t k = 0; k < width; k++)
+        {
+          // Arguments that don't depend on a variable contribute nothing, even through an infinite or missing partial
+          if (argument[k] != 0)
+          {
+            tangent[k] += partial*argument[k];
+          }
+        }
+      }
+    }
+    result.value = values[ast.root];
+    const double* tangent = tangents.data()+(size_t)ast.root*width;
+    for (size_t k = 0; k < width; k++)
+    {
+      result.derivatives[k].value = tangent[k];
+    }
+  }
+
+  void reverse(const AST& ast, const Bindings& bindings)
+  {
+    if (values.size() < ast.size())
+    {
+      values.resize(ast.size());
+    }
+    if (tape.size() < ast.args.size())
+    {
+      tape.resize(ast.args.size());
+    }
+    if (adjoints.size() < ast.size())
+    {
+      adjoints.resize(ast.size());
+    }
+    for (NodeId id = 0; id <= ast.root; id++)
+    {
+      if (evaluateNode(ast, id, bindings))
+      {
+        recordPartials(ast, id);
+      }
+      adjoints[id] = 0;
+    }
+    result.value = values[ast.root];
+    if (result.value.isError())
+    {
+      return;
+    }
+    adjoints[ast.root] = 1;
+    for (NodeId id = ast.root+1; id-- > 0;)
+    {
+      const double adjoint = adjoints[id];
+      if (adjoint == 0)
+      {
+        continue;
+      }
+      const ASTNode& node = ast.nodes[id];
+      if (node.argCount == 0)
+      {
+        if (isVariable(node.leaf))
+        {
+          result.derivatives[getSlot(node.leaf)].value += adjoint;
+        }
+        continue;
+      }
+      for (uint32_t i = 0; i < node.argCount; i++)
+      {
+        const double partial = tape[node.firstArg+i];
+        if (partial != 0)
+        {
+          adjoints[ast.args[node.firstArg+i]] += adjoint*partial;
+        }
+      }
+    }
+  }
+};
+
+// Convenience entry point backed by one evaluator per thread
+inline Gradient gradient(const AST& ast, const Bindings& bindings, const DifferentiationModes mode = DifferentiationModes::REVERSE)
+{
+  thread_local GradientEvaluator evaluator;
+  return evaluator.evaluate(ast, bindings, mode);
+}
+
+#endif
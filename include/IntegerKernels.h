@@ -0,0 +1,368 @@
+#ifndef INTEGERKERNELS_H
+#define INTEGERKERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "BigInteger.h"
+#include "Functions.h"
+#include "NumberTheory.h"
+
+/*
+  Exact integer results of the arithmetic operators and of the combinatorial functions that overflow doubles almost
+  immediately: FACTORIAL, PERM, CHOOSE, PRIMORIAL, FIB, PARTITION and the Stirling numbers. Large products are built
+  as balanced product trees, so their multiplications run on operands of similar size where Karatsuba pays off;
+  binomials multiply the prime powers given by Legendre's formula instead of dividing factorials.
+
+  Every function estimates the size of its result (and the cost of the recurrences, for PARTITION and the Stirling
+  numbers) before computing anything, and gives up with DNE past maxBits, so an innocent looking 10^9! can't hang
+  the caller.
+*/
+namespace IntegerKernels
+{
+  // About 79000 decimal digits, which still prints in milliseconds
+  constexpr size_t defaultMaxBits = 1 << 18;
+
+  // Largest argument of the recurrences, whose cost grows faster than their result
+  constexpr int64_t partitionLimit = 20000;
+  constexpr double stirlingLimbOperations = 2e8;
+
+  constexpr double log2e = 1.44269504088896340736;
+
+  // Product of factors[first, last), splitting in halves down to runs that fit small multiplications
+  inline BigInteger product(const uint32_t* factors, const size_t first, const size_t last)
+  {
+    if (last-first <= 16)
+    {
+      BigInteger result(1);
+      for (size_t i = first; i < last; i++)
+      {
+        result.multiplySmall(factors[i]);
+      }
+      return result;
+    }
+    const size_t middle = first+(last-first)/2;
+    return product(factors, first, middle)*product(factors, middle, last);
+  }
+
+  // Product of the integers in [low, high]
+  inline BigInteger productRange(const uint64_t low, const uint64_t high)
+  {
+    if (low > high)
+    {
+      return BigInteger(1);
+    }
+    if (high-low < 16)
+    {
+      BigInteger result(1);
+      for (uint64_t i = low; i <= high; i++)
+      {
+        result.multiplySmall((BigInteger::Limb)i);
+      }
+      return result;
+    }
+    const uint64_t middle = low+(high-low)/2;
+    return productRange(low, middle)*productRange(middle+1, high);
+  }
+
+  inline double log2Factorial(const double n)
+  {
+    return std::lgamma(n+1)*log2e;
+  }
+
+  inline AtomicTypes factorial(const int64_t n, BigInteger& result, const size_t maxBits)
+  {
+    if (n < 0) return AtomicTypes::UNDEFINED;
+    if (log2Factorial((double)n) > (double)maxBits) return AtomicTypes::DNE;
+    result = productRange(2, (uint64_t)n);
+    return AtomicTypes::INTEGER;
+  }
+
+  // n!/(n-k)!
+  inline AtomicTypes fallingFactorial(const int64_t n, const int64_t k, BigInteger& result, const size_t maxBits)
+  {
+    if (n < 0 || k < 0) return AtomicTypes::UNDEFINED;
+    if (k > n)
+    {
+      result = BigInteger(0);
+      return AtomicTypes::INTEGER;
+    }
+    if (log2Factorial((double)n)-log2Factorial((double)(n-k)) > (double)maxBits) return AtomicTypes::DNE;
+    result = productRange((uint64_t)(n-k+1), (uint64_t)n);
+    return AtomicTypes::INTEGER;
+  }
+
+  inline AtomicTypes binomial(const int64_t n, int64_t k, BigInteger& result, const size_t maxBits)
+  {
+    if (n < 0 || k < 0) return AtomicTypes::UNDEFINED;
+    if (k > n)
+    {
+      result = BigInteger(0);
+      return AtomicTypes::INTEGER;
+    }
+    k = std::min(k, n-k);
+    if (log2Factorial((double)n)-log2Factorial((double)k)-log2Factorial((double)(n-k)) > (double)maxBits) return AtomicTypes::DNE;
+    if (k < 64 || n >= (int64_t)PrimeSieve::tableLimit)
+    {
+      // Every prefix of the product is itself a binomial coefficient, so each division is exact
+      result = BigInteger(1);
+      for (int64_t i = 1; i <= k; i++)
+      {
+        result = result*BigInteger(n-k+i);
+        result.divideSmall((BigInteger::Limb)i);
+      }
+      return AtomicTypes::INTEGER;
+    }
+    // Legendre: the exponent of p is the number of carries when adding k and n-k in base p
+    PrimeSieve& sieve = PrimeSieve::shared();
+    sieve.ensure((uint64_t)n);
+    std::vector<uint32_t> factors;
+    for (uint32_t i = 0, primes = sieve.count((uint32_t)n); i < primes; i++)
+    {
+      const uint32_t prime = sieve.primes()[i];
+      uint64_t power = 1;
+      for (int64_t p = prime; p <= n; p *= prime)
+      {
+        if (n/p-k/p-(n-k)/p > 0)
+        {
+          power *= prime;
+        }
+        if (p > n/prime)
+        {
+          break;
+        }
+      }
+      if (power > 1)
+      {
+        factors.push_back((uint32_t)power);
+      }
+    }
+    result = product(factors.data(), 0, factors.size());
+    return AtomicTypes::INTEGER;
+  }
+
+  // Product of the primes up to n
+  inline AtomicTypes primorial(const int64_t n, BigInteger& result, const size_t maxBits)
+  {
+    if (n < 0) return AtomicTypes::UNDEFINED;
+    // The log of n# is Chebyshev's theta(n), below 1.01624*n
+    if ((double)n*1.01624*log2e > (double)maxBits || n >= (int64_t)PrimeSieve::tableLimit) return AtomicTypes::DNE;
+    PrimeSieve& sieve = PrimeSieve::shared();
+    sieve.ensure((uint64_t)n);
+    result = product(sieve.primes(), 0, sieve.count((uint32_t)n));
+    return AtomicTypes::INTEGER;
+  }
+
+  // Fast doubling: F(2m) = F(m)(2F(m+1)-F(m)) and F(2m+1) = F(m)^2+F(m+1)^2, with F(-n) = (-1)^(n+1)F(n)
+  inline AtomicTypes fibonacci(const int64_t n, BigInteger& result, const size_t maxBits)
+  {
+    const uint64_t m = n < 0 ? 0-(uint64_t)n : (uint64_t)n;
+    if ((double)m*0.69424191363 > (double)maxBits) return AtomicTypes::DNE;
+    BigInteger a(0), b(1);
+    for (int bit = 63; bit >= 0; bit--)
+    {
+      BigInteger twice = b;
+      twice += b;
+      twice -= a;
+      BigInteger even = a*twice;
+      BigInteger odd = a*a;
+      odd += b*b;
+      if ((m >> bit) & 1)
+      {
+        even += odd;
+        a = std::move(odd);
+        b = std::move(even);
+      }
+      else
+      {
+        a = std::move(even);
+        b = std::move(odd);
+      }
+    }
+    result = n < 0 && m%2 == 0 ? -a : std::move(a);
+    return AtomicTypes::INTEGER;
+  }
+
+  // Euler's pentagonal number recurrence p(n) = sum over k of (-1)^(k+1) (p(n-k(3k-1)/2)+p(n-k(3k+1)/2))
+  inline AtomicTypes partition(const int64_t n, BigInteger& result, const size_t maxBits)
+  {
+    if (n < 0) return AtomicTypes::UNDEFINED;
+    // p(n) < e^(pi*sqrt(2n/3))
+    if (n > partitionLimit || 2.56510*std::sqrt((double)n)*log2e > (double)maxBits) return AtomicTypes::DNE;
+    std::vector<BigInteger> values(n+1);
+    values[0] = BigInteger(1);
+    for (int64_t i = 1; i <= n; i++)
+    {
+      BigInteger sum;
+      for (int64_t k = 1;; k++)
+      {
+        const int64_t first = i-k*(3*k-1)/2;
+        if (first < 0)
+        {
+          break;
+        }
+        const int64_t second = i-k*(3*k+1)/2;
+        if (k%2 == 1)
+        {
+          sum += values[first];
+          if (second >= 0) sum += values[second];
+        }
+        else
+        {
+          sum -= values[first];
+          if (second >= 0) sum -= values[second];
+        }
+      }
+      values[i] = std::move(sum);
+    }
+    result = std::move(values[n]);
+    return AtomicTypes::INTEGER;
+  }
+
+  // Rows of the triangle S(i, j) = factor(i, j)*S(i-1, j)+S(i-1, j-1), where factor is i-1 for the unsigned Stirling
+  //   numbers of the first kind and j for the second kind
+  inline AtomicTypes stirling(const int64_t n, const int64_t k, const bool firstKind, const bool signedFirstKind, BigInteger& result,
+    const size_t maxBits)
+  {
+    if (n < 0 || k < 0) return AtomicTypes::UNDEFINED;
+    if (k > n || (n > 0 && k == 0))
+    {
+      result = BigInteger(n == 0 && k == 0 ? 1 : 0);
+      return AtomicTypes::INTEGER;
+    }
+    // Both kinds are bounded by the unsigned first kind, whose row sums to n!
+    const double bits = log2Factorial((double)n);
+    if (bits > (double)maxBits || (double)n*(double)k*(bits/32+1) > stirlingLimbOperations) return AtomicTypes::DNE;
+    std::vector<BigInteger> row(k+1);
+    row[0] = BigInteger(1);
+    for (int64_t i = 1; i <= n; i++)
+    {
+      // Right to left, so row[j-1] still holds the previous row
+      for (int64_t j = std::min(i, k); j >= 1; j--)
+      {
+        row[j].multiplySmall((BigInteger::Limb)(firstKind ? i-1 : j));
+        row[j] += row[j-1];
+      }
+      row[0] = BigInteger(0);
+    }
+    result = std::move(row[k]);
+    if (signedFirstKind && (n-k)%2 != 0)
+    {
+      result = -result;
+    }
+    return AtomicTypes::INTEGER;
+  }
+
+  /*
+    Exact value of function over integer arguments. Returns INTEGER with the value in result, UNDEFINED outside the
+    domain, UNDETERMINED for 0^0, DNE when the result would take more than maxBits, or NULLTYPE when function has no
+    exact integer form for these arguments (like a negative exponent), in which case callers fall back to doubles.
+  */
+  inline AtomicTypes evaluate(const Functions function, const BigInteger* args, const uint32_t argCount, BigInteger& result,
+    const size_t maxBits = defaultMaxBits)
+  {
+    switch (function)
+    {
+      case Functions::ADDITION:
+      result = BigInteger(0);
+      for (uint32_t i = 0; i < argCount; i++) result += args[i];
+      return AtomicTypes::INTEGER;
+      case Functions::SUBTRACTION:
+      if (argCount != 2) return AtomicTypes::NULLTYPE;
+      result = args[0]-args[1];
+      return AtomicTypes::INTEGER;
+      case Functions::UNSUBTRACTION:
+      if (argCount != 1) return AtomicTypes::NULLTYPE;
+      result = -args[0];
+      return AtomicTypes::INTEGER;
+      case Functions::MULTIPLICATION:
+      {
+        size_t bits = 0;
+        for (uint32_t i = 0; i < argCount; i++)
+        {
+          if (args[i].isZero())
+          {
+            result = BigInteger(0);
+            return AtomicTypes::INTEGER;
+          }
+          bits += args[i].bitLength();
+        }
+        if (bits > maxBits) return AtomicTypes::DNE;
+        result = BigInteger(1);
+        for (uint32_t i = 0; i < argCount; i++) result *= args[i];
+      }
+      return AtomicTypes::INTEGER;
+      case Functions::EXPONENTIATION:
+      {
+        int64_t exponent;
+        if (argCount != 2 || args[1].isNegative()) return AtomicTypes::NULLTYPE;
+        if (args[0].isZero() && args[1].isZero()) return AtomicTypes::UNDETERMINED;
+        const BigInteger one(1);
+        if (args[0].isZero() || args[0].abs() == one || args[1].isZero())
+        {
+          const bool odd = !args[1].isZero() && (args[1].limbs()[0] & 1);
+          result = args[1].isZero() ? one : args[0].isNegative() && !odd ? one : args[0];
+          return AtomicTypes::INTEGER;
+        }
+        if (!args[1].toInt64(exponent) || (double)exponent*(double)args[0].bitLength() > (double)maxBits) return AtomicTypes::DNE;
+        // Square and multiply from the most significant bit of the exponent
+        result = one;
+        for (int bit = 63; bit >= 0; bit--)
+        {
+          result *= result;
+          if (((uint64_t)exponent >> bit) & 1)
+          {
+            result *= args[0];
+          }
+        }
+      }
+      return AtomicTypes::INTEGER;
+      default:
+      break;
+    }
+
+    // The combinatorial functions take machine-sized arguments; anything larger is either negative or far too big
+    int64_t n = 0, k = 0;
+    if (argCount == 0 || argCount > 2)
+    {
+      return AtomicTypes::NULLTYPE;
+    }
+    for (uint32_t i = 0; i < argCount; i++)
+    {
+      int64_t& value = i == 0 ? n : k;
+      if (!args[i].toInt64(value))
+      {
+        return args[i].isNegative() ? AtomicTypes::UNDEFINED : AtomicTypes::DNE;
+      }
+    }
+    const bool binary = argCount == 2;
+    switch (function)
+    {
+      case Functions::FACTORIAL:
+      return binary ? AtomicTypes::NULLTYPE : factorial(n, result, maxBits);
+      case Functions::PRIMORIAL:
+      return binary ? AtomicTypes::NULLTYPE : primorial(n, result, maxBits);
+      case Functions::FIB:
+      return binary ? AtomicTypes::NULLTYPE : fibonacci(n, result, maxBits);
+      case Functions::PARTITION:
+      return binary ? AtomicTypes::NULLTYPE : partition(n, result, maxBits);
+      case Functions::PERM:
+      return binary ? fallingFactorial(n, k, result, maxBits) : AtomicTypes::NULLTYPE;
+      case Functions::CHOOSE:
+      return binary ? binomial(n, k, result, maxBits) : AtomicTypes::NULLTYPE;
+      case Functions::FKSTIRLING:
+      return binary ? stirling(n, k, true, true, result, maxBits) : AtomicTypes::NULLTYPE;
+      case Functions::UNGSTIRLING:
+      return binary ? stirling(n, k, true, false, result, maxBits) : AtomicTypes::NULLTYPE;
+      case Functions::SKSTIRLING:
+      return binary ? stirling(n, k, false, false, result, maxBits) : AtomicTypes::NULLTYPE;
+      default:
+      return AtomicTypes::NULLTYPE;
+    }
+  }
+}
+
+#endif
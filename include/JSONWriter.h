@@ -0,0 +1,255 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "AtomicTypes.h"
+#include "BigInteger.h"
+#include "Constants.h"
+#include "Decimal.h"
+#include "Diagnostics.h"
+#include "Functions.h"
+#include "LookupTables.h"
+#include "Trace.h"
+#include "Allocations.h"
+
+/*
+  Streaming JSON emitter for ASTs. Every node is written once, straight into the caller's buffer, so the cost is linear
+  in the size of the tree and nothing is built on the side: numbers go through std::to_chars and names are copied
+  from the lookup tables.
+
+  A function node is an object with one key, its name (the operator symbol, the command name or the interval type),
+  mapped to the array of its arguments in AST order, e.g. {"+":[1,{"sqrt":[3,"x"]}]}. Every FunctionTypes category
+  uses the same form, and the argument count tells optional parts apart: \sqrt[3]{x} is [3,"x"], and a big operator
+  holds [content], [subscript,content] or [subscript,superscript,content]. IDENTITY nodes are written as their
+  argument. Leaves are written as:
+    INTEGER      a number, with every digit of big integers
+    REAL         a number that always has a fraction or an exponent (2.0, 1e+300), or null if not finite. Decimal
+                 literals keep the digits they were written with, less trailing zeros
+    VARIABLE     a one-character string
+    CONSTANT     {"constant":"pi"}
+    PROPOSITION  true or false
+    errors       {"error":"undefined"}, {"error":"undetermined"} or {"error":"dne"}
+    NULLTYPE     null
+*/
+class JSONWriter
+{
+  public:
+  void write(const AST& ast, std::string& out)
+  {
+    write(ast, ast.root, out);
+  }
+
+  // Appends the JSON of the subtree at id
+  void write(const AST& ast, const NodeId id, std::string& out)
+  {
+    AllocationScope allocations(AllocationPhases::TOJSON);
+    stack.clear();
+    if (!open(ast, id, out))
+    {
+      return;
+    }
+    while (!stack.empty())
+    {
+      Frame& frame = stack.back();
+      const ASTArgs args = ast.getArgs(frame.node);
+      if (frame.next == args.size())
+      {
+        out += "]}";
+        stack.pop_back();
+        continue;
+      }
+      const NodeId child = args[frame.next];
+      if (frame.next++ != 0)
+      {
+        out += ',';
+      }
+      // May grow the stack, so frame is not used past this point
+      open(ast, child, out);
+    }
+  }
+
+  // A string holding text, with quotes, backslashes and everything outside printable ASCII escaped
+  static void appendString(const std::string_view text, std::string& out)
+  {
+    static constexpr char hex[] = "0123456789abcdef";
+    out += '"';
+    for (const char c : text)
+    {
+      const uint8_t byte = (uint8_t)c;
+      if (byte == '"' || byte == '\\')
+      {
+        out += '\\';
+        out += c;
+      }
+      else if (byte < 0x20 || byte >= 0x7f)
+      {
+        const char escape[] = {'\\', 'u', '0', '0', hex[byte >> 4], hex[byte & 15]};
+        out.append(escape, sizeof(escape));
+      }
+      else
+      {
+        out += c;
+      }
+    }
+    out += '"';
+  }
+
+  // An array with one {"error":name,"begin":offset,"end":offset} object per diagnostic, empty for well formed input
+  static void appendDiagnostics(const Diagnostics& diagnostics, std::string& out)
+  {
+    out += '[';
+    for (size_t i = 0; i < diagnostics.size(); i++)
+    {
+      if (i != 0)
+      {
+        out += ',';
+      }
+      out += "{\"error\":";
+      appendString(getName(diagnostics[i].type), out);
+      out += ",\"begin\":";
+      appendSize(diagnostics[i].span.begin, out);
+      out += ",\"end\":";
+      appendSize(diagnostics[i].span.end, out);
+      out += '}';
+    }
+    out += ']';
+  }
+
+  static void appendNumber(const double value, std::string& out)
+  {
+    if (!std::isfinite(value))
+    {
+      out += "null";
+      return;
+    }
+    // Shortest representation that reads back to the same double
+    char digits[32];
+    char* end = std::to_chars(digits, digits+sizeof(digits), value).ptr;
+    out.append(digits, end);
+    if (std::string_view(digits, end-digits).find_first_of(".e") == std::string_view::npos)
+    {
+      out += ".0";
+    }
+  }
+
+  static void appendLeaf(const ASTLeaf& leaf, std::string& out)
+  {
+    if (std::holds_alternative<AuxiliaryTypes>(leaf.type))
+    {
+      // Groupers and separators never reach a finished AST
+      out += "{\"auxiliary\":";
+      appendInteger((int)std::get<AuxiliaryTypes>(leaf.type), out);
+      out += '}';
+      return;
+    }
+    switch (std::get<AtomicTypes>(leaf.type))
+    {
+      case AtomicTypes::INTEGER:
+      if (std::holds_alternative<const BigInteger*>(leaf.value))
+      {
+        std::get<const BigInteger*>(leaf.value)->appendDecimal(out);
+        return;
+      }
+      if (std::holds_alternative<int64_t>(leaf.value))
+      {
+        appendInteger(std::get<int64_t>(leaf.value), out);
+        return;
+      }
+      appendInteger(std::get<int>(leaf.value), out);
+      return;
+      case AtomicTypes::REAL:
+      if (std::holds_alternative<Decimal>(leaf.value))
+      {
+        std::get<Decimal>(leaf.value).appendDecimal(out);
+        return;
+      }
+      appendNumber(std::get<double>(leaf.value), out);
+      return;
+      case AtomicTypes::VARIABLE:
+      {
+        const char name = (char)std::get<int>(leaf.value);
+        appendString(std::string_view(&name, 1), out);
+        return;
+      }
+      case AtomicTypes::CONSTANT:
+      out += "{\"constant\":";
+      if ((size_t)std::get<int>(leaf.value) < constantCount)
+      {
+        appendString(getName((Constants)std::get<int>(leaf.value)), out);
+      }
+      else
+      {
+        appendInteger(std::get<int>(leaf.value), out);
+      }
+      out += '}';
+      return;
+      case AtomicTypes::PROPOSITION:
+      out += std::get<int>(leaf.value) != 0 ? "true" : "false";
+      return;
+      case AtomicTypes::UNDEFINED:
+      out += "{\"error\":\"undefined\"}";
+      return;
+      case AtomicTypes::UNDETERMINED:
+      out += "{\"error\":\"undetermined\"}";
+      return;
+      case AtomicTypes::DNE:
+      out += "{\"error\":\"dne\"}";
+      return;
+      case AtomicTypes::NULLTYPE:
+      break;
+    }
+    out += "null";
+  }
+
+  private:
+  struct Frame
+  {
+    NodeId node;
+    uint32_t next; // Next argument to write
+  };
+
+  // Kept between calls, so writing trees no deeper than earlier ones allocates nothing
+  std::vector<Frame> stack;
+
+  static void appendInteger(const int64_t value, std::string& out)
+  {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits+sizeof(digits), value).ptr);
+  }
+
+  static void appendSize(const size_t value, std::string& out)
+  {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits+sizeof(digits), value).ptr);
+  }
+
+  // Writes a leaf whole, or the opening of a function node and pushes it. Returns whether a node was pushed
+  bool open(const AST& ast, NodeId id, std::string& out)
+  {
+    while (!ast.isLeaf(id) && ast.getType(id) == Functions::IDENTITY && ast.getArgs(id).size() == 1)
+    {
+      id = ast.getArgs(id)[0];
+    }
+    if (ast.isLeaf(id))
+    {
+      appendLeaf(ast.getLeaf(id), out);
+      return false;
+    }
+    const std::string_view name = getName(ast.getType(id));
+    TRACE(TraceCategories::SERIALIZE, TraceLevels::DEBUG, id, "function", name);
+    out += '{';
+    appendString(name, out);
+    out += ":[";
+    stack.push_back({id, 0});
+    return true;
+  }
+};
+
+#endif
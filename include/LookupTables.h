@@ -0,0 +1,504 @@
+#ifndef LOOKUPTABLES_H
+#define LOOKUPTABLES_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#include "AuxiliaryTypes.h"
+#include "Constants.h"
+#include "Functions.h"
+#include "FunctionTypes.h"
+
+/*
+  Every table in this file is built at compile time: there is no static initialization and no lookup allocates.
+
+  functionTable and constantTable are indexed by their enumeration itself, so going from a value to its name, type or
+  priority is a plain array access (this is what serialization uses). Going from a name to a function goes through commandTable, an open-addressing hash table
+  whose slots are filled by the compiler.
+*/
+
+struct FunctionProperties
+{
+  Functions function;
+  std::string_view name; // Command name (written after a '\'), operator symbol or, for internal functions, a descriptive name
+  FunctionTypes type;
+  uint8_t priority; // Shunting-yard priority; 255 means function application
+  bool command; // Whether the name can be written in the input as \name
+};
+
+constexpr size_t functionCount = (size_t)Functions::INDEX + 1;
+
+// Entries must follow the order of the Functions enumeration; a static_assert below enforces it
+constexpr FunctionProperties functionTable[] =
+{
+  // NULL OPERATOR
+  {Functions::NULLOPERATOR, "null", FunctionTypes::NULLFUNCTIONTYPE, 200, false},
+
+  // IGNORE OPERATOR
+  {Functions::IDENTITY, "identity", FunctionTypes::NULLFUNCTIONTYPE, 255, false},
+
+  // BASIC ARITHMETIC OPERATORS
+  {Functions::ADDITION, "+", FunctionTypes::BINARY, 20, false},
+  {Functions::SUBTRACTION, "-", FunctionTypes::BINARY, 20, false},
+  {Functions::UNSUBTRACTION, "-", FunctionTypes::UNARYLEFT, 70, false},
+  {Functions::MULTIPLICATION, "*", FunctionTypes::BINARY, 30, false},
+  {Functions::DIVISION, "/", FunctionTypes::BINARY, 30, false},
+  {Functions::EXPONENTIATION, "^", FunctionTypes::BINARY, 40, false},
+  {Functions::SQRT, "sqrt", FunctionTypes::OPTIONALARGUMENTS, 255, true},
+  {Functions::LOG, "log", FunctionTypes::OPTIONALARGUMENTS, 255, true},
+  {Functions::ABS, "abs", FunctionTypes::UNARYLEFT, 255, true},
+
+  // SPECIAL ARITHMETIC OPERATIONS
+  {Functions::TETRATION, "tetration", FunctionTypes::BINARY, 50, true},
+  {Functions::SSRT, "ssrt", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SROOT, "sroot", FunctionTypes::BINARY, 255, true},
+  {Functions::SLOG, "slog", FunctionTypes::BINARY, 255, true},
+
+  // RELATIONAL OPERATORS
+  {Functions::EQUALS, "=", FunctionTypes::BINARY, 10, false},
+  {Functions::GT, "gt", FunctionTypes::BINARY, 10, true},
+  {Functions::LT, "lt", FunctionTypes::BINARY, 10, true},
+  {Functions::GE, "ge", FunctionTypes::BINARY, 10, true},
+  {Functions::LE, "le", FunctionTypes::BINARY, 10, true},
+
+  // ELLIPTIC TRIG FUNCTIONS
+  {Functions::SIN, "sin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::COS, "cos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::TAN, "tan", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CSC, "csc", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SEC, "sec", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::COT, "cot", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCSIN, "arcsin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCOS, "arccos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCTAN, "arctan", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCSC, "arccsc", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCSEC, "arcsec", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCOT, "arccot", FunctionTypes::UNARYLEFT, 255, true},
+
+  // HYPERBOLIC TRIG FUNCTIONS
+  {Functions::SINH, "sinh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::COSH, "cosh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::TANH, "tanh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CSCH, "csch", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SECH, "sech", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::COTH, "coth", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCSINH, "arcsinh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCOSH, "arccosh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCTANH, "arctanh", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCSCH, "arccsch", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCSECH, "arcsech", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCOTH, "arccoth", FunctionTypes::UNARYLEFT, 255, true},
+
+  // SPHERICAL TRIG FUNCTIONS
+  {Functions::VER, "versin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CVS, "coversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::VCS, "vercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CVC, "covercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::HV, "haversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::HCV, "hacoversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::HVC, "havercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::HCC, "hacovercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SV, "semiversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SCV, "semicoversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCVER, "arcversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCVCS, "arcvercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCVS, "arccoversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCVC, "arccovercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCHV, "archaversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCHVC, "archavercos", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCHCV, "archacoversin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCHCC, "archacovercos", FunctionTypes::UNARYLEFT, 255, true},
+
+  // SPECIAL TRIG FUNCTIONS
+  {Functions::ATAN2, "atan2", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::SINC, "sinc", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::GD, "gd", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CRD, "crd", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ACRD, "acrd", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CCD, "ccd", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ACCD, "accd", FunctionTypes::UNARYLEFT, 255, true},
+
+  // ELLIPTIC INTEGRAL TRIG FUNCTIONS
+  {Functions::SI, "Si", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::si, "si", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CIN, "Cin", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CI, "Ci", FunctionTypes::UNARYLEFT, 255, true},
+
+  // HYPERBOLIC INTEGRAL TRIG FUNCTIONS
+  {Functions::SHI, "Shi", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CHI, "Chi", FunctionTypes::UNARYLEFT, 255, true},
+
+  // DEPRECATED TRIG FUNCTIONS
+  {Functions::CIS, "cis", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCCIS, "arccis", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::CAS, "cas", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::EXS, "exsec", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::EXC, "excsc", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCEXS, "arcexsec", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ARCEXCS, "arcexcsc", FunctionTypes::UNARYLEFT, 255, true},
+
+  // COMBINATORICS & NUMBER THEORY
+  {Functions::GCD, "gcd", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::LCM, "lcm", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::MODULO, "mod", FunctionTypes::BINARY, 30, true},
+  {Functions::FACTORIAL, "!", FunctionTypes::UNARYRIGHT, 110, false},
+  {Functions::PERM, "perm", FunctionTypes::BINARY, 255, true},
+  {Functions::CHOOSE, "choose", FunctionTypes::BINARY, 255, true},
+  {Functions::CEIL, "ceil", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::FLOOR, "floor", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::FRAC, "fracpart", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::ROUND, "round", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SIGN, "sgn", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::FIB, "fib", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::PHI, "totient", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::PI, "primepi", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::SIGMA, "sigma", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::PARTITION, "partition", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::MU, "mobius", FunctionTypes::UNARYLEFT, 255, true},
+
+  // SPECIAL NUMBER THEORY
+  {Functions::FKSTIRLING, "fkstirling", FunctionTypes::BINARY, 255, true},
+  {Functions::UNGSTIRLING, "ungstirling", FunctionTypes::BINARY, 255, true},
+  {Functions::SKSTIRLING, "skstirling", FunctionTypes::BINARY, 255, true},
+  {Functions::PRIMORIAL, "#", FunctionTypes::UNARYLEFT, 60, false},
+
+  // PIECEWISE SPECIAL FUNCTIONS
+  {Functions::DDELTA, "diracdelta", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::HEAVISIDE, "heaviside", FunctionTypes::UNARYLEFT, 255, true},
+
+  // PROPOSITIONAL LOGIC
+  {Functions::AND, "land", FunctionTypes::BINARY, 6, true},
+  {Functions::OR, "lor", FunctionTypes::BINARY, 5, true},
+  {Functions::NOT, "lnot", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::XOR, "xor", FunctionTypes::BINARY, 5, true},
+  {Functions::NAND, "nand", FunctionTypes::BINARY, 6, true},
+  {Functions::NOR, "nor", FunctionTypes::BINARY, 5, true},
+  {Functions::XNOR, "xnor", FunctionTypes::BINARY, 5, true},
+
+  // PROOFS AND METALOGIC
+  {Functions::IMPLIES, "implies", FunctionTypes::BINARY, 3, true},
+  {Functions::IF, "impliedby", FunctionTypes::BINARY, 3, true},
+  {Functions::IFF, "iff", FunctionTypes::BINARY, 2, true},
+
+  // SETS AND FIRST ORDER LOGIC
+  {Functions::SETBUILDER, "setbuilder", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::FORALL, "forall", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::EXISTS, "exists", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::IN, "in", FunctionTypes::BINARY, 10, true},
+  {Functions::NIN, "nin", FunctionTypes::BINARY, 10, true},
+  {Functions::CONTAINS, "ni", FunctionTypes::BINARY, 10, true},
+  {Functions::NCONTAINS, "nni", FunctionTypes::BINARY, 10, true},
+  {Functions::SUCHTHAT, "mid", FunctionTypes::BINARY, 4, true},
+  {Functions::UNION, "cup", FunctionTypes::BINARY, 25, true},
+  {Functions::INTERSECTION, "cap", FunctionTypes::BINARY, 25, true},
+  {Functions::CARTESIAN, "times", FunctionTypes::BINARY, 30, true},
+
+  // LARGE OPERATORS
+  {Functions::LIMIT, "lim", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::INT, "int", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::SUM, "sum", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::PROD, "prod", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGUNION, "bigcup", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGINTERSECTION, "bigcap", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGAND, "bigand", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGOR, "bigor", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGOPLUS, "bigoplus", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGOTIMES, "bigotimes", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::BIGWEDGE, "bigwedge", FunctionTypes::BIGOPERATOR, 255, true},
+  {Functions::COPROD, "coprod", FunctionTypes::BIGOPERATOR, 255, true},
+
+  // LINEAR ALGEBRA
+  {Functions::VEC, "vec", FunctionTypes::ARRAYARGUMENTS, 255, true},
+  {Functions::MATRIX, "matrix", FunctionTypes::MATRIXARGUMENTS, 255, true},
+  {Functions::INTERVAL, "interval", FunctionTypes::INTERVAL, 255, true},
+
+  // INTERVAL TYPES
+  {Functions::CCINTV, "cc interval", FunctionTypes::INTERVAL, 255, false},
+  {Functions::COINTV, "co interval", FunctionTypes::INTERVAL, 255, false},
+  {Functions::OCINTV, "oc interval", FunctionTypes::INTERVAL, 255, false},
+  {Functions::OOINTV, "oo interval", FunctionTypes::INTERVAL, 255, false},
+
+  // COMPLEX ANALISIS
+  {Functions::RE, "Re", FunctionTypes::UNARYLEFT, 255, true},
+  {Functions::IM, "Im", FunctionTypes::UNARYLEFT, 255, true},
+
+  // INDEXING
+  {Functions::INDEX, "index", FunctionTypes::BINARY, 255, false},
+};
+
+constexpr bool isFunctionTableOrdered()
+{
+  for (size_t i = 0; i < std::size(functionTable); i++)
+  {
+    if ((size_t)functionTable[i].function != i)
+    {
+      return false;
+    }
+  }
+  return std::size(functionTable) == functionCount;
+}
+static_assert(isFunctionTableOrdered(), "functionTable must have exactly one entry per Functions value, in declaration order");
+
+constexpr const FunctionProperties& getProperties(const Functions f)
+{
+  return functionTable[(size_t)f];
+}
+
+constexpr FunctionTypes getFunctionType(const Functions f)
+{
+  return functionTable[(size_t)f].type;
+}
+
+constexpr size_t getPriority(const Functions f)
+{
+  return functionTable[(size_t)f].priority;
+}
+
+// Infix commands (e.g. x \gt 1) take their left operand from the preceding tokens instead of being applied to the following ones
+constexpr bool isInfix(const Functions f)
+{
+  return functionTable[(size_t)f].type == FunctionTypes::BINARY && functionTable[(size_t)f].priority != 255;
+}
+
+struct ConstantProperties
+{
+  Constants constant;
+  std::string_view name;
+  bool command; // Whether the name can be written in the input as \name
+};
+
+constexpr size_t constantCount = (size_t)Constants::CATALAN + 1;
+
+constexpr ConstantProperties constantTable[] =
+{
+  // NULL CONSTANT
+
+  {Constants::NULLCONST, "null", false},
+
+  // ERROR CONSTANTS
+
+  {Constants::INDETERMINATE, "indeterminate", false},
+  {Constants::UNDEFINED, "undefined", false},
+  {Constants::UNKNOWN, "unknown", false},
+
+  // NUMERICAL CONSTANTS
+
+  {Constants::PI, "pi", true},
+  {Constants::e, "e", true},
+  {Constants::PHI, "phi", true},
+  {Constants::i, "i", true},
+  {Constants::EULER_MASCHERONI, "gamma", true},
+  {Constants::OMEGA, "omega", true},
+  {Constants::DOTTIE, "dottie", true},
+  {Constants::CATALAN, "catalan", true},
+};
+
+constexpr bool isConstantTableOrdered()
+{
+  for (size_t i = 0; i < std::size(constantTable); i++)
+  {
+    if ((size_t)constantTable[i].constant != i)
+    {
+      return false;
+    }
+  }
+  return std::size(constantTable) == constantCount;
+}
+static_assert(isConstantTableOrdered(), "constantTable must have exactly one entry per Constants value, in declaration order");
+
+// Serialization relies on every enumeration value having a name
+constexpr bool areAllNamed()
+{
+  for (const FunctionProperties& properties : functionTable)
+  {
+    if (properties.name.empty())
+    {
+      return false;
+    }
+  }
+  for (const ConstantProperties& properties : constantTable)
+  {
+    if (properties.name.empty())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(areAllNamed(), "Every Functions and Constants value needs a name in its table");
+
+constexpr std::string_view getName(const Functions f)
+{
+  return functionTable[(size_t)f].name;
+}
+
+constexpr std::string_view getName(const Constants c)
+{
+  return constantTable[(size_t)c].name;
+}
+
+// Open-addressing (linear probing) hash table from names to values. Size must be a power of two
+template <typename T, size_t Size>
+struct NameTable
+{
+  static_assert((Size & (Size-1)) == 0, "NameTable size must be a power of two");
+
+  std::array<std::string_view, Size> names {};
+  std::array<T, Size> values {};
+  size_t longestProbe = 0;
+
+  // FNV-1a
+  static constexpr uint32_t hash(const std::string_view name)
+  {
+    uint32_t h = 2166136261u;
+    for (const char c : name)
+    {
+      h = (h ^ (uint8_t)c) * 16777619u;
+    }
+    return h;
+  }
+
+  constexpr void insert(const std::string_view name, const T value)
+  {
+    size_t slot = hash(name) & (Size-1);
+    for (size_t probe = 0; probe < Size; probe++, slot = (slot+1) & (Size-1))
+    {
+      if (names[slot].empty())
+      {
+        names[slot] = name;
+        values[slot] = value;
+        longestProbe = probe > longestProbe ? probe : longestProbe;
+        return;
+      }
+      if (names[slot] == name)
+      {
+        // Evaluated at compile time, so this turns a duplicated name into a build error
+        throw std::logic_error("Duplicated name in a lookup table");
+      }
+    }
+    throw std::logic_error("Lookup table is full");
+  }
+
+  // Returns missing if the name isn't in the table
+  constexpr T find(const std::string_view name, const T missing) const
+  {
+    size_t slot = hash(name) & (Size-1);
+    for (size_t probe = 0; probe <= longestProbe; probe++, slot = (slot+1) & (Size-1))
+    {
+      if (names[slot] == name)
+      {
+        return values[slot];
+      }
+      if (names[slot].empty())
+      {
+        break;
+      }
+    }
+    return missing;
+  }
+};
+
+constexpr NameTable<Functions, 512> buildCommandTable()
+{
+  NameTable<Functions, 512> table {};
+  for (const FunctionProperties& properties : functionTable)
+  {
+    if (properties.command)
+    {
+      table.insert(properties.name, properties.function);
+    }
+  }
+  return table;
+}
+
+constexpr NameTable<Constants, 32> buildConstantNameTable()
+{
+  NameTable<Constants, 32> table {};
+  for (const ConstantProperties& properties : constantTable)
+  {
+    if (properties.command)
+    {
+      table.insert(properties.name, properties.constant);
+    }
+  }
+  return table;
+}
+
+inline constexpr NameTable<Functions, 512> commandTable = buildCommandTable();
+inline constexpr NameTable<Constants, 32> constantNameTable = buildConstantNameTable();
+static_assert(commandTable.longestProbe <= 4, "Command table has too many collisions, consider growing it");
+
+// Returns NULLOPERATOR if the name isn't a command
+constexpr Functions findCommand(const std::string_view name)
+{
+  return commandTable.find(name, Functions::NULLOPERATOR);
+}
+
+// Returns NULLCONST if the name isn't a constant
+constexpr Constants findConstant(const std::string_view name)
+{
+  return constantNameTable.find(name, Constants::NULLCONST);
+}
+
+struct OperatorSymbol
+{
+  char symbol;
+  Functions function;
+};
+
+// Single-character operators. The unary subtraction shares its symbol with the subtraction and is resolved by the tokenizer
+constexpr OperatorSymbol operatorSymbols[] =
+{
+  {'+', Functions::ADDITION},
+  {'-', Functions::SUBTRACTION},
+  {'*', Functions::MULTIPLICATION},
+  {'/', Functions::DIVISION},
+  {'^', Functions::EXPONENTIATION},
+  {'!', Functions::FACTORIAL},
+  {'#', Functions::PRIMORIAL},
+  {'=', Functions::EQUALS},
+};
+
+constexpr std::array<Functions, 256> buildOperatorTable()
+{
+  std::array<Functions, 256> table {};
+  for (const OperatorSymbol& entry : operatorSymbols)
+  {
+    table[(uint8_t)entry.symbol] = entry.function;
+  }
+  return table;
+}
+
+inline constexpr std::array<Functions, 256> operatorTable = buildOperatorTable();
+
+// Returns NULLOPERATOR if the character isn't an operator
+constexpr Functions getOperator(const char c)
+{
+  return operatorTable[(uint8_t)c];
+}
+
+// Returns NULLAUX if the character isn't a grouper
+constexpr AuxiliaryTypes getGrouper(const char c)
+{
+  switch (c)
+  {
+    case '{':
+    return AuxiliaryTypes::LEFTKEY;
+    case '}':
+    return AuxiliaryTypes::RIGHTKEY;
+    case '[':
+    return AuxiliaryTypes::LEFTBRACKET;
+    case ']':
+    return AuxiliaryTypes::RIGHTBRACKET;
+    case '(':
+    return AuxiliaryTypes::LEFTPARENTHESIS;
+    case ')':
+    return AuxiliaryTypes::RIGHTPARENTHESIS;
+  }
+  return AuxiliaryTypes::NULLAUX;
+}
+
+#endif
@@ -0,0 +1,557 @@
+#ifndef NUMBERTHEORY_H
+#define NUMBERTHEORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+/*
+  Smallest-prime-factor table over the odd numbers below limit(), shared by every evaluation and every thread. It
+  starts empty and grows by whole segments of segmentSize numbers, doubling its reach whenever a caller needs more and
+  stopping at tableLimit, so a batch that evaluates totients over a range sieves once instead of trial-dividing per
+  call. Each segment also keeps a bitmap of its primes and the count of primes before every word of it, which makes
+  prime counting inside the table one lookup and a popcount.
+
+  Segments are only written under the growth mutex, before limit() is advanced past them with a release store;
+  readers load limit() with acquire and never look past it, so lookups take no lock. The i-th prime is read from one
+  array sized for every prime below tableLimit up front and left uninitialized until the sieve reaches it.
+*/
+class PrimeSieve
+{
+  public:
+  static constexpr uint32_t segmentSize = 1 << 16;
+  static constexpr uint32_t tableLimit = 1 << 24;
+  static constexpr uint32_t maxPrimes = 1077871; // pi(2^24)
+
+  static PrimeSieve& shared()
+  {
+    static PrimeSieve sieve;
+    return sieve;
+  }
+
+  // Numbers below the result can be looked up
+  uint32_t limit() const
+  {
+    return covered.load(std::memory_order_acquire);
+  }
+
+  // Sieves until n can be looked up, or the whole table if n is past it, and returns the new limit
+  uint32_t ensure(const uint64_t n)
+  {
+    uint32_t current = limit();
+    if (n < current || current == tableLimit)
+    {
+      return current;
+    }
+    std::lock_guard<std::mutex> lock(growth);
+    const uint64_t target = std::min<uint64_t>(std::max<uint64_t>(n+1, 2*(uint64_t)covered.load(std::memory_order_relaxed)), tableLimit);
+    while ((current = covered.load(std::memory_order_relaxed)) < target)
+    {
+      sieveSegment(current/segmentSize);
+      covered.store(current+segmentSize, std::memory_order_release);
+    }
+    return current;
+  }
+
+  // For 2 <= n < limit(): n itself when it's prime
+  uint32_t smallestFactor(const uint32_t n) const
+  {
+    if (n%2 == 0)
+    {
+      return 2;
+    }
+    const uint16_t factor = segments[n/segmentSize]->factors[n%segmentSize/2];
+    return factor == 0 ? n : factor;
+  }
+
+  bool isPrime(const uint32_t n) const
+  {
+    return n == 2 || (n > 2 && smallestFactor(n) == n);
+  }
+
+  // Primes up to n, for n < limit()
+  uint32_t count(const uint32_t n) const
+  {
+    if (n < 2)
+    {
+      return 0;
+    }
+    const Segment& segment = *segments[n/segmentSize];
+    const uint32_t offset = n%segmentSize;
+    const uint32_t odd = (offset%128+1)/2; // Odd numbers of the word up to n
+    const uint64_t mask = odd == 64 ? ~0ull : (1ull << odd)-1;
+    return 1+segment.before[offset/128]+(uint32_t)std::bitset<64>(segment.primes[offset/128] & mask).count();
+  }
+
+  // The primes in increasing order, starting with primes()[0] = 2; only the first primeCount() are valid
+  const uint32_t* primes() const
+  {
+    return primeList.get();
+  }
+
+  uint32_t primeCount() const
+  {
+    return found.load(std::memory_order_acquire);
+  }
+
+  private:
+  struct Segment
+  {
+    uint16_t factors[segmentSize/2]; // Of the odd numbers; 0 for primes (and 1), as they can exceed 16 bits
+    uint64_t primes[segmentSize/128];
+    uint32_t before[segmentSize/128]; // Odd primes below the first number of each word
+  };
+
+  PrimeSieve() : primeList(new uint32_t[maxPrimes])
+  {
+  }
+
+  void sieveSegment(const uint32_t index)
+  {
+    std::unique_ptr<Segment> segment(new Segment());
+    const uint64_t low = (uint64_t)index*segmentSize, high = low+segmentSize;
+    uint32_t primeTotal = found.load(std::memory_order_relaxed);
+    if (index == 0)
+    {
+      // The first segment holds every prime below the square root of the table, so it sieves itself
+      primeList[primeTotal++] = 2;
+      for (uint64_t i = 3; i*i < high; i += 2)
+      {
+        if (segment->factors[i/2] != 0)
+        {
+          continue;
+        }
+        for (uint64_t multiple = i*i; multiple < high; multiple += 2*i)
+        {
+          if (segment->factors[multiple/2] == 0)
+          {
+            segment->factors[multiple/2] = (uint16_t)i;
+          }
+        }
+      }
+    }
+    else
+    {
+      for (uint32_t i = 1; i < primeTotal && (uint64_t)primeList[i]*primeList[i] < high; i++)
+      {
+        const uint64_t prime = primeList[i];
+        uint64_t multiple = std::max(prime*prime, (low+prime-1)/prime*prime);
+        if (multiple%2 == 0)
+        {
+          multiple += prime;
+        }
+        for (; multiple < high; multiple += 2*prime)
+        {
+          uint16_t& factor = segment->factors[(multiple-low)/2];
+          if (factor == 0)
+          {
+            factor = (uint16_t)prime;
+          }
+        }
+      }
+    }
+    uint32_t oddPrimes = primeTotal-1;
+    for (uint32_t i = 0; i < segmentSize/2; i++)
+    {
+      if (i%64 == 0)
+      {
+        segment->before[i/64] = oddPrimes;
+      }
+      if (segment->factors[i] == 0 && (index != 0 || i != 0))
+      {
+        segment->primes[i/64] |= 1ull << (i%64);
+        primeList[primeTotal++] = (uint32_t)(low+2*i+1);
+        oddPrimes++;
+      }
+    }
+    segments[index] = std::move(segment);
+    found.store(primeTotal, std::memory_order_release);
+  }
+
+  std::unique_ptr<Segment> segments[tableLimit/segmentSize];
+  std::unique_ptr<uint32_t[]> primeList;
+  std::atomic<uint32_t> covered{0};
+  std::atomic<uint32_t> found{0};
+  std::mutex growth;
+};
+
+/*
+  The multiplicative functions (PHI, SIGMA, MU) factor their argument through the shared PrimeSieve: numbers inside
+  the table are divided down their smallest prime factors, larger ones lose their small factors by trial division and
+  split the rest with Miller-Rabin and Pollard's rho. Calls inside the table take under a hundred nanoseconds, and the
+  worst case below 2^53, a product of two primes near 2^26, a few hundred microseconds.
+
+  PI counts primes with one table lookup below tableLimit and with Lehmer's formula above it, which needs the primes
+  up to the square root and the count of primes below x/p for the primes p up to the square root, found again in the
+  table or recursively. Legendre's phi(x, a) is cut short by the table of phi(x, 6) over one period of 2*3*5*7*11*13,
+  and by phi(x, a) = pi(x)-a+1 once the a-th prime passes the square root of x.
+*/
+namespace NumberTheory
+{
+  // Lehmer's method takes under a second here; larger arguments give DNE
+  constexpr uint64_t primeCountingLimit = 1ull << 40;
+
+  struct PrimePower
+  {
+    uint64_t prime;
+    uint32_t exponent;
+  };
+
+  // Numbers below 2^64 have at most 15 distinct prime factors
+  struct Factorization
+  {
+    PrimePower factors[16];
+    uint32_t count = 0;
+
+    void add(const uint64_t prime, const uint32_t exponent)
+    {
+      for (uint32_t i = 0; i < count; i++)
+      {
+        if (factors[i].prime == prime)
+        {
+          factors[i].exponent += exponent;
+          return;
+        }
+      }
+      factors[count++] = {prime, exponent};
+    }
+  };
+
+  inline uint64_t multiplyModulo(const uint64_t a, const uint64_t b, const uint64_t modulus)
+  {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)((unsigned __int128)a*b%modulus);
+#else
+    uint64_t result = 0, addend = a%modulus;
+    for (uint64_t factor = b; factor != 0; factor >>= 1)
+    {
+      if (factor & 1)
+      {
+        result = result >= modulus-addend ? result-(modulus-addend) : result+addend;
+      }
+      addend = addend >= modulus-addend ? addend-(modulus-addend) : addend+addend;
+    }
+    return result;
+#endif
+  }
+
+  inline uint64_t powerModulo(uint64_t base, uint64_t exponent, const uint64_t modulus)
+  {
+    uint64_t result = 1;
+    for (base %= modulus; exponent != 0; exponent >>= 1)
+    {
+      if (exponent & 1)
+      {
+        result = multiplyModulo(result, base, modulus);
+      }
+      base = multiplyModulo(base, base, modulus);
+    }
+    return result;
+  }
+
+  // Miller-Rabin with a set of bases that is deterministic below 2^64
+  inline bool isPrime(const uint64_t n)
+  {
+    PrimeSieve& sieve = PrimeSieve::shared();
+    if (n < sieve.limit())
+    {
+      return sieve.isPrime((uint32_t)n);
+    }
+    if (n%2 == 0)
+    {
+      return false;
+    }
+    uint64_t odd = n-1;
+    uint32_t twos = 0;
+    for (; odd%2 == 0; odd /= 2)
+    {
+      twos++;
+    }
+    for (const uint64_t base : {2ull, 325ull, 9375ull, 28178ull, 450775ull, 9780504ull, 1795265022ull})
+    {
+      uint64_t x = powerModulo(base, odd, n);
+      if (x == 0 || x == 1 || x == n-1)
+      {
+        continue;
+      }
+      bool composite = true;
+      for (uint32_t i = 1; i < twos && composite; i++)
+      {
+        x = multiplyModulo(x, x, n);
+        composite = x != n-1;
+      }
+      if (composite)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // A nontrivial factor of the odd composite n, by Brent's variant of Pollard's rho
+  inline uint64_t findFactor(const uint64_t n)
+  {
+    for (uint64_t increment = 1;; increment++)
+    {
+      uint64_t x = 2, y = 2, product = 1, divisor = 1;
+      const auto step = [&](const uint64_t value) { return (multiplyModulo(value, value, n)+increment)%n; };
+      for (uint64_t length = 1; divisor == 1; length *= 2)
+      {
+        x = y;
+        for (uint64_t i = 0; i < length; i++)
+        {
+          y = step(y);
+        }
+        for (uint64_t i = 0; i < length && divisor == 1; i += 64)
+        {
+          const uint64_t saved = y;
+          for (uint64_t j = 0; j < 64 && j < length-i; j++)
+          {
+            y = step(y);
+            product = multiplyModulo(product, x > y ? x-y : y-x, n);
+          }
+          divisor = std::gcd(product, n);
+          if (divisor == n)
+          {
+            // The batch overshot: retrace it one step at a time
+            y = saved;
+            do
+            {
+              y = step(y);
+              divisor = std::gcd(x > y ? x-y : y-x, n);
+            }
+            while (divisor == 1);
+          }
+        }
+      }
+      if (divisor != n)
+      {
+        return divisor;
+      }
+    }
+  }
+
+  inline void factorLarge(const uint64_t n, const uint32_t exponent, Factorization& result)
+  {
+    PrimeSieve& sieve = PrimeSieve::shared();
+    if (n < sieve.limit())
+    {
+      for (uint32_t m = (uint32_t)n; m > 1;)
+      {
+        const uint32_t prime = sieve.smallestFactor(m);
+        uint32_t times = 0;
+        for (; m%prime == 0; m /= prime)
+        {
+          times++;
+        }
+        result.add(prime, times*exponent);
+      }
+      return;
+    }
+    if (isPrime(n))
+    {
+      result.add(n, exponent);
+      return;
+    }
+    uint64_t factor = findFactor(n), rest = n/factor;
+    // Equal halves (n = p^2, common for squarefree tests) are factored once
+    if (factor == rest)
+    {
+      factorLarge(factor, 2*exponent, result);
+      return;
+    }
+    factorLarge(factor, exponent, result);
+    factorLarge(rest, exponent, result);
+  }
+
+  // Prime factors of n >= 1 in increasing order
+  inline void factorize(uint64_t n, Factorization& result)
+  {
+    result.count = 0;
+    PrimeSieve& sieve = PrimeSieve::shared();
+    // Past the table the sieve is only needed for its first primes, so one large argument doesn't sieve all of it
+    sieve.ensure(n < PrimeSieve::tableLimit ? n : 0);
+    if (n >= sieve.limit())
+    {
+      // Small factors are cheaper to divide out than to find with rho
+      const uint32_t* primes = sieve.primes();
+      for (uint32_t i = 0; i < 168 && (uint64_t)primes[i]*primes[i] <= n; i++)
+      {
+        uint32_t times = 0;
+        for (; n%primes[i] == 0; n /= primes[i])
+        {
+          times++;
+        }
+        if (times != 0)
+        {
+          result.add(primes[i], times);
+        }
+      }
+    }
+    if (n > 1)
+    {
+      factorLarge(n, 1, result);
+    }
+    std::sort(result.factors, result.factors+result.count, [](const PrimePower& a, const PrimePower& b) { return a.prime < b.prime; });
+  }
+
+  inline uint64_t totient(const uint64_t n)
+  {
+    Factorization factorization;
+    factorize(n, factorization);
+    uint64_t result = n;
+    for (uint32_t i = 0; i < factorization.count; i++)
+    {
+      result = result/factorization.factors[i].prime*(factorization.factors[i].prime-1);
+    }
+    return result;
+  }
+
+  // Sum of the divisors of n, which stays below 2^64 for any n below 2^60
+  inline uint64_t divisorSum(const uint64_t n)
+  {
+    Factorization factorization;
+    factorize(n, factorization);
+    uint64_t result = 1;
+    for (uint32_t i = 0; i < factorization.count; i++)
+    {
+      const PrimePower& factor = factorization.factors[i];
+      uint64_t sum = 1, power = 1;
+      for (uint32_t e = 0; e < factor.exponent; e++)
+      {
+        power *= factor.prime;
+        sum += power;
+      }
+      result *= sum;
+    }
+    return result;
+  }
+
+  inline int mobius(const uint64_t n)
+  {
+    Factorization factorization;
+    factorize(n, factorization);
+    for (uint32_t i = 0; i < factorization.count; i++)
+    {
+      if (factorization.factors[i].exponent > 1)
+      {
+        return 0;
+      }
+    }
+    return factorization.count%2 == 0 ? 1 : -1;
+  }
+
+  // Integer roots, exact despite the rounding of std::pow
+  inline uint64_t integerRoot(const uint64_t x, const int degree)
+  {
+    uint64_t root = (uint64_t)std::pow((double)x, 1.0/degree);
+    const auto exceeds = [&](const uint64_t r)
+    {
+      uint64_t power = 1;
+      for (int i = 0; i < degree; i++)
+      {
+        if (power > x/r) return true;
+        power *= r;
+      }
+      return power > x;
+    };
+    while (root > 0 && exceeds(root))
+    {
+      root--;
+    }
+    while (!exceeds(root+1))
+    {
+      root++;
+    }
+    return root;
+  }
+
+  // phi(m, 6) for m in one period of 2*3*5*7*11*13
+  inline const std::vector<uint16_t>& phiPeriod()
+  {
+    static const std::vector<uint16_t> table = []
+    {
+      std::vector<uint16_t> result(30030);
+      uint16_t count = 0;
+      for (uint32_t m = 0; m < result.size(); m++)
+      {
+        if (m%2 != 0 && m%3 != 0 && m%5 != 0 && m%7 != 0 && m%11 != 0 && m%13 != 0)
+        {
+          count++;
+        }
+        result[m] = count;
+      }
+      return result;
+    }();
+    return table;
+  }
+
+  // Legendre's phi(x, a): the integers in [1, x] divisible by none of the first a primes
+  inline uint64_t legendrePhi(const uint64_t x, const uint32_t a)
+  {
+    const PrimeSieve& sieve = PrimeSieve::shared();
+    const uint32_t* primes = sieve.primes();
+    if (a == 0)
+    {
+      return x;
+    }
+    if (a == 6)
+    {
+      return x/30030*5760+phiPeriod()[x%30030];
+    }
+    if (x < primes[a-1])
+    {
+      return x == 0 ? 0 : 1;
+    }
+    // Past the square root only the primes themselves (and 1) are left
+    if (a > 6 && x < sieve.limit() && (uint64_t)primes[a]*primes[a] > x)
+    {
+      return sieve.count((uint32_t)x)-a+1;
+    }
+    return legendrePhi(x, a-1)-legendrePhi(x/primes[a-1], a-1);
+  }
+
+  // Lehmer: pi(x) = phi(x, a)+(b+a-2)(b-a+1)/2-sum of pi(x/p_i) for a < i <= b, where a = pi(x^(1/4)) and
+  //   b = pi(x^(1/2)), and the primes i up to c = pi(x^(1/3)) also subtract the pi(x/(p_i p_j))-(j-1) for i <= j <= pi(sqrt(x/p_i))
+  inline uint64_t primeCount(const uint64_t x)
+  {
+    PrimeSieve& sieve = PrimeSieve::shared();
+    if (x < sieve.limit())
+    {
+      return sieve.count((uint32_t)x);
+    }
+    // Counts below x^(2/3) come from the table for as long as it reaches
+    sieve.ensure(std::max(integerRoot(x, 2), integerRoot(x, 3)*integerRoot(x, 3)));
+    if (x < sieve.limit())
+    {
+      return sieve.count((uint32_t)x);
+    }
+    const uint32_t* primes = sieve.primes();
+    const uint64_t a = primeCount(integerRoot(x, 4));
+    const uint64_t b = primeCount(integerRoot(x, 2));
+    const uint64_t c = primeCount(integerRoot(x, 3));
+    uint64_t result = legendrePhi(x, (uint32_t)a)+(b+a-2)*(b-a+1)/2;
+    for (uint64_t i = a+1; i <= b; i++)
+    {
+      const uint64_t w = x/primes[i-1];
+      result -= primeCount(w);
+      if (i <= c)
+      {
+        const uint64_t limit = primeCount(integerRoot(w, 2));
+        for (uint64_t j = i; j <= limit; j++)
+        {
+          result -= primeCount(w/primes[j-1])-(j-1);
+        }
+      }
+    }
+    return result;
+  }
+}
+
+#endif
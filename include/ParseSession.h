@@ -0,0 +1,833 @@
+#ifndef PARSESESSION_H
+#define PARSESESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "ASTInterner.h"
+#include "AtomicTypes.h"
+#include "Diagnostics.h"
+#include "Functions.h"
+#include "FunctionTypes.h"
+#include "LookupTables.h"
+#include "Parser.h"
+#include "Tokenizer.h"
+
+// Work done by the last ParseSession::edit or reset
+struct EditStatistics
+{
+  size_t reparsedBytes = 0; // Text tokenized again, over every argument tried before one parsed on its own
+  size_t reparsedTokens = 0;
+  size_t reusedArguments = 0; // Untouched arguments handed to the tokenizer as a single token
+  size_t rebuiltNodes = 0; // Nodes above the re-parsed argument rebuilt with one argument replaced
+  bool fullParse = false;
+};
+
+/*
+  Keeps a formula and its AST up to date through edits, re-parsing only the innermost argument around each one: the
+  text between an opening grouper or a separator and the next separator or closing grouper, or a term of such a text,
+  the text between two of the + and - that join its sum. Such an argument tokenizes, goes through shunting-yard and
+  builds the same way on its own as inside the whole text, as long as it builds exactly one subtree and leaves no
+  construct waiting across its ends (Tokenizer::isSettled, Tokenizer::getHeldOperators). Untouched arguments nested in
+  it are not read again: the tokenizer hands each one out as a placeholder token that stands for its subtree.
+
+  Nodes go through an ASTInterner into an arena that lives as long as the session, so everything the edit left intact
+  keeps its node id. While an argument is built, every node that ends up above one of its nested arguments gets an
+  anchor recording where it sits in its parent, and the new subtree replaces the old one by rebuilding the nodes on
+  that path with one argument changed. An edit whose argument no longer parses on its own (a separator or an unbalanced
+  grouper was typed, a construct now spans past its ends) moves to the enclosing argument, up to the whole text; once
+  the arguments tried have read as many bytes as the text holds, it is parsed in full instead, so an edit that breaks a
+  deeply nested argument costs no more than two full parses. Text that is malformed as a whole is parsed in full until
+  it is well formed again.
+
+  Each argument stores its start as an offset from its parent's, so an edit only moves the arguments on its path and
+  their children after it. The arena keeps the nodes edits replaced, and is rebuilt with a full parse once it holds
+  four times the nodes of the last one, so an edit costs the size of its argument (less its untouched nested
+  arguments), the children it moves and the path above it. That path is as deep as the AST: a sum of n terms is a
+  chain of n-1 binary nodes, so an edit in its first term still rebuilds all of them.
+*/
+class ParseSession
+{
+  public:
+  ParseSession() {}
+  // The interner points into the session's own arena
+  ParseSession(const ParseSession&) = delete;
+  ParseSession& operator=(const ParseSession&) = delete;
+
+  // Starts over with a new text, parsed in full
+  const AST& reset(const std::string_view newText)
+  {
+    text.assign(newText.data(), newText.size());
+    statistics = EditStatistics();
+    parseAll();
+    return ast;
+  }
+
+  // Replaces removed bytes at offset with inserted and brings the AST up to date. The range is clamped to the text
+  const AST& edit(size_t offset, size_t removed, const std::string_view inserted)
+  {
+    offset = std::min(offset, text.size());
+    removed = std::min(removed, text.size()-offset);
+    text.replace(offset, removed, inserted.data(), inserted.size());
+    statistics = EditStatistics();
+    if (!incremental)
+    {
+      parseAll();
+      return ast;
+    }
+    innermost(offset, removed);
+    shift(offset, removed, inserted.size());
+    size_t level = path.size()-1;
+    while (arguments[path[level]].anchor == none || !reparse(level, offset, offset+inserted.size()))
+    {
+      // Every enclosing argument reads the text of the ones below it again, so once the failed attempts have read as
+      //   much as the whole text a full parse is no dearer than going on, and deep nesting stays linear
+      if (level == 0 || statistics.reparsedBytes >= text.size())
+      {
+        parseAll();
+        return ast;
+      }
+      level--;
+    }
+    if (ast.size() > 4*liveNodes+1024)
+    {
+      parseAll();
+    }
+    return ast;
+  }
+
+  // Valid until the next edit or reset. The arena also holds nodes that earlier edits replaced
+  const AST& getAST() const
+  {
+    return ast;
+  }
+
+  const std::string& getText() const
+  {
+    return text;
+  }
+
+  // Errors of the text, as Parser::Parse reports them. They come from the last full parse: edits only re-parse part of
+  //   the text when it is well formed, so those of malformed text are always current
+  const Diagnostics& getDiagnostics() const
+  {
+    return diagnostics;
+  }
+
+  // Whether the next edit may re-parse less than the whole text
+  bool isIncremental() const
+  {
+    return incremental;
+  }
+
+  const EditStatistics& getStatistics() const
+  {
+    return statistics;
+  }
+
+  private:
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // A node on the way up from some argument's subtree to the root
+  struct Anchor
+  {
+    NodeId node;
+    uint32_t parent = none; // Anchor of the node holding this one, none at the root
+    uint32_t position = 0; // Among the arguments of that node
+  };
+
+  // The text between an opening grouper or a separator and the next separator or closing grouper, or a term of one:
+  //   the text between two of the + and - that join its sum. Argument 0 is the whole text
+  struct Argument
+  {
+    uint32_t begin; // From the start of the parent, so an edit only moves the arguments it is in and those after it
+    uint32_t length;
+    uint32_t parent; // Argument holding the group or sum this one belongs to
+    uint32_t firstChild = 0; // Arguments directly inside this one, in text order, in children
+    uint32_t childCount = 0;
+    uint32_t anchor = none; // Anchor of its subtree, none if its RPN does not build exactly one subtree
+    bool term = false;
+  };
+
+  // Stack entry while building: a subtree and its anchor, if it holds an argument
+  struct Entry
+  {
+    NodeId node;
+    uint32_t anchor;
+  };
+
+  // An argument being built, its slot in built (none for the one being re-parsed), the lowest the stack went since it
+  //   opened, and once a + or - split it, the slot of the term being read
+  struct OpenArgument
+  {
+    uint32_t argument;
+    uint32_t slot;
+    uint32_t base;
+    uint32_t low;
+    uint32_t term = none;
+    bool mixed = false; // Joined something at a lower priority than its sum, whose terms are then not its operands
+  };
+
+  // An untouched argument handed to the tokenizer as one token, and where it lies in the text
+  struct Placeholder
+  {
+    uint32_t argument;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // Placeholder state to restore if the argument using it fails to build
+  struct Reuse
+  {
+    uint32_t argument;
+    uint32_t parent;
+    uint32_t anchorParent;
+    uint32_t anchorPosition;
+  };
+
+  std::string text;
+  Parser parser;
+  AST ast;
+  ASTInterner interner;
+  size_t liveNodes = 0; // Arena size after the last full parse
+  bool incremental = false;
+  Diagnostics diagnostics;
+  EditStatistics statistics;
+
+  std::vector<Argument> arguments;
+  std::vector<uint32_t> children;
+  std::vector<Anchor> anchors;
+  std::vector<uint32_t> path; // Arguments from the whole text down to the innermost one holding the last edit
+  std::vector<uint32_t> starts; // Where each of them starts in the text
+
+  // Buffers of build, kept between edits
+  std::vector<uint32_t> boundaries;
+  std::vector<uint32_t> marks; // Grouper and separator positions in the text being built
+  std::vector<Entry> entries;
+  std::vector<OpenArgument> open;
+  std::vector<NodeId> operands;
+  std::vector<uint32_t> built; // Arguments met while building. Siblings are in text order
+  std::vector<TextRange> spans; // Their text while building
+  uint32_t buildStart = 0;
+  std::vector<Placeholder> pending; // Arguments still to search for placeholders, with their start in begin
+  std::vector<Placeholder> reused; // Arguments standing in as placeholders, in text order
+  std::vector<TextRange> placeholders;
+  std::vector<Reuse> saved;
+
+  void parseAll()
+  {
+    statistics.fullParse = true;
+    ast.clear();
+    interner.reset(ast);
+    arguments.clear();
+    children.clear();
+    anchors.clear();
+    reused.clear();
+    placeholders.clear();
+    arguments.push_back({0, (uint32_t)text.size(), none});
+    incremental = build(0, 0, true);
+    if (incremental)
+    {
+      arguments[0].anchor = anchorTop();
+      rebase(0, 0);
+      link(0, 1);
+    }
+    else
+    {
+      arguments.resize(1);
+      anchors.clear();
+    }
+    setRoot(entries.back().node);
+    liveNodes = ast.size();
+  }
+
+  // Fills path with the arguments whose span holds the whole edited range, going down from the whole text
+  void innermost(const size_t offset, const size_t removed)
+  {
+    path.clear();
+    starts.clear();
+    uint32_t current = 0;
+    size_t start = 0;
+    while (true)
+    {
+      path.push_back(current);
+      starts.push_back((uint32_t)start);
+      const Argument& argument = arguments[current];
+      const uint32_t* first = children.data()+argument.firstChild;
+      const uint32_t* last = first+argument.childCount;
+      // Last child starting at or before offset
+      const uint32_t* child = std::upper_bound(first, last, offset-start, [&](const size_t value, const uint32_t id)
+      {
+        return value < arguments[id].begin;
+      });
+      if (child == first || offset+removed-start > arguments[child[-1]].begin+arguments[child[-1]].length)
+      {
+        return;
+      }
+      current = child[-1];
+      start += arguments[current].begin;
+    }
+  }
+
+  // Moves spans from the text before the edit to the text after it: the arguments on the path take the length of the
+  //   edit, and their children after it move. Children of the innermost one that overlap the removed range are about
+  //   to be built again: they collapse onto its start and lose their own children, whose offsets no longer hold
+  void shift(const size_t offset, const size_t removed, const size_t inserted)
+  {
+    const size_t end = offset+removed;
+    for (size_t level = 0; level < path.size(); level++)
+    {
+      Argument& argument = arguments[path[level]];
+      argument.length = (uint32_t)(argument.length-removed+inserted);
+      const size_t start = starts[level];
+      for (uint32_t i = argument.childCount; i-- > 0;)
+      {
+        const uint32_t id = children[argument.firstChild+i];
+        Argument& child = arguments[id];
+        size_t childBegin = start+child.begin;
+        if (childBegin > offset && childBegin >= end)
+        {
+          // Wholly after the edit: only moves
+          child.begin = (uint32_t)(child.begin-removed+inserted);
+          continue;
+        }
+        size_t childEnd = childBegin+child.length;
+        if (childEnd <= offset || (level+1 < path.size() && id == path[level+1]))
+        {
+          break;
+        }
+        if (childBegin < end && childEnd > offset)
+        {
+          child.childCount = 0;
+        }
+        // A child starting at offset holds the edit and keeps its start
+        if (childBegin > offset)
+        {
+          childBegin = childBegin >= end ? childBegin-removed+inserted : offset;
+        }
+        childEnd = childEnd >= end ? childEnd-removed+inserted : offset;
+        child.begin = (uint32_t)(childBegin-start);
+        child.length = (uint32_t)(childEnd-childBegin);
+      }
+    }
+  }
+
+  // Builds the argument at level of the path again, [editBegin, editEnd] being the edited text, and puts its subtree in
+  //   place of the old one. Returns false, leaving the session as it was, if it does not parse on its own
+  bool reparse(const size_t level, const size_t editBegin, const size_t editEnd)
+  {
+    const uint32_t unit = path[level];
+    const uint32_t previous = arguments[unit].anchor;
+    const Anchor place = anchors[previous];
+    const size_t firstArgument = arguments.size();
+    const size_t firstAnchor = anchors.size();
+    findPlaceholders(level, editBegin, editEnd);
+    if (!build(unit, starts[level], false))
+    {
+      for (const Reuse& reuse : saved)
+      {
+        arguments[reuse.argument].parent = reuse.parent;
+        Anchor& anchor = anchors[arguments[reuse.argument].anchor];
+        anchor.parent = reuse.anchorParent;
+        anchor.position = reuse.anchorPosition;
+      }
+      arguments.resize(firstArgument);
+      anchors.resize(firstAnchor);
+      return false;
+    }
+    const uint32_t current = anchorTop();
+    anchors[current].parent = place.parent;
+    anchors[current].position = place.position;
+    // Enclosing arguments made of nothing but this one share its anchor
+    for (uint32_t argument = unit; argument != none && arguments[argument].anchor == previous; argument = arguments[argument].parent)
+    {
+      arguments[argument].anchor = current;
+    }
+    rebase(unit, starts[level]);
+    link(unit, firstArgument);
+    // Rebuilds the path up to the root, stopping where a node comes out unchanged
+    for (uint32_t child = current, parent = place.parent; parent != none; child = parent, parent = anchors[parent].parent)
+    {
+      const NodeId node = anchors[parent].node;
+      const ASTArgs args = ast.getArgs(node);
+      if (args[anchors[child].position] == anchors[child].node)
+      {
+        break;
+      }
+      operands.assign(args.begin(), args.end());
+      operands[anchors[child].position] = anchors[child].node;
+      anchors[parent].node = interner.addNode(ast.getType(node), operands.data(), (uint32_t)operands.size());
+      statistics.rebuiltNodes++;
+    }
+    setRoot(anchors[arguments[0].anchor].node);
+    return true;
+  }
+
+  // Collects the largest arguments nested in the argument at level of the path that the edit left intact and that build
+  //   a subtree of their own. Terms are left out: an edit before the + or - in front of one can make it a sign, which
+  //   binds tighter than the operators inside the term
+  void findPlaceholders(const size_t level, const size_t editBegin, const size_t editEnd)
+  {
+    reused.clear();
+    placeholders.clear();
+    saved.clear();
+    pending.clear();
+    pending.push_back({path[level], starts[level], 0});
+    while (!pending.empty())
+    {
+      const Argument& argument = arguments[pending.back().argument];
+      const size_t start = pending.back().begin;
+      pending.pop_back();
+      // Pushed last to first, so arguments come out in text order
+      for (uint32_t i = argument.childCount; i-- > 0;)
+      {
+        const uint32_t child = children[argument.firstChild+i];
+        const Argument& candidate = arguments[child];
+        const uint32_t begin = (uint32_t)(start+candidate.begin);
+        const uint32_t end = begin+candidate.length;
+        if (candidate.anchor != none && !candidate.term && begin < end && (end < editBegin || begin > editEnd))
+        {
+          reused.push_back({child, begin, end});
+        }
+        else
+        {
+          pending.push_back({child, begin, end});
+        }
+      }
+    }
+    // Depth-first order only sorts siblings
+    std::sort(reused.begin(), reused.end(), [&](const Placeholder& a, const Placeholder& b)
+    {
+      return a.begin < b.begin;
+    });
+    for (const Placeholder& placeholder : reused)
+    {
+      placeholders.push_back({placeholder.begin-starts[level], placeholder.end-starts[level]});
+      const Argument& argument = arguments[placeholder.argument];
+      const Anchor& anchor = anchors[argument.anchor];
+      saved.push_back({placeholder.argument, argument.parent, anchor.parent, anchor.position});
+    }
+    statistics.reusedArguments += reused.size();
+  }
+
+  // Records the groupers and separators of source outside the placeholders in marks, leaving out those the tokenizer
+  //   drops: closing groupers and separators outside every group, and the + and - of the tokens between them
+  void scan(const std::string_view source, const std::vector<ASTLeaf>& tokens)
+  {
+    marks.clear();
+    size_t depth = 0;
+    size_t placeholder = 0;
+    for (size_t position = 0; position < source.size(); position++)
+    {
+      if (placeholder < placeholders.size() && placeholders[placeholder].begin == position)
+      {
+        position = placeholders[placeholder++].end-1;
+        continue;
+      }
+      const char c = source[position];
+      const AuxiliaryTypes grouper = getGrouper(c);
+      if (isOpeningGrouper(grouper))
+      {
+        depth++;
+      }
+      else if (isClosingGrouper(grouper) && depth > 0)
+      {
+        depth--;
+      }
+      else if (!((c == ',' || c == ';') && depth > 0))
+      {
+        continue;
+      }
+      marks.push_back((uint32_t)position);
+    }
+    // Only the characters themselves: a + or - the tokenizer made up is missing from marks, and the argument irregular
+    const std::vector<TextRange>& tokenSpans = parser.getTokenSpans();
+    const size_t groupers = marks.size();
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+      const TextRange span = tokenSpans[i];
+      if (tokens[i].type.index() == 1 && isTermOperator(std::get<Functions>(tokens[i].type)) && span.end == span.begin+1
+        && (source[span.begin] == '+' || source[span.begin] == '-'))
+      {
+        marks.push_back((uint32_t)span.begin);
+      }
+    }
+    std::inplace_merge(marks.begin(), marks.begin()+groupers, marks.end());
+  }
+
+  static bool isTermOperator(const Functions function)
+  {
+    return function == Functions::ADDITION || function == Functions::SUBTRACTION;
+  }
+
+  // Parses the text of argument unit on its own, leaving its subtree on top of entries and appending the arguments found
+  //   inside it. Returns whether the text is regular: free of errors, settled, and building exactly one subtree, with
+  //   every grouper and separator found again in the RPN. The whole text is built even when it is not
+  bool build(const uint32_t unit, const uint32_t begin, const bool whole)
+  {
+    const std::string_view source = std::string_view(text).substr(begin, arguments[unit].length);
+    statistics.reparsedBytes += source.size();
+    for (const TextRange& placeholder : placeholders)
+    {
+      // Skipped by the tokenizer without reading them
+      statistics.reparsedBytes -= placeholder.end-placeholder.begin;
+    }
+    const std::vector<ASTLeaf>& tokens = parser.Tokenize(source, &placeholders);
+    statistics.reparsedTokens += tokens.size();
+    bool regular = parser.getDiagnostics().empty() && parser.getTokenizer().isSettled();
+    if (!whole && !regular)
+    {
+      return false;
+    }
+    entries.clear();
+    scan(source, tokens);
+    const std::vector<size_t>& held = parser.getTokenizer().getHeldOperators();
+    boundaries.clear();
+    parser.setBoundaries(&boundaries);
+    const std::vector<ASTLeaf>& rpn = parser.RPN(tokens, &parser.getTokenSpans());
+    parser.setBoundaries(nullptr);
+    if (whole)
+    {
+      diagnostics = parser.getDiagnostics();
+    }
+    regular = regular && parser.getDiagnostics().empty() && boundaries.size() == marks.size();
+
+    open.clear();
+    open.push_back({unit, none, 0, 0});
+    built.clear();
+    spans.clear();
+    buildStart = begin;
+    bool malformed = false;
+    size_t mark = 0;
+    size_t placeholder = 0;
+    for (size_t i = 0; i <= rpn.size(); i++)
+    {
+      // Groupers and separators read before the token at i
+      for (; regular && mark < marks.size() && boundaries[mark] == i; mark++)
+      {
+        const uint32_t at = begin+marks[mark];
+        const char c = text[at];
+        if (c == '+' || c == '-')
+        {
+          splitTerm(at, std::binary_search(held.begin(), held.end(), (size_t)marks[mark]), malformed);
+          continue;
+        }
+        const uint32_t parent = open.back().argument;
+        if (!isOpeningGrouper(getGrouper(c)))
+        {
+          closeArgument(at, malformed);
+        }
+        if (!isClosingGrouper(getGrouper(c)))
+        {
+          // A separator opens the next argument of the same group
+          openArgument(isOpeningGrouper(getGrouper(c)) ? innermostOpen() : arguments[parent].parent, at+1, placeholder);
+        }
+      }
+      if (i == rpn.size())
+      {
+        break;
+      }
+      const ASTLeaf& token = rpn[i];
+      switch (token.type.index())
+      {
+        case 0: // AtomicTypes
+        if (std::get<AtomicTypes>(token.type) == AtomicTypes::NULLTYPE && std::get<int>(token.value) != 0)
+        {
+          // Placeholders hold their index plus one, the NULLTYPE leaves of missing operands hold zero
+          const Argument& argument = arguments[reused[std::get<int>(token.value)-1].argument];
+          entries.push_back({anchors[argument.anchor].node, argument.anchor});
+        }
+        else
+        {
+          entries.push_back({interner.addLeaf(token), none});
+        }
+        break;
+        case 1: // Functions
+        reduce(token, malformed);
+        break;
+        default: // Groupers left open by malformed input
+        break;
+      }
+    }
+    finishTerms(open[0], begin+(uint32_t)source.size());
+    if (entries.empty())
+    {
+      // Only the whole text may be empty: an empty argument builds nothing inside its group
+      if (!whole)
+      {
+        return false;
+      }
+      entries.push_back({interner.addLeaf(ASTLeaf(AtomicTypes::NULLTYPE)), none});
+    }
+    return regular && !malformed && entries.size() == 1;
+  }
+
+  // The term being read, or else the innermost open argument
+  uint32_t innermostOpen() const
+  {
+    const OpenArgument& current = open.back();
+    return current.term == none ? current.argument : built[current.term];
+  }
+
+  void openArgument(const uint32_t parent, const uint32_t begin, size_t& placeholder)
+  {
+    uint32_t argument;
+    if (placeholder < reused.size() && reused[placeholder].begin == begin)
+    {
+      argument = reused[placeholder++].argument;
+      arguments[argument].parent = parent;
+    }
+    else
+    {
+      argument = (uint32_t)arguments.size();
+      arguments.push_back({0, 0, parent});
+    }
+    built.push_back(argument);
+    spans.push_back({begin, begin});
+    open.push_back({argument, (uint32_t)built.size()-1, (uint32_t)entries.size(), (uint32_t)entries.size()});
+  }
+
+  void closeArgument(const uint32_t end, bool& malformed)
+  {
+    const OpenArgument closed = open.back();
+    open.pop_back();
+    finishTerms(closed, end);
+    spans[closed.slot].end = end;
+    Argument& argument = arguments[closed.argument];
+    // Tracked only if it built one subtree from its own tokens, otherwise the text is malformed
+    argument.anchor = entries.size() == closed.base+1 && closed.low >= closed.base ? anchorTop() : none;
+    malformed = malformed || argument.anchor == none;
+    open.back().low = std::min(open.back().low, closed.low);
+  }
+
+  // A + or - read at the level of the innermost open argument ends the term being read there and starts the next one.
+  //   The first one splits the argument: its first term takes everything read since it opened. One read while a
+  //   construct was pending (held) leaves terms that don't tokenize on their own, so none of them is anchored
+  void splitTerm(const uint32_t at, const bool held, bool& malformed)
+  {
+    OpenArgument& current = open.back();
+    current.mixed = current.mixed || held;
+    if (arguments[current.argument].term)
+    {
+      // A term built on its own has to stay a single operand of the sum around it
+      malformed = true;
+      return;
+    }
+    if (current.term == none)
+    {
+      current.term = addTerm(current.argument, current.slot == none ? buildStart : spans[current.slot].begin);
+      const uint32_t first = built[current.term];
+      for (size_t slot = current.slot == none ? 0 : current.slot+1; slot < current.term; slot++)
+      {
+        if (arguments[built[slot]].parent == current.argument)
+        {
+          arguments[built[slot]].parent = first;
+        }
+      }
+      // Operators of the first term were popped before this one was read, so it is a single subtree
+      if (entries.size() == current.base+1)
+      {
+        arguments[first].anchor = anchorTop();
+      }
+      else
+      {
+        current.mixed = true;
+      }
+    }
+    spans[current.term].end = at;
+    current.term = addTerm(current.argument, at+1);
+  }
+
+  uint32_t addTerm(const uint32_t parent, const uint32_t begin)
+  {
+    arguments.push_back({0, 0, parent, 0, 0, none, true});
+    built.push_back((uint32_t)arguments.size()-1);
+    spans.push_back({begin, begin});
+    return (uint32_t)built.size()-1;
+  }
+
+  // Ends the last term of an argument. The terms of one that also joined something at a lower priority than its sum are
+  //   not the operands of the sum, and keep no anchor
+  void finishTerms(const OpenArgument& closed, const uint32_t end)
+  {
+    if (closed.term == none)
+    {
+      return;
+    }
+    spans[closed.term].end = end;
+    if (!closed.mixed)
+    {
+      return;
+    }
+    for (size_t slot = closed.slot == none ? 0 : closed.slot+1; slot < built.size(); slot++)
+    {
+      Argument& argument = arguments[built[slot]];
+      if (argument.term && argument.parent == closed.argument)
+      {
+        argument.anchor = none;
+      }
+    }
+  }
+
+  uint32_t anchorTop()
+  {
+    Entry& top = entries.back();
+    if (top.anchor == none)
+    {
+      top.anchor = (uint32_t)anchors.size();
+      anchors.push_back({top.node});
+    }
+    return top.anchor;
+  }
+
+  // Same reductions as Parser::RPN2AST. Missing operands of malformed text are filled with NULLTYPE leaves, and a matrix
+  //   without its row counter has a single row
+  void reduce(const ASTLeaf& token, bool& malformed)
+  {
+    const size_t count = getArgumentCount(token);
+    if (count == 0)
+    {
+      return;
+    }
+    const Functions function = getNodeFunction(token);
+    const bool matrix = getFunctionType(function) == FunctionTypes::MATRIXARGUMENTS;
+    const size_t needed = count+(matrix ? 1 : 0);
+    while (entries.size() < needed)
+    {
+      entries.push_back({interner.addLeaf(ASTLeaf(AtomicTypes::NULLTYPE)), none});
+      malformed = true;
+    }
+    const size_t base = entries.size()-count;
+    OpenArgument& current = open.back();
+    current.low = std::min(current.low, (uint32_t)(entries.size()-needed));
+    if (isInfix(function) && getPriority(function) <= getPriority(Functions::ADDITION))
+    {
+      if (isTermOperator(function) && current.term != none)
+      {
+        // Reduced once the next + or - was read, or where the argument ends: its right operand is the term being read
+        arguments[built[current.term]].anchor = anchorTop();
+      }
+      else
+      {
+        current.mixed = true;
+        malformed = malformed || arguments[current.argument].term;
+      }
+    }
+    if (!matrix)
+    {
+      entries[base] = join(function, base, count);
+      entries.resize(base+1);
+      return;
+    }
+    // The arguments sit on top of the row counter the tokenizer placed right after the operator. Anything else there
+    //   means operands were taken from elsewhere, and the shape of the matrix would depend on their value
+    const Entry counter = entries[base-1];
+    size_t rowNum = 1;
+    const ASTLeaf& leaf = ast.getLeaf(counter.node);
+    if (counter.anchor == none && ast.isLeaf(counter.node) && std::holds_alternative<AtomicTypes>(leaf.type)
+      && std::get<AtomicTypes>(leaf.type) == AtomicTypes::INTEGER && std::holds_alternative<int>(leaf.value))
+    {
+      rowNum = std::min((size_t)std::max(std::get<int>(leaf.value), 0)+1, count);
+    }
+    else
+    {
+      malformed = true;
+    }
+    const size_t rowLength = count/rowNum;
+    // Row entries replace their own first arguments, which were already copied into the row node
+    for (size_t row = 0; row < rowNum; row++)
+    {
+      entries[base+row] = join(Functions::VEC, base+row*rowLength, row+1 < rowNum ? rowLength : count-row*rowLength);
+    }
+    entries[base-1] = join(function, base, rowNum);
+    entries.resize(base);
+  }
+
+  // Node taking entries [first, first+count) as its arguments, anchored if any of them is
+  Entry join(const Functions function, const size_t first, const size_t count)
+  {
+    operands.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+      operands.push_back(entries[first+i].node);
+    }
+    Entry joined = {interner.addNode(function, operands.data(), (uint32_t)count), none};
+    for (size_t i = 0; i < count; i++)
+    {
+      const uint32_t anchor = entries[first+i].anchor;
+      if (anchor == none)
+      {
+        continue;
+      }
+      if (joined.anchor == none)
+      {
+        joined.anchor = (uint32_t)anchors.size();
+        anchors.push_back({joined.node});
+      }
+      anchors[anchor].parent = joined.anchor;
+      anchors[anchor].position = (uint32_t)i;
+    }
+    return joined;
+  }
+
+  // Turns the spans of the arguments built inside unit, which starts at start, into offsets from their parents
+  void rebase(const uint32_t unit, const uint32_t start)
+  {
+    for (size_t slot = 0; slot < built.size(); slot++)
+    {
+      Argument& argument = arguments[built[slot]];
+      argument.begin = (uint32_t)spans[slot].begin;
+      argument.length = (uint32_t)(spans[slot].end-spans[slot].begin);
+    }
+    // Parents can come after their children in built, so every offset is found before any is written
+    for (size_t slot = 0; slot < built.size(); slot++)
+    {
+      const uint32_t parent = arguments[built[slot]].parent;
+      spans[slot].begin -= parent == unit ? start : arguments[parent].begin;
+    }
+    for (size_t slot = 0; slot < built.size(); slot++)
+    {
+      arguments[built[slot]].begin = (uint32_t)spans[slot].begin;
+    }
+  }
+
+  // Gives unit and the arguments it built new child lists, with the placeholders among them keeping their own
+  void link(const uint32_t unit, const size_t firstArgument)
+  {
+    arguments[unit].childCount = 0;
+    for (const uint32_t argument : built)
+    {
+      arguments[arguments[argument].parent].childCount++;
+    }
+    uint32_t next = (uint32_t)children.size();
+    const auto allocate = [&](Argument& argument)
+    {
+      argument.firstChild = next;
+      next += argument.childCount;
+      argument.childCount = 0;
+    };
+    allocate(arguments[unit]);
+    for (size_t argument = firstArgument; argument < arguments.size(); argument++)
+    {
+      allocate(arguments[argument]);
+    }
+    children.resize(next);
+    for (const uint32_t argument : built)
+    {
+      Argument& parent = arguments[arguments[argument].parent];
+      children[parent.firstChild+parent.childCount++] = argument;
+    }
+  }
+
+  // Roots that are leaves are wrapped in an IDENTITY node, as Parser::RPN2AST does
+  void setRoot(const NodeId node)
+  {
+    ast.root = ast.isLeaf(node) ? interner.addNode(Functions::IDENTITY, &node, 1) : node;
+  }
+};
+
+#endif
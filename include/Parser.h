@@ -0,0 +1,558 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <algorithm>
+#include <variant>
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "AtomicTypes.h"
+#include "Functions.h"
+#include "AuxiliaryTypes.h"
+#include "FunctionTypes.h"
+#include "LookupTables.h"
+#include "AST.h"
+#include "ASTInterner.h"
+#include "Trace.h"
+#include "Allocations.h"
+#include "Diagnostics.h"
+#include "Tokenizer.h"
+
+constexpr int CCIntervalIndex = (int)Functions::CCINTV;
+
+constexpr size_t getArgType()
+{
+  return 0;
+};
+
+// Arguments the node built for a function token of an RPN takes from the top of the stack, not counting the row
+//   counter a matrix keeps below them. Functions that build no node take none and are dropped
+inline size_t getArgumentCount(const ASTLeaf& function)
+{
+  switch (getFunctionType(std::get<Functions>(function.type)))
+  {
+    case FunctionTypes::BINARY:
+    case FunctionTypes::INTERVAL:
+    return 2;
+    case FunctionTypes::UNARYLEFT:
+    case FunctionTypes::UNARYRIGHT:
+    return 1;
+    case FunctionTypes::BIGOPERATOR:
+    case FunctionTypes::OPTIONALARGUMENTS:
+    case FunctionTypes::ARRAYARGUMENTS:
+    case FunctionTypes::MATRIXARGUMENTS:
+    return std::get<int>(function.value)+1;
+    default:
+    return 0;
+  }
+}
+
+// Arguments of a function that come before its token: the left operand of infix operators and the operand of postfix
+//   ones. Prefix functions take all of theirs from the tokens after them
+inline size_t getLeadingArgumentCount(const ASTLeaf& function)
+{
+  const Functions type = std::get<Functions>(function.type);
+  return isInfix(type) || getFunctionType(type) == FunctionTypes::UNARYRIGHT ? 1 : 0;
+}
+
+// Type of the node built for a function token of an RPN: intervals carry the type of their ends in the token value
+inline Functions getNodeFunction(const ASTLeaf& function)
+{
+  const Functions type = std::get<Functions>(function.type);
+  return getFunctionType(type) == FunctionTypes::INTERVAL ? (Functions)(CCIntervalIndex+std::get<int>(function.value)) : type;
+}
+
+struct Environment
+{
+  std::vector<AST> expressions;
+};
+
+// Work done by the last parse. Tokens are handed from one buffer to the next by value, and tokenTransfers counts every
+//   such write (into the operator stack, the output buffer or the arena); subtrees are referenced by id and never copied
+struct ParseStatistics
+{
+  size_t tokens = 0;
+  size_t rpnLength = 0;
+  size_t nodes = 0;
+  size_t tokenTransfers = 0;
+  size_t sharedNodes = 0; // Nodes that reused an identical subtree instead of being added, only when interning
+  uint64_t allocations = 0; // Heap allocations made by Parse on this thread, zero when allocation counting is compiled out
+  uint64_t allocatedBytes = 0;
+};
+
+/*
+  Every buffer of the pipeline (tokenizer window, operator stack, RPN output, id stack and AST arena) belongs to the
+  parser and is only cleared between parses, so after the first few expressions parsing stops allocating
+  as long as the inputs don't outgrow the largest one seen so far
+*/
+class Parser
+{
+  public:
+  // Converts a sequence of ASTLeafs into reverse-polish notation, written into a buffer owned by the parser and valid
+  //   until the next call. Any range of tokens is accepted; passing a Tokenizer pulls the tokens lazily.
+  // Every argument (the tokens between two groupers or separators, or the whole input) leaves exactly one value in the
+  //   output, and every function takes its operands from its own side of its token, so RPN2AST never takes operands
+  //   that belong elsewhere: missing operands become NULLTYPE leaves where they were expected, an empty argument becomes
+  //   one, and operands left without an operator between them are multiplied. Each repair is added to getDiagnostics(),
+  //   located by the spans of the tokens: those of the Tokenizer when it is the range, the entries of spans otherwise,
+  //   or else token positions. The diagnostics already there, such as those Tokenize left, are merged in by position,
+  //   so Tokenize followed by RPN reports the same list as Parse
+  template <typename TokenRange>
+  const std::vector<ASTLeaf>& RPN(TokenRange&& nodes, const std::vector<TextRange>* spans = nullptr)
+  {
+    // Using the shunting-yard algorithm
+    AllocationScope allocations(AllocationPhases::RPN);
+    std::swap(earlier, diagnostics);
+    diagnostics.clear();
+    operatorStack.clear();
+    operatorMarks.clear();
+    output.clear();
+    arguments.clear();
+    arguments.push_back({0, 0});
+    values = 0;
+    statistics = ParseStatistics();
+    size_t position = 0;
+    TextRange span = {0, 0};
+    for (const ASTLeaf& leaf : nodes)
+    {
+      TRACE(TraceCategories::SHUNTINGYARD, TraceLevels::DEBUG, position, "token", leaf.toString());
+      if (Trace::enabled(TraceCategories::SHUNTINGYARD, TraceLevels::VERBOSE))
+      {
+        // Dumping both containers makes every token O(n), so this is reserved for the most detailed level
+        traceState(position);
+      }
+      if constexpr (std::is_same_v<std::decay_t<TokenRange>, Tokenizer>)
+      {
+        span = nodes.getSpan();
+      }
+      else
+      {
+        span = spans ? (*spans)[position] : TextRange{position, position+1};
+      }
+      position++;
+
+      switch (leaf.type.index())
+      {
+        case 0: // AtomicTypes
+        {
+          pushOutput(leaf);
+        }
+        break;
+        case 1: // Functions
+        {
+          const Functions& newFunction = std::get<Functions>(leaf.type);
+          // A prefix operator has no operand yet for the operators below it to take, so it pops none: --x, \sin\cos x
+          while (getLeadingArgumentCount(leaf) != 0 && !operatorStack.empty())
+          {
+            const ASTLeaf& top = operatorStack.back();
+            if (top.type.index() == 1 && getPriority(std::get<Functions>(top.type)) >= getPriority(newFunction))
+            {
+              popOperator();
+              continue;
+            }
+            break;
+          }
+          if (boundaries && (newFunction == Functions::ADDITION || newFunction == Functions::SUBTRACTION))
+          {
+            boundaries->push_back((uint32_t)output.size());
+          }
+          // Leading operands have to follow those the operator below is still waiting for
+          const size_t floor = operatorMarks.empty() ? 0 : operatorMarks.back().values;
+          if (values-floor < getLeadingArgumentCount(leaf))
+          {
+            diagnostics.report(ErrorTypes::MISSINGOPERAND, span);
+            pushOutput(ASTLeaf(AtomicTypes::NULLTYPE));
+          }
+          pushOperator(leaf, span);
+        }
+        break;
+        case 2: // AuxiliaryTypes
+        {
+          const AuxiliaryTypes& currentType = std::get<AuxiliaryTypes>(leaf.type);
+          if (isOpeningGrouper(currentType))
+          {
+            pushOperator(leaf, span);
+            arguments.push_back({values, span.begin});
+          }
+          else if (isClosingGrouper(currentType) || currentType == AuxiliaryTypes::COMMA)
+          {
+            if (arguments.size() == 1)
+            {
+              // Closes or separates nothing. The Tokenizer already drops these, so they only come from other ranges
+              diagnostics.report(isClosingGrouper(currentType) ? ErrorTypes::UNBALANCEDGROUPER : ErrorTypes::STRAYSEPARATOR, span);
+              break;
+            }
+            // Opening groupers and commas both enclose the well formed formula before a closing grouper or a comma:
+            // (... , ...) (...)
+            //      ^ ___  ^___       WFFs represented by underscores and triple dots, parse delimiters represented by carrets
+            closeArgument(span, false);
+            if (isClosingGrouper(currentType))
+            {
+              arguments.pop_back();
+            }
+            else
+            {
+              arguments.back() = {values, span.begin};
+              pushOperator(ASTLeaf(AuxiliaryTypes::COMMA), span);
+            }
+          }
+          else
+          {
+            break;
+          }
+          if (boundaries)
+          {
+            boundaries->push_back((uint32_t)output.size());
+          }
+        }
+        break;
+      };
+    }
+    // Groups a range left open are closed where it ends. The Tokenizer closes its own, so they only come from other ranges
+    const TextRange end = {span.end, span.end};
+    for (; arguments.size() > 1; arguments.pop_back())
+    {
+      diagnostics.report(ErrorTypes::UNCLOSEDGROUPER, {arguments.back().begin, end.end});
+      closeArgument(end, false);
+    }
+    closeArgument(end, true);
+    diagnostics.merge(earlier);
+    statistics.tokens = position;
+    statistics.rpnLength = output.size();
+    if (Trace::enabled(TraceCategories::SHUNTINGYARD, TraceLevels::INFO))
+    {
+      for (size_t i = 0; i < output.size(); i++)
+      {
+        Trace::emit(TraceCategories::SHUNTINGYARD, TraceLevels::INFO, i, "output", output[i].toString());
+      }
+    }
+    return output;
+  }
+
+  // Builds the arena AST bottom-up into ast, which is cleared but keeps its capacity: every node takes its children
+  //   from the top of a stack of node ids
+  void RPN2AST(const std::vector<ASTLeaf>& rpn, AST& ast)
+  {
+    AllocationScope allocations(AllocationPhases::RPN2AST);
+    ast.clear();
+    ast.reserve(rpn.size()+1);
+    if (interning)
+    {
+      interner.reset(ast);
+    }
+    ASTStack.clear();
+    ASTStack.reserve(rpn.size());
+    for (size_t position = 0; position < rpn.size(); position++)
+    {
+      const ASTLeaf &current = rpn[position];
+      TRACE(TraceCategories::ASTBUILD, TraceLevels::DEBUG, position, "token", current.toString());
+      switch (current.type.index())
+      {
+        case 0: // Atomic Type
+        ASTStack.push_back(addLeaf(ast, current));
+        statistics.tokenTransfers++;
+        break;
+        case 1: // Function
+        {
+          const size_t argNum = getArgumentCount(current);
+          if (argNum == 0)
+          {
+            break;
+          }
+          const Functions function = getNodeFunction(current);
+          const bool rows = getFunctionType(function) == FunctionTypes::MATRIXARGUMENTS;
+          // An RPN from RPN always holds the operands, anything else has the missing ones filled in
+          while (ASTStack.size() < argNum+(rows ? 1 : 0))
+          {
+            ASTStack.push_back(addLeaf(ast, ASTLeaf(AtomicTypes::NULLTYPE)));
+          }
+          if (!rows)
+          {
+            reduce(ast, function, argNum);
+            break;
+          }
+          // The arguments sit on top of the row counter the tokenizer placed right after the operator. Malformed input
+          //   can leave another value there, which then counts as a single row
+          const size_t base = ASTStack.size()-argNum;
+          const ASTLeaf& counter = ast.getLeaf(ASTStack[base-1]);
+          size_t rowNum = 1;
+          if (std::holds_alternative<AtomicTypes>(counter.type) && std::get<AtomicTypes>(counter.type) == AtomicTypes::INTEGER
+            && std::holds_alternative<int>(counter.value) && std::get<int>(counter.value) >= 0)
+          {
+            rowNum = std::min((size_t)std::get<int>(counter.value)+1, argNum);
+          }
+          // The tokenizer pads short rows, so its rows all have the same length. Any other range may not divide
+          //   evenly, and then the last row takes what is left
+          const size_t rowLength = argNum/rowNum;
+          // Row ids replace their own first arguments in the stack, which were already copied into the row node
+          for (size_t row = 0; row < rowNum; row++)
+          {
+            const size_t length = row+1 < rowNum ? rowLength : argNum-row*rowLength;
+            ASTStack[base+row] = addNode(ast, Functions::VEC, &ASTStack[base+row*rowLength], (uint32_t)length);
+          }
+          const NodeId matrix = addNode(ast, function, &ASTStack[base], (uint32_t)rowNum);
+          ASTStack.resize(base-1);
+          ASTStack.push_back(matrix);
+        }
+        break;
+        default: // Groupers left open by malformed input carry no meaning here
+        break;
+      }
+    }
+    if (ASTStack.empty())
+    {
+      ASTStack.push_back(addLeaf(ast, ASTLeaf(AtomicTypes::NULLTYPE)));
+    }
+    ast.root = ASTStack.back();
+    if (ast.isLeaf(ast.root))
+    {
+      ast.root = addNode(ast, Functions::IDENTITY, &ast.root, 1);
+    }
+    statistics.nodes = ast.size();
+    statistics.sharedNodes = interning ? interner.getSharedCount() : 0;
+  }
+
+  AST RPN2AST(const std::vector<ASTLeaf>& rpn)
+  {
+    AST ast;
+    RPN2AST(rpn, ast);
+    return ast;
+  }
+
+  // Runs the whole pipeline on the parser's own buffers. The returned AST is overwritten by the next parse. Malformed
+  //   input still gives an AST, with the repairs listed in getDiagnostics()
+  const AST& Parse(const std::string_view input)
+  {
+    const AllocationCounters before = Allocations::thread();
+    diagnostics.clear();
+    tokenizer.reset(input);
+    RPN2AST(RPN(tokenizer), ast);
+    diagnostics.merge(tokenizer.getDiagnostics());
+    const AllocationCounters used = Allocations::thread()-before;
+    statistics.allocations = used.allocations;
+    statistics.allocatedBytes = used.bytes;
+    return ast;
+  }
+
+  // Finds the errors of input without building its AST: the tokenizer and shunting-yard alone find all of them
+  const Diagnostics& Validate(const std::string_view input)
+  {
+    diagnostics.clear();
+    tokenizer.reset(input);
+    RPN(tokenizer);
+    diagnostics.merge(tokenizer.getDiagnostics());
+    return diagnostics;
+  }
+
+  // Materializes the tokens of input into a buffer owned by the parser and valid until the next call, leaving their
+  //   spans in getTokenSpans() and the tokenizer errors in getDiagnostics(). The result can be handed to RPN
+  const std::vector<ASTLeaf>& Tokenize(const std::string_view input, const std::vector<TextRange>* placeholders = nullptr)
+  {
+    tokenizer.reset(input, placeholders);
+    tokens.clear();
+    tokenSpans.clear();
+    ASTLeaf token;
+    while (tokenizer.next(token))
+    {
+      tokens.push_back(token);
+      tokenSpans.push_back(tokenizer.getSpan());
+    }
+    diagnostics.clear();
+    diagnostics.merge(tokenizer.getDiagnostics());
+    return tokens;
+  }
+
+  const std::vector<TextRange>& getTokenSpans() const
+  {
+    return tokenSpans;
+  }
+
+  // When enabled, ASTs are hash-consed while they are built: identical subtrees become a single node, so the AST is a
+  //   DAG whose subtrees are equal exactly when their ids are
+  void setInterning(const bool enabled)
+  {
+    interning = enabled;
+  }
+
+  bool isInterning() const
+  {
+    return interning;
+  }
+
+  // While set, RPN appends to boundaries the length of its output after each grouper and separator token, in input
+  //   order: the RPN of every argument of a group is the range of the output between two consecutive lengths. It does
+  //   the same after each + and - once the operators before it are popped, where the term before it has been joined
+  void setBoundaries(std::vector<uint32_t>* target)
+  {
+    boundaries = target;
+  }
+
+  const Tokenizer& getTokenizer() const
+  {
+    return tokenizer;
+  }
+
+  // Errors of the last Parse, Validate or Tokenize, sorted by position, plus those found by RPN calls since then
+  const Diagnostics& getDiagnostics() const
+  {
+    return diagnostics;
+  }
+
+  const ParseStatistics& getStatistics() const
+  {
+    return statistics;
+  }
+
+  private:
+  // An argument RPN is reading, which has to leave exactly one value
+  struct OpenArgument
+  {
+    size_t values; // Values in the output when it started
+    size_t begin; // Start of the grouper or separator before it
+  };
+
+  Tokenizer tokenizer;
+  std::vector<ASTLeaf> tokens;
+  std::vector<TextRange> tokenSpans;
+  std::vector<ASTLeaf> operatorStack;
+  // Where an entry of the operator stack was pushed
+  struct OperatorMark
+  {
+    TextRange span;
+    size_t values; // Values in the output at that point
+  };
+  std::vector<OperatorMark> operatorMarks; // One per operator
+  std::vector<ASTLeaf> output;
+  std::vector<OpenArgument> arguments;
+  size_t values = 0; // Values the output leaves on the stack of RPN2AST
+  Diagnostics diagnostics;
+  Diagnostics earlier; // Diagnostics found before RPN started, merged into its own
+  std::vector<NodeId> ASTStack;
+  AST ast;
+  ASTInterner interner;
+  bool interning = false;
+  std::vector<uint32_t>* boundaries = nullptr;
+  ParseStatistics statistics;
+
+  void pushOperator(const ASTLeaf& leaf, const TextRange span)
+  {
+    operatorStack.push_back(leaf);
+    operatorMarks.push_back({span, values});
+    statistics.tokenTransfers++;
+  }
+
+  void popOperator()
+  {
+    const ASTLeaf function = operatorStack.back();
+    const OperatorMark mark = operatorMarks.back();
+    operatorStack.pop_back();
+    operatorMarks.pop_back();
+    pushFunction(function, mark.span, mark.values-getLeadingArgumentCount(function));
+  }
+
+  void pushOutput(const ASTLeaf& leaf)
+  {
+    values += leaf.type.index() == 0;
+    output.push_back(leaf);
+    statistics.tokenTransfers++;
+  }
+
+  // Appends a function taking the values from first onwards. Missing trailing operands are filled with NULLTYPE leaves,
+  //   and extra values, which no operator joined, are multiplied together first
+  void pushFunction(const ASTLeaf& function, const TextRange span, const size_t first)
+  {
+    // A matrix also takes the row counter the tokenizer placed before its group
+    const size_t count = getArgumentCount(function)+(getFunctionType(std::get<Functions>(function.type)) == FunctionTypes::MATRIXARGUMENTS);
+    if (count == 0)
+    {
+      // Builds no node
+      pushOutput(function);
+      return;
+    }
+    if (values-first < count)
+    {
+      diagnostics.report(ErrorTypes::MISSINGOPERAND, span);
+      while (values-first < count)
+      {
+        pushOutput(ASTLeaf(AtomicTypes::NULLTYPE));
+      }
+    }
+    else if (values-first > count)
+    {
+      diagnostics.report(ErrorTypes::MISSINGOPERATOR, span);
+      while (values-first > count)
+      {
+        pushFunction(ASTLeaf(Functions::MULTIPLICATION), span, values-2);
+      }
+    }
+    pushOutput(function);
+    values -= count;
+    values++;
+  }
+
+  // Pops the operators of the innermost argument into the output, then the grouper or comma it started at, and leaves
+  //   exactly one value for it. Only the whole input may be empty
+  void closeArgument(const TextRange closing, const bool whole)
+  {
+    while (!operatorStack.empty() && operatorStack.back().type.index() != 2)
+    {
+      popOperator();
+    }
+    if (!operatorStack.empty())
+    {
+      operatorStack.pop_back();
+      operatorMarks.pop_back();
+    }
+    const size_t first = arguments.back().values;
+    const TextRange span = {arguments.back().begin, closing.end};
+    if (values == first && !whole)
+    {
+      diagnostics.report(ErrorTypes::MISSINGOPERAND, span);
+      pushOutput(ASTLeaf(AtomicTypes::NULLTYPE));
+    }
+    else if (values > first+1)
+    {
+      diagnostics.report(ErrorTypes::MISSINGOPERATOR, span);
+      while (values > first+1)
+      {
+        pushFunction(ASTLeaf(Functions::MULTIPLICATION), span, values-2);
+      }
+    }
+  }
+
+  NodeId addLeaf(AST& ast, const ASTLeaf& leaf)
+  {
+    return interning ? interner.addLeaf(leaf) : ast.addLeaf(leaf);
+  }
+
+  NodeId addNode(AST& ast, const Functions function, const NodeId* children, const uint32_t count)
+  {
+    return interning ? interner.addNode(function, children, count) : ast.addNode(function, children, count);
+  }
+
+  // Replaces the top argNum ids of the stack with a new node taking them as its arguments
+  void reduce(AST& ast, const Functions function, const size_t argNum)
+  {
+    const NodeId node = addNode(ast, function, ASTStack.data() + ASTStack.size() - argNum, (uint32_t)argNum);
+    TRACE(TraceCategories::ASTBUILD, TraceLevels::DEBUG, node, "node", getName(function));
+    ASTStack.resize(ASTStack.size() - argNum);
+    ASTStack.push_back(node);
+  }
+
+  void traceState(const size_t position) const
+  {
+    for (auto it = operatorStack.rbegin(); it != operatorStack.rend(); ++it)
+    {
+      Trace::emit(TraceCategories::SHUNTINGYARD, TraceLevels::VERBOSE, position, "operator stack", it->toString());
+    }
+    for (const ASTLeaf& leaf : output)
+    {
+      Trace::emit(TraceCategories::SHUNTINGYARD, TraceLevels::VERBOSE, position, "output queue", leaf.toString());
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,712 @@
+#ifndef SIMPLIFIER_H
+#define SIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "AST.h"
+#include "ASTInterner.h"
+#include "AtomicTypes.h"
+#include "Evaluator.h"
+#include "Functions.h"
+#include "BigInteger.h"
+#include "IntegerKernels.h"
+
+struct SimplificationStatistics
+{
+  size_t nodesBefore = 0;
+  size_t nodesAfter = 0;
+  // Nodes that rewrites, folds and flattening eliminated, counted over the trees both arenas stand for: a subtree shared
+  //   by hash-consing counts once per use, and the identity kept at the root counts on neither side
+  size_t removed = 0;
+  size_t folded = 0; // Subtrees or operand groups replaced by a single number
+  size_t exact = 0; // Folds computed over integers, or arithmetic over decimals, without rounding
+  size_t rewrites = 0; // Identities applied: x+0, x*1, x*0, x-0, 0-x, x/1, x^1, --x and redundant identity nodes
+  size_t flattened = 0; // Nested additions and multiplications merged into their parent
+};
+
+/*
+  Algebraic simplification of an AST into a new, hash-consed one. Nodes are rewritten bottom-up in id order, so every
+  node sees its children already simplified, and every rule leaves its result in the same normal form: numbers are
+  folded with the kernels of Evaluator (whenever they give a REAL), additions and multiplications are flattened into
+  n-ary nodes with their numbers merged and their operands sorted canonically, and the identities listed in
+  SimplificationStatistics are applied. A single pass therefore reaches the fixpoint, and since the rewritten nodes go
+  through an ASTInterner, shared subtrees are simplified and stored once. When every operand is an INTEGER, the
+  arithmetic operators and the combinatorial functions are folded exactly through IntegerKernels, so 30! or 2^100
+  become big integer leaves instead of rounded or overflowing doubles.
+
+  Like any algebraic simplifier this may change what an expression evaluates to outside the reals: x*0 becomes 0 even
+  where x is undefined, and reordered sums round differently, which only shows next to cancellations of huge terms.
+
+  A sum or product whose only parent is of its own kind (the inner sum of (a+b)+c) is not rewritten on its own: the
+  parent gathers the operands of the whole chain from the source, so the left-nested chains the parser builds are
+  flattened in time linear in their length instead of once per level. The rewritten arena can still hold nodes that a
+  parent later absorbed (a sum that a product by 1 became), so the result is compacted into the target keeping only
+  what the root reaches. Every buffer is reused between calls.
+*/
+class Simplifier
+{
+  public:
+  // Writes the simplified form of source into target, which is cleared
+  const SimplificationStatistics& simplify(const AST& source, AST& target)
+  {
+    statistics = SimplificationStatistics();
+    statistics.nodesBefore = source.size();
+    work.clear();
+    structure.clear();
+    interner.reset(work);
+    remap.resize(source.size());
+    countParents(source);
+    for (NodeId id = 0; id < source.size(); id++)
+    {
+      // Absorbed nodes are rewritten as part of their parent, and unreachable ones not at all
+      if (parents[id] == 0 || isAbsorbed(source, id))
+      {
+        continue;
+      }
+      const ASTNode& node = source.nodes[id];
+      if (!std::holds_alternative<Functions>(node.leaf.type))
+      {
+        remap[id] = leaf(node.leaf);
+        continue;
+      }
+      gather(source, id);
+      remap[id] = rewrite(std::get<Functions>(node.leaf.type), id == source.root);
+    }
+    NodeId root = source.size() ? remap[source.root] : leaf(ASTLeaf(AtomicTypes::NULLTYPE));
+    // Same convention as the parser: the root is always a function node
+    if (work.isLeaf(root))
+    {
+      operands.assign(1, root);
+      root = node(Functions::IDENTITY);
+    }
+    work.root = root;
+    compact(target);
+    statistics.nodesAfter = target.size();
+    const size_t before = treeSize(source), after = treeSize(target);
+    statistics.removed = before > after ? before-after : 0;
+    return statistics;
+  }
+
+  AST simplify(const AST& source)
+  {
+    AST target;
+    simplify(source, target);
+    return target;
+  }
+
+  const SimplificationStatistics& getStatistics() const
+  {
+    return statistics;
+  }
+
+  // Leaves sums and products that several source nodes share as operands of their parents instead of copying their
+  //   operands into each one, which keeps DAGs such as derivatives linear at the cost of the normal form
+  void setKeepShared(const bool keep)
+  {
+    keepShared = keep;
+  }
+
+  private:
+  AST work;
+  ASTInterner interner;
+  std::vector<uint64_t> structure; // Hash of the shape of every work node, independent of ids, used to order operands
+  std::vector<NodeId> remap;
+  std::vector<NodeId> operands; // Of the node being rewritten
+  std::vector<NodeId> merged;
+  std::vector<Evaluation> values;
+  std::vector<BigInteger> integers;
+  std::vector<bool> reachable;
+  std::vector<size_t> sizes;
+  std::vector<uint32_t> parents; // Of every source node, counted over the nodes the root reaches
+  std::vector<bool> nested; // Whether a source node is an operand of a sum or product of its own kind
+  std::vector<NodeId> pending;
+  std::vector<bool> shared; // Whether each of operands stands for a source node with several parents
+  bool keepShared = false;
+  SimplificationStatistics statistics;
+
+  static bool isAssociative(const AST& ast, const NodeId id)
+  {
+    return !ast.isLeaf(id) && (ast.getType(id) == Functions::ADDITION || ast.getType(id) == Functions::MULTIPLICATION);
+  }
+
+  // Children always have lower ids than their parents, so going down from the root every parent is counted before its
+  //   children are reached
+  void countParents(const AST& source)
+  {
+    parents.assign(source.size(), 0);
+    nested.assign(source.size(), false);
+    if (source.size() == 0)
+    {
+      return;
+    }
+    parents[source.root] = 1;
+    for (NodeId id = source.root+1; id-- > 0;)
+    {
+      if (parents[id] == 0)
+      {
+        continue;
+      }
+      const bool associative = isAssociative(source, id);
+      for (const NodeId child : source.getArgs(id))
+      {
+        parents[child]++;
+        nested[child] = nested[child] || (associative && isAssociative(source, child) && source.getType(child) == source.getType(id));
+      }
+    }
+  }
+
+  // A sum or product whose only parent is one of its own kind, which takes its operands in its place
+  bool isAbsorbed(const AST& source, const NodeId id) const
+  {
+    return nested[id] && parents[id] == 1 && id != source.root;
+  }
+
+  // Fills operands with the rewritten children of source node id. A sum or product takes the operands of its absorbed
+  //   children instead, so the binary chains the parser builds are flattened in one walk instead of being copied into
+  //   a new n-ary node at each of their levels
+  void gather(const AST& source, const NodeId id)
+  {
+    operands.clear();
+    shared.clear();
+    const ASTArgs args = source.getArgs(id);
+    if (!isAssociative(source, id))
+    {
+      for (const NodeId child : args)
+      {
+        operands.push_back(remap[child]);
+      }
+      return;
+    }
+    pending.clear();
+    for (size_t i = args.size(); i-- > 0;)
+    {
+      pending.push_back(args[i]);
+    }
+    while (!pending.empty())
+    {
+      const NodeId child = pending.back();
+      pending.pop_back();
+      if (isAbsorbed(source, child))
+      {
+        statistics.flattened++;
+        const ASTArgs inner = source.getArgs(child);
+        for (size_t i = inner.size(); i-- > 0;)
+        {
+          pending.push_back(inner[i]);
+        }
+        continue;
+      }
+      operands.push_back(remap[child]);
+      shared.push_back(parents[child] > 1);
+    }
+  }
+
+  // Nodes of the tree the arena stands for, saturating on huge shared ones
+  size_t treeSize(const AST& ast)
+  {
+    if (ast.size() == 0)
+    {
+      return 0;
+    }
+    sizes.resize(ast.size());
+    for (NodeId id = 0; id <= ast.root; id++)
+    {
+      size_t size = 1;
+      for (const NodeId child : ast.getArgs(id))
+      {
+        size = sizes[child] > SIZE_MAX-size ? SIZE_MAX : size+sizes[child];
+      }
+      sizes[id] = size;
+    }
+    const bool wrapped = !ast.isLeaf(ast.root) && ast.getType(ast.root) == Functions::IDENTITY && ast.nodes[ast.root].argCount == 1;
+    return wrapped ? sizes[ast.root]-1 : sizes[ast.root];
+  }
+
+  bool isNumber(const NodeId id) const
+  {
+    if (!work.isLeaf(id) || !std::holds_alternative<AtomicTypes>(work.getLeaf(id).type))
+    {
+      return false;
+    }
+    const AtomicTypes type = std::get<AtomicTypes>(work.getLeaf(id).type);
+    return type == AtomicTypes::INTEGER || type == AtomicTypes::REAL;
+  }
+
+  double numberValue(const NodeId id) const
+  {
+    const ASTLeaf& number = work.getLeaf(id);
+    if (std::holds_alternative<const BigInteger*>(number.value))
+    {
+      return std::get<const BigInteger*>(number.value)->toDouble();
+    }
+    if (std::holds_alternative<Decimal>(number.value))
+    {
+      return std::get<Decimal>(number.value).toDouble();
+    }
+    if (std::holds_alternative<int64_t>(number.value))
+    {
+      return (double)std::get<int64_t>(number.value);
+    }
+    return std::holds_alternative<int>(number.value) ? std::get<int>(number.value) : std::get<double>(number.value);
+  }
+
+  bool isInteger(const NodeId id) const
+  {
+    return isNumber(id) && std::get<AtomicTypes>(work.getLeaf(id).type) == AtomicTypes::INTEGER;
+  }
+
+  bool isNumber(const NodeId id, const double value) const
+  {
+    return isNumber(id) && numberValue(id) == value;
+  }
+
+  bool isFunction(const NodeId id, const Functions function) const
+  {
+    return !work.isLeaf(id) && work.getType(id) == function;
+  }
+
+  NodeId leaf(const ASTLeaf& value)
+  {
+    const size_t size = work.size();
+    const NodeId id = interner.addLeaf(value);
+    if (work.size() != size)
+    {
+      uint64_t words[2];
+      encodeLeaf(value, words);
+      structure.push_back(mixHash(words[0], words[1]));
+    }
+    return id;
+  }
+
+  // Integral values that fit become INTEGER leaves, like the ones the tokenizer produces
+  NodeId number(const double value)
+  {
+    if (value == std::floor(value) && value >= INT_MIN && value <= INT_MAX)
+    {
+      return leaf(ASTLeaf(AtomicTypes::INTEGER, (int)value));
+    }
+    return leaf(ASTLeaf(AtomicTypes::REAL, value));
+  }
+
+  NodeId integer(BigInteger&& value)
+  {
+    int small;
+    if (value.toInt(small))
+    {
+      return leaf(ASTLeaf(AtomicTypes::INTEGER, small));
+    }
+    int64_t large;
+    if (value.toInt64(large))
+    {
+      return leaf(ASTLeaf(AtomicTypes::INTEGER, large));
+    }
+    // The arena copies the value, unless it already holds a node with it
+    return leaf(ASTLeaf(AtomicTypes::INTEGER, &value));
+  }
+
+  // Adds function applied to operands as it is
+  NodeId node(const Functions function)
+  {
+    const size_t size = work.size();
+    const NodeId id = interner.addNode(function, operands.data(), (uint32_t)operands.size());
+    if (work.size() != size)
+    {
+      uint64_t hash = mixHash((uint64_t)function, operands.size());
+      for (const NodeId operand : operands)
+      {
+        hash = mixHash(hash, structure[operand]);
+      }
+      structure.push_back(hash);
+    }
+    return id;
+  }
+
+  // Evaluates function exactly over the integers in operands, returning false unless all of them are integers and
+  //   IntegerKernels gives a result
+  bool foldExact(const Functions function, NodeId& result)
+  {
+    if (!std::all_of(operands.begin(), operands.end(), [this](const NodeId id) { return isInteger(id); }))
+    {
+      return false;
+    }
+    integers.resize(operands.size());
+    for (size_t i = 0; i < operands.size(); i++)
+    {
+      const ASTLeaf& number = work.getLeaf(operands[i]);
+      if (std::holds_alternative<const BigInteger*>(number.value))
+      {
+        integers[i] = *std::get<const BigInteger*>(number.value);
+      }
+      else
+      {
+        integers[i] = BigInteger(std::holds_alternative<int64_t>(number.value) ? std::get<int64_t>(number.value) : std::get<int>(number.value));
+      }
+    }
+    BigInteger value;
+    if (IntegerKernels::evaluate(function, integers.data(), (uint32_t)integers.size(), value) != AtomicTypes::INTEGER)
+    {
+      return false;
+    }
+    statistics.exact++;
+    result = integer(std::move(value));
+    return true;
+  }
+
+  // Exact value of an int or decimal leaf
+  bool decimalValue(const NodeId id, Decimal& value) const
+  {
+    const LeafValue& number = work.getLeaf(id).value;
+    if (std::holds_alternative<Decimal>(number))
+    {
+      value = std::get<Decimal>(number);
+      return true;
+    }
+    if (std::holds_alternative<int64_t>(number))
+    {
+      return Decimal::make(std::get<int64_t>(number), 0, value);
+    }
+    return std::holds_alternative<int>(number) && Decimal::make(std::get<int>(number), 0, value);
+  }
+
+  // Evaluates arithmetic over ints and decimals without rounding: sums, differences, negations, products, integer
+  //   powers and quotients that terminate. Returns false unless one of the operands is a decimal (for quotients, unless
+  //   it doesn't divide exactly as integers) and the result stays in the range of Decimal
+  bool foldDecimal(const Functions function, NodeId& result)
+  {
+    Decimal value, operand;
+    bool decimals = false;
+    for (const NodeId id : operands)
+    {
+      if (!decimalValue(id, operand))
+      {
+        return false;
+      }
+      decimals |= std::holds_alternative<Decimal>(work.getLeaf(id).value);
+    }
+    if (operands.empty() || !decimalValue(operands[0], value))
+    {
+      return false;
+    }
+    switch (function)
+    {
+      case Functions::ADDITION:
+      case Functions::MULTIPLICATION:
+      for (size_t i = 1; i < operands.size(); i++)
+      {
+        decimalValue(operands[i], operand);
+        if (!(function == Functions::ADDITION ? Decimal::add(value, operand, value) : Decimal::multiply(value, operand, value)))
+        {
+          return false;
+        }
+      }
+      break;
+      case Functions::UNSUBTRACTION:
+      if (operands.size() != 1)
+      {
+        return false;
+      }
+      value = -value;
+      break;
+      case Functions::SUBTRACTION:
+      if (operands.size() != 2 || !decimalValue(operands[1], operand) || !Decimal::add(value, -operand, value))
+      {
+        return false;
+      }
+      break;
+      case Functions::DIVISION:
+      if (operands.size() != 2 || !decimalValue(operands[1], operand) || !Decimal::divide(value, operand, value))
+      {
+        return false;
+      }
+      // Integer quotients that are exact already went through foldExact
+      decimals = true;
+      break;
+      case Functions::EXPONENTIATION:
+      // Small exponents only, so that the loop stays short; larger ones overflow the significand anyway. 0^0 is left to
+      //   the kernel, which makes it UNDETERMINED
+      if (operands.size() != 2 || !decimalValue(operands[1], operand) || operand.scale() != 0 || operand.significand() < 0
+        || operand.significand() > 64 || (operand.significand() == 0 && value.significand() == 0)
+        || !Decimal::power(value, (uint32_t)operand.significand(), value))
+      {
+        return false;
+      }
+      break;
+      default:
+      return false;
+    }
+    if (!decimals)
+    {
+      return false;
+    }
+    statistics.exact++;
+    if (value.scale() == 0 && value.significand() >= INT_MIN && value.significand() <= INT_MAX)
+    {
+      result = leaf(ASTLeaf(AtomicTypes::INTEGER, (int)value.significand()));
+      return true;
+    }
+    result = leaf(ASTLeaf(AtomicTypes::REAL, value));
+    return true;
+  }
+
+  // Evaluates function over the numbers in operands, returning false if the kernel doesn't give a REAL
+  bool fold(const Functions function, double& result)
+  {
+    values.clear();
+    for (const NodeId operand : operands)
+    {
+      values.push_back({AtomicTypes::REAL, numberValue(operand)});
+    }
+    const Evaluation value = getKernel(function)(values.data(), (uint32_t)values.size());
+    result = value.value;
+    return value.type == AtomicTypes::REAL;
+  }
+
+  NodeId rewrite(const Functions function, const bool isRoot)
+  {
+    switch (function)
+    {
+      case Functions::ADDITION:
+      case Functions::MULTIPLICATION:
+      return associative(function);
+      case Functions::IDENTITY:
+      if (!isRoot && operands.size() == 1)
+      {
+        statistics.rewrites++;
+        return operands[0];
+      }
+      break;
+      case Functions::SUBTRACTION:
+      if (operands.size() == 2 && isNumber(operands[1], 0))
+      {
+        statistics.rewrites++;
+        return operands[0];
+      }
+      if (operands.size() == 2 && isNumber(operands[0], 0))
+      {
+        statistics.rewrites++;
+        operands.erase(operands.begin());
+        return rewrite(Functions::UNSUBTRACTION, isRoot);
+      }
+      break;
+      case Functions::UNSUBTRACTION:
+      if (operands.size() == 1 && isFunction(operands[0], Functions::UNSUBTRACTION))
+      {
+        statistics.rewrites++;
+        return work.getArgs(operands[0])[0];
+      }
+      break;
+      case Functions::DIVISION:
+      if (operands.size() == 2 && isNumber(operands[1], 1))
+      {
+        statistics.rewrites++;
+        return operands[0];
+      }
+      break;
+      case Functions::EXPONENTIATION:
+      if (operands.size() == 2 && isNumber(operands[1], 1))
+      {
+        statistics.rewrites++;
+        return operands[0];
+      }
+      break;
+      default:
+      break;
+    }
+    // The root identity is kept over a number as it is, since folding it would round exact literals into doubles
+    if (function != Functions::IDENTITY && !operands.empty()
+      && std::all_of(operands.begin(), operands.end(), [this](const NodeId id) { return isNumber(id); }))
+    {
+      NodeId exact;
+      if (foldExact(function, exact) || foldDecimal(function, exact))
+      {
+        statistics.folded++;
+        return exact;
+      }
+      double result;
+      if (fold(function, result))
+      {
+        statistics.folded++;
+        return number(result);
+      }
+    }
+    return node(function);
+  }
+
+  // Flattens nested applications of function, merges its numbers, drops its neutral element, and sorts its operands
+  NodeId associative(const Functions function)
+  {
+    const double neutral = function == Functions::ADDITION ? 0 : 1;
+    merged.clear();
+    size_t numbers = 0;
+    for (size_t i = 0; i < operands.size(); i++)
+    {
+      const NodeId operand = operands[i];
+      if (isFunction(operand, function) && !(keepShared && i < shared.size() && shared[i]))
+      {
+        statistics.flattened++;
+        for (const NodeId inner : work.getArgs(operand))
+        {
+          merged.push_back(inner);
+        }
+      }
+      else
+      {
+        merged.push_back(operand);
+      }
+    }
+    for (const NodeId operand : merged)
+    {
+      if (isNumber(operand))
+      {
+        numbers++;
+        if (function == Functions::MULTIPLICATION && numberValue(operand) == 0)
+        {
+          statistics.rewrites++;
+          return number(0);
+        }
+      }
+    }
+    // Numbers first, merged into one when their kernel allows it, then everything else in canonical order
+    operands.clear();
+    for (const NodeId operand : merged)
+    {
+      if (isNumber(operand))
+      {
+        operands.push_back(operand);
+      }
+    }
+    if (numbers > 1)
+    {
+      NodeId exact;
+      double result;
+      if (foldExact(function, exact) || foldDecimal(function, exact))
+      {
+        statistics.folded++;
+        operands.assign(1, exact);
+      }
+      else if (fold(function, result))
+      {
+        statistics.folded++;
+        operands.assign(1, number(result));
+      }
+    }
+    if (operands.size() == 1 && isNumber(operands[0], neutral) && merged.size() > numbers)
+    {
+      statistics.rewrites++;
+      operands.clear();
+    }
+    for (const NodeId operand : merged)
+    {
+      if (!isNumber(operand))
+      {
+        operands.push_back(operand);
+      }
+    }
+    std::sort(operands.begin(), operands.end(), [this](const NodeId a, const NodeId b) { return precedes(a, b); });
+    if (operands.empty())
+    {
+      return number(neutral);
+    }
+    if (operands.size() == 1)
+    {
+      return operands[0];
+    }
+    return node(function);
+  }
+
+  // Numbers by value, then constants, variables by name, other leaves, and function nodes by shape. The order only
+  //   depends on the operands themselves, so any permutation of them sorts the same way
+  bool precedes(const NodeId a, const NodeId b) const
+  {
+    const int rankA = rank(a), rankB = rank(b);
+    if (rankA != rankB)
+    {
+      return rankA < rankB;
+    }
+    if (rankA == 0 && numberValue(a) != numberValue(b))
+    {
+      return numberValue(a) < numberValue(b);
+    }
+    if ((rankA == 1 || rankA == 2) && std::get<int>(work.getLeaf(a).value) != std::get<int>(work.getLeaf(b).value))
+    {
+      return std::get<int>(work.getLeaf(a).value) < std::get<int>(work.getLeaf(b).value);
+    }
+    if (structure[a] != structure[b])
+    {
+      return structure[a] < structure[b];
+    }
+    return a < b;
+  }
+
+  int rank(const NodeId id) const
+  {
+    if (!work.isLeaf(id))
+    {
+      return 4;
+    }
+    if (isNumber(id))
+    {
+      return 0;
+    }
+    const ASTLeaf& value = work.getLeaf(id);
+    if (std::holds_alternative<AtomicTypes>(value.type) && std::holds_alternative<int>(value.value))
+    {
+      switch (std::get<AtomicTypes>(value.type))
+      {
+        case AtomicTypes::CONSTANT:
+        return 1;
+        case AtomicTypes::VARIABLE:
+        return 2;
+        default:
+        break;
+      }
+    }
+    return 3;
+  }
+
+  // Copies the nodes reachable from the root of work into target, keeping their relative order
+  void compact(AST& target)
+  {
+    target.clear();
+    reachable.assign(work.size(), false);
+    reachable[work.root] = true;
+    for (NodeId id = work.root+1; id-- > 0;)
+    {
+      if (reachable[id])
+      {
+        for (const NodeId child : work.getArgs(id))
+        {
+          reachable[child] = true;
+        }
+      }
+    }
+    target.reserve(work.size());
+    remap.resize(work.size());
+    for (NodeId id = 0; id <= work.root; id++)
+    {
+      if (!reachable[id])
+      {
+        continue;
+      }
+      const ASTNode& node = work.nodes[id];
+      if (node.argCount == 0 && !std::holds_alternative<Functions>(node.leaf.type))
+      {
+        remap[id] = target.addLeaf(node.leaf);
+        continue;
+      }
+      merged.clear();
+      for (const NodeId child : work.getArgs(id))
+      {
+        merged.push_back(remap[child]);
+      }
+      remap[id] = target.addNode(std::get<Functions>(node.leaf.type), merged.data(), node.argCount);
+    }
+    target.root = remap[work.root];
+  }
+};
+
+#endif
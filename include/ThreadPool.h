@@ -0,0 +1,161 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Work-stealing thread pool. Every worker owns a deque: it takes its own tasks from the back, and once it runs out
+  it steals from the front of the other deques, so a worker stuck with a slow task doesn't hold back the tasks queued
+  behind it. Tasks receive the index of the worker running them, which lets callers keep per-worker state (a Parser,
+  scratch buffers) without any locking.
+*/
+class ThreadPool
+{
+  public:
+  using Task = std::function<void(size_t worker)>;
+
+  explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency())
+  {
+    if (threadCount == 0) threadCount = 1;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+      queues.emplace_back(new Queue());
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+      threads.emplace_back(&ThreadPool::work, this, i);
+    }
+  }
+
+  // Finishes every submitted task before joining the workers
+  ~ThreadPool()
+  {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+    {
+      thread.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const
+  {
+    return threads.size();
+  }
+
+  // Tasks submitted from a worker go to its own deque, the rest are spread round-robin
+  void submit(Task task)
+  {
+    const size_t target = currentPool == this ? currentWorker : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    // Counted before the push so a worker can never take the task while the counter still excludes it
+    pending.fetch_add(1);
+    queued.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(queues[target]->mutex);
+      queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+  }
+
+  // Blocks until every submitted task has finished
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this]() { return pending.load() == 0; });
+  }
+
+  private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> nextQueue{0};
+  std::atomic<size_t> queued{0}; // Tasks waiting in any deque
+  std::atomic<size_t> pending{0}; // Tasks queued or running
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  bool stopping = false;
+
+  inline static thread_local ThreadPool* currentPool = nullptr;
+  inline static thread_local size_t currentWorker = 0;
+
+  bool take(const size_t worker, Task& task)
+  {
+    {
+      Queue& own = *queues[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+      Queue& victim = *queues[(worker+i) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(const size_t worker)
+  {
+    currentPool = this;
+    currentWorker = worker;
+    Task task;
+    while (true)
+    {
+      if (take(worker, task))
+      {
+        task(worker);
+        task = nullptr;
+        if (pending.fetch_sub(1) == 1)
+        {
+          std::lock_guard<std::mutex> lock(sleepMutex);
+          idle.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+      if (stopping && queued.load() == 0)
+      {
+        return;
+      }
+    }
+  }
+};
+
+#endif
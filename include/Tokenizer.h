@@ -0,0 +1,916 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <algorithm>
+#include <charconv>
+#include <variant>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+
+#include "AtomicTypes.h"
+#include "Functions.h"
+#include "Constants.h"
+#include "AuxiliaryTypes.h"
+#include "FunctionTypes.h"
+#include "LookupTables.h"
+#include "AST.h"
+#include "BigInteger.h"
+#include "ErrorTypes.h"
+#include "Diagnostics.h"
+#include "Trace.h"
+#include "Allocations.h"
+
+// The following four functions can be optimized and reduced to a single line if the auxiliaryTypes enumeration keeps
+//   the opening and closing characters in an alternate order: ('(',')','[',']','{','}')
+//   however this implementation was selected because it allows the header file to be organized in any way
+
+inline bool isOpeningGrouper(const AuxiliaryTypes x)
+{
+  switch(x)
+  {
+    case AuxiliaryTypes::LEFTKEY:
+    case AuxiliaryTypes::LEFTBRACKET:
+    case AuxiliaryTypes::LEFTPARENTHESIS:
+    return true;
+  }
+  return false;
+}
+
+inline bool isClosingGrouper(const AuxiliaryTypes x)
+{
+  switch(x)
+  {
+    case AuxiliaryTypes::RIGHTKEY:
+    case AuxiliaryTypes::RIGHTBRACKET:
+    case AuxiliaryTypes::RIGHTPARENTHESIS:
+    return true;
+  }
+  return false;
+}
+
+inline char getOppositeGrouper(const char c)
+{
+  switch (c)
+  {
+    case '(':
+    return ')';
+    case ')':
+    return '(';
+    case '[':
+    return ']';
+    case ']':
+    return '[';
+    case '{':
+    return '}';
+    case '}':
+    return '{';
+  }
+  throw std::invalid_argument("Argument isn't an implemented grouper");
+  return '@';
+}
+
+inline AuxiliaryTypes getOppositeGrouper(const AuxiliaryTypes x)
+{
+  switch (x)
+  {
+    case AuxiliaryTypes::LEFTPARENTHESIS:
+    return AuxiliaryTypes::RIGHTPARENTHESIS;
+    case AuxiliaryTypes::RIGHTPARENTHESIS:
+    return AuxiliaryTypes::LEFTPARENTHESIS;
+    case AuxiliaryTypes::LEFTBRACKET:
+    return AuxiliaryTypes::RIGHTBRACKET;
+    case AuxiliaryTypes::RIGHTBRACKET:
+    return AuxiliaryTypes::LEFTBRACKET;
+    case AuxiliaryTypes::LEFTKEY:
+    return AuxiliaryTypes::RIGHTKEY;
+    case AuxiliaryTypes::RIGHTKEY:
+    return AuxiliaryTypes::LEFTKEY;
+  }
+  throw std::invalid_argument("Argument isn't an implemented grouper");
+  return AuxiliaryTypes::NULLAUX;
+}
+
+class Tokenizer
+{
+  public:
+  Tokenizer() {}
+  Tokenizer(const std::string_view& input)
+  {
+    reset(input);
+  }
+
+  // Points the tokenizer to a new input. Every buffer keeps its capacity, so a warm tokenizer doesn't allocate per expression.
+  //   Each of the sorted ranges in newPlaceholders is skipped and handed out as a single NULLTYPE token holding its index
+  //   plus one, a token no input produces: ParseSession stands in this way for arguments it has already built
+  void reset(const std::string_view& newInput, const std::vector<TextRange>* newPlaceholders = nullptr)
+  {
+    input = newInput;
+    placeholders = newPlaceholders;
+    placeholder = 0;
+    pos = 0;
+    emitted = 0;
+    diagnostics.clear();
+    settled = true;
+    heldOperators.clear();
+    rowEnds.clear();
+    tokens.clear();
+    integers.clear();
+    spans.clear();
+    contexts.clear();
+    contexts.emplace_back();
+    TRACE(TraceCategories::TOKENIZE, TraceLevels::INFO, 0, "input", input);
+  }
+
+  // Pulls the next token, returning false once the input is exhausted.
+  // Tokens are handed out as soon as no pending construct can still modify them (e.g. the argument count of \gcd),
+  //   so only the window between the oldest pending construct and the current position is ever buffered.
+  // Malformed input is reported to getDiagnostics() and repaired so that groupers always come in pairs: closing groupers
+  //   that close nothing and separators outside every group are dropped, a closing grouper of the wrong type closes
+  //   the innermost group anyway, and groups still open where the input ends are closed there
+  bool next(ASTLeaf& token)
+  {
+    AllocationScope allocations(AllocationPhases::TOKENIZE);
+    while (emitted == tokens.size() || (pos < input.size() && emitted >= heldFrom()) || (pos >= input.size() && contexts.size() > 1))
+    {
+      if (pos >= input.size())
+      {
+        if (contexts.size() == 1)
+        {
+          if (contexts[0].pending == PendingConstructs::FRAC)
+          {
+            dropFrac();
+            settled = false;
+            clearPending();
+          }
+          return false;
+        }
+        const size_t opening = contexts.back().opening;
+        reportError(ErrorTypes::UNCLOSEDGROUPER, {opening, input.size()});
+        closeGroup(getOppositeGrouper(input[opening]));
+        spans.resize(tokens.size(), TextRange{input.size(), input.size()});
+        continue;
+      }
+      const size_t start = pos;
+      step();
+      spans.resize(tokens.size(), TextRange{start, pos});
+    }
+    token = tokens[emitted];
+    TRACE(TraceCategories::TOKENIZE, TraceLevels::DEBUG, emitted, "token", token.toString());
+    emitted++;
+    if (emitted == tokens.size() && emitted > 1 && heldFrom() == SIZE_MAX)
+    {
+      // Everything was handed out and nothing refers back to the buffer: keep only the last token, which the
+      //   tokenizer still inspects to insert implicit multiplications and unary subtractions
+      tokens[0] = tokens.back();
+      tokens.resize(1);
+      spans[0] = spans.back();
+      spans.resize(1);
+      emitted = 1;
+    }
+    return true;
+  }
+
+  // Characters of the input the last token handed out was read from. Tokens the tokenizer inserts (implicit
+  //   multiplications, the division of \frac, closing groupers it adds) share the span of the token that caused them
+  TextRange getSpan() const
+  {
+    return spans[emitted-1];
+  }
+
+  // Every error found in the current input so far, each with the characters it is about
+  const Diagnostics& getDiagnostics() const
+  {
+    return diagnostics;
+  }
+
+  // Error found earliest in the current input, NULLERROR if there is none
+  ErrorTypes getError() const
+  {
+    return diagnostics.first();
+  }
+
+  size_t getErrorPosition() const
+  {
+    return diagnostics.empty() ? 0 : diagnostics[0].span.begin;
+  }
+
+  // Positions of the operator characters read while a construct of their level was still pending, e.g. the + of
+  //   \frac 1+(2)3, after which (2)3 reads as a division. The text on either side of them does not tokenize on its own
+  const std::vector<size_t>& getHeldOperators() const
+  {
+    return heldOperators;
+  }
+
+  // Whether no construct was left waiting for more input where its level ended: at a separator or a closing grouper
+  //   of that level, or at the end of the input. Then every argument between groupers and separators tokenizes the
+  //   same on its own as inside the whole input
+  bool isSettled() const
+  {
+    return settled && contexts.size() == 1 && contexts[0].pending == PendingConstructs::NONE;
+  }
+
+  // Materializes the whole token stream of the current input
+  std::vector<ASTLeaf> Tokenize()
+  {
+    std::vector<ASTLeaf> result;
+    result.reserve(input.size()/5);
+    ASTLeaf token;
+    while (next(token))
+    {
+      result.emplace_back(token);
+    }
+    return result;
+  }
+
+  class iterator
+  {
+    public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = ASTLeaf;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ASTLeaf*;
+    using reference = const ASTLeaf&;
+
+    iterator() {}
+    iterator(Tokenizer* tokenizer) : tokenizer(tokenizer)
+    {
+      ++*this;
+    }
+    const ASTLeaf& operator*() const
+    {
+      return current;
+    }
+    const ASTLeaf* operator->() const
+    {
+      return &current;
+    }
+    iterator& operator++()
+    {
+      if (!tokenizer->next(current))
+      {
+        tokenizer = nullptr;
+      }
+      return *this;
+    }
+    bool operator==(const iterator& other) const
+    {
+      return tokenizer == other.tokenizer;
+    }
+    bool operator!=(const iterator& other) const
+    {
+      return tokenizer != other.tokenizer;
+    }
+
+    private:
+    Tokenizer* tokenizer = nullptr;
+    ASTLeaf current;
+  };
+
+  // Single-pass range over the remaining tokens: for (const ASTLeaf& token : tokenizer)
+  iterator begin()
+  {
+    return iterator(this);
+  }
+  iterator end()
+  {
+    return iterator();
+  }
+
+  private:
+  std::string_view input;
+  // Tokens that were produced but not handed out yet (plus the last handed out one), from index emitted onwards
+  std::vector<ASTLeaf> tokens;
+  std::vector<TextRange> spans; // One per token
+  // Values of the big integer tokens of the current input, which ASTs copy when they add them
+  std::vector<std::unique_ptr<BigInteger>> integers;
+  size_t emitted = 0;
+  // Constructs that still have to modify one of their tokens once later characters are read
+  enum class PendingConstructs : uint8_t
+  {
+    NONE,
+    BIGOPERATOR, // Counts its scripts until its content group opens
+    MULTIARGUMENT, // Counts its arguments (and rows for matrices) until its group closes
+    INTERVAL, // Encodes the type of its ends when its group opens and closes
+    FRAC, // Inserts a division when its numerator group closes
+  };
+
+  // One entry per open grouper level: contexts[0] is the top level and contexts.back() the innermost open group.
+  //   Depth only moves one level at a time, so the entries form a stack that is reused between inputs
+  struct DepthContext
+  {
+    PendingConstructs pending = PendingConstructs::NONE;
+    size_t token = 0; // Position of the token the pending construct modifies
+    size_t heldFrom = SIZE_MAX; // Oldest token any construct up to this level may still modify
+    size_t opening = 0; // Position of the grouper that opened this level
+    size_t groups = 0; // Argument groups the last function of this level still takes, e.g. two right after \choose
+    size_t command = 0; // Where the \frac waiting for its numerator group starts
+  };
+  std::vector<DepthContext> contexts = std::vector<DepthContext>(1);
+
+  // A semicolon of a matrix group: the token it became and the elements of the matrix before it
+  struct RowEnd
+  {
+    size_t token;
+    size_t elements;
+  };
+  std::vector<RowEnd> rowEnds; // Of the matrix groups still open, innermost last
+
+  Diagnostics diagnostics;
+  bool settled = true;
+  std::vector<size_t> heldOperators;
+
+  const std::vector<TextRange>* placeholders = nullptr;
+  size_t placeholder = 0; // Next range of placeholders
+
+  size_t pos = 0;
+
+  // Consumes the construct starting at the current character, producing zero or more tokens
+  void step()
+  {
+    TRACE(TraceCategories::TOKENIZE, TraceLevels::VERBOSE, pos, "character", input.substr(pos, 1));
+    if (Trace::enabled(TraceCategories::TOKENIZE, TraceLevels::VERBOSE))
+    {
+      // Dumping the lookups costs O(depth) per character, so it is reserved for the most detailed level
+      traceLookups();
+    }
+    if (placeholders && placeholder < placeholders->size() && (*placeholders)[placeholder].begin == pos)
+    {
+      tokens.emplace_back(AtomicTypes::NULLTYPE, (int)placeholder+1);
+      pos = (*placeholders)[placeholder++].end;
+      return;
+    }
+    const char& current = input[pos];
+    if (current != '\\' && current != ' ' && getGrouper(current) == AuxiliaryTypes::NULLAUX)
+    {
+      // Any other token between the groups of a function ends its arguments, e.g. \sin x (y)
+      contexts.back().groups = 0;
+    }
+    if (current == '\\')
+    {
+      parseCommand();
+    } else if (getGrouper(current) != AuxiliaryTypes::NULLAUX) {
+      switch (current)
+      {
+        case '(':
+        case '[':
+        case '{':
+        // The groups of a big operator before its content are its scripts
+        if (contexts.back().pending != PendingConstructs::BIGOPERATOR)
+        {
+          multiplyImplicitly();
+        }
+        switch (contexts.back().pending)
+        {
+          case PendingConstructs::BIGOPERATOR:
+          // Having a closing character before the opening character while having to complete a large operator must mean that the following group introduces
+          //   the big operator's expression, therefore the lookup shall be removed
+          if (tokens.back().type.index() == 2 && std::get<AuxiliaryTypes>(tokens.back().type) == AuxiliaryTypes::RIGHTKEY)
+          {
+            TRACE(TraceCategories::TOKENIZE, TraceLevels::DEBUG, pos, "big operator content", std::to_string(contexts.size()-1));
+            clearPending();
+          }
+          break;
+          case PendingConstructs::INTERVAL:
+          // The grouper opening the interval sets its left end
+          TRACE(TraceCategories::TOKENIZE, TraceLevels::DEBUG, pos, "interval opening", std::to_string(contexts.size()-1));
+          if (current == '(')
+          {
+            std::get<int>(tokens[contexts.back().token].value)+=2;
+          }
+          break;
+          default:
+          break;
+        }
+        contexts.push_back({PendingConstructs::NONE, 0, contexts.back().heldFrom, pos});
+        break;
+        case ')':
+        case ']':
+        case '}':
+        if (contexts.size() == 1)
+        {
+          // Nothing to close: the grouper is dropped so the rest of the input can still be tokenized
+          reportError(ErrorTypes::UNBALANCEDGROUPER, {pos, pos+1});
+          pos++;
+          return;
+        }
+        closeGroup(current);
+        pos++;
+        return;
+      }
+      tokens.emplace_back(ASTLeaf(getGrouper(current)));
+      pos++;
+    } else if (std::isdigit((unsigned char)current)||current == '.') {
+      // A number right after another atomic type is left alone, since 1 2 means nothing
+      if (!tokens.empty() && !std::holds_alternative<AtomicTypes>(tokens.back().type))
+      {
+        multiplyImplicitly();
+      }
+      tokens.emplace_back(parseNumber());
+    } else if (std::isalpha((unsigned char)current)) {
+      tokens.emplace_back(parseVariable());
+    } else if (getOperator(current) != Functions::NULLOPERATOR) {
+      if (contexts.back().pending != PendingConstructs::NONE)
+      {
+        heldOperators.push_back(pos);
+      }
+      // Hard code unary subtraction
+      if (current == '-')
+      {
+        if (tokens.empty() || tokens.back().type.index() == 2 && (std::get<AuxiliaryTypes>(tokens.back().type) == AuxiliaryTypes::COMMA || isOpeningGrouper(std::get<AuxiliaryTypes>(tokens.back().type))) || tokens.back().type.index() == 1 && !(getFunctionType(std::get<Functions>(tokens.back().type)) == FunctionTypes::UNARYRIGHT))
+        {
+          tokens.emplace_back(ASTLeaf(Functions::UNSUBTRACTION));
+          pos++;
+          return;
+        }
+      }
+      else if (current == '^')
+      {
+        // Check if ^ is used to express the superscript of a big operator
+        if (contexts.back().pending == PendingConstructs::BIGOPERATOR)
+        {
+          tokens[contexts.back().token].value = 2;
+          tokens.emplace_back(AuxiliaryTypes::SUPERSCRIPT);
+          pos++;
+          return;
+        }
+      }
+      tokens.emplace_back(ASTLeaf(getOperator(current)));
+      pos++;
+    } else if (current == '_') {
+      // Check if _ is used to express the subscript of a big operator
+      if (contexts.back().pending == PendingConstructs::BIGOPERATOR)
+      {
+        tokens[contexts.back().token].value = 1;
+        tokens.emplace_back(AuxiliaryTypes::SUBSCRIPT);
+        pos++;
+        return;
+      }
+      // Subscripts only belong to big operators: dropped, so that what follows still parses
+      reportError(ErrorTypes::MISSINGOPERAND, {pos, pos+1});
+      pos++;
+    } else if (isEmpty()) {
+      consumeEmpty();
+    } else if (current == ',' || current == ';') {
+      if (contexts.size() == 1)
+      {
+        // Separates nothing: dropped like a closing grouper without its opening one
+        reportError(ErrorTypes::STRAYSEPARATOR, {pos, pos+1});
+        pos++;
+        return;
+      }
+      settled = settled && contexts.back().pending == PendingConstructs::NONE;
+      if (current == ',')
+      {
+        // Add up the counter of arguments of a multi-argument operator when finding a comma
+        if (const DepthContext* owner = groupOwner())
+        {
+          std::get<int>(tokens[owner->token].value)++;
+        }
+      }
+      else if (const DepthContext* owner = groupOwner())
+      {
+        // Semicolons separate the rows of a matrix, whose row counter follows the operator token. In the group of
+        //   another multi-argument operator they are plain commas
+        if (getFunctionType(std::get<Functions>(tokens[owner->token].type)) == FunctionTypes::MATRIXARGUMENTS)
+        {
+          rowEnds.push_back({tokens.size(), (size_t)std::get<int>(tokens[owner->token].value)+1});
+          std::get<int>(tokens[owner->token+1].value)++;
+        }
+        std::get<int>(tokens[owner->token].value)++;
+      }
+      // Shortcut: commas have the same sintactic and semantic meaning as semicolons
+      tokens.emplace_back(AuxiliaryTypes::COMMA);
+      pos++;
+    } else {
+      // Skipped whole, continuation bytes of a multibyte UTF-8 character included
+      const size_t start = pos;
+      do
+      {
+        pos++;
+      } while (pos < input.size() && ((unsigned char)input[pos] & 0xC0) == 0x80);
+      reportError(ErrorTypes::UNIDENTIFIEDCHARACTER, {start, pos});
+    }
+  }
+
+  // Leaves the innermost level with the given closing grouper, completing the construct that owns the group
+  void closeGroup(char closer)
+  {
+    if (contexts.back().pending != PendingConstructs::NONE)
+    {
+      settled = false;
+    }
+    dropFrac();
+    const size_t opening = contexts.back().opening;
+    // The level is left before checking it, since the construct owning this group lives in the enclosing level
+    contexts.pop_back();
+    if (contexts.back().groups > 0)
+    {
+      contexts.back().groups--;
+    }
+    // Only intervals may close with another type of grouper, e.g. [0,1)
+    if (closer != getOppositeGrouper(input[opening]) && contexts.back().pending != PendingConstructs::INTERVAL)
+    {
+      reportError(ErrorTypes::MISMATCHEDGROUPER, {opening, pos+1});
+      closer = getOppositeGrouper(input[opening]);
+    }
+    switch (contexts.back().pending)
+    {
+      case PendingConstructs::MULTIARGUMENT:
+      // A closing grouper at the corresponding level as an opening grouper that came after a multiArgumentOperator must close this operator:
+      // e.g. --> gcd(a,b,c)
+      //             └─────┴─── These parentheses are in the same level so they limit the amount of arguments
+      if (getFunctionType(std::get<Functions>(tokens[contexts.back().token].type)) == FunctionTypes::MATRIXARGUMENTS)
+      {
+        squareRows(opening);
+      }
+      clearPending();
+      break;
+      case PendingConstructs::INTERVAL:
+      // The grouper closing the interval sets its right end
+      TRACE(TraceCategories::TOKENIZE, TraceLevels::DEBUG, pos, "interval closing", std::to_string(contexts.size()-1));
+      if (closer == ')')
+      {
+        ++std::get<int>(tokens[contexts.back().token].value);
+      }
+      clearPending();
+      break;
+      case PendingConstructs::FRAC:
+      tokens.emplace_back(ASTLeaf(getGrouper(closer)));
+      tokens.emplace_back(ASTLeaf(Functions::DIVISION));
+      clearPending();
+      return;
+      default:
+      break;
+    }
+    tokens.emplace_back(ASTLeaf(getGrouper(closer)));
+  }
+
+  // Pads every row of the matrix whose group is closing up to the length of the longest one, with missing operands
+  //   where the row ends, so that each row keeps its own elements: \matrix(1,2;3) as [[1,2],[3,?]]. Its tokens are
+  //   all still buffered, since the matrix holds them until its group closes
+  void squareRows(const size_t opening)
+  {
+    const size_t matrix = contexts.back().token;
+    size_t first = rowEnds.size();
+    while (first > 0 && rowEnds[first-1].token > matrix)
+    {
+      first--;
+    }
+    const size_t elements = (size_t)std::get<int>(tokens[matrix].value)+1;
+    const auto rowLength = [&](const size_t row)
+    {
+      return (row < rowEnds.size() ? rowEnds[row].elements : elements)-(row > first ? rowEnds[row-1].elements : 0);
+    };
+    size_t columns = 0;
+    size_t padding = 0;
+    for (size_t row = first; row <= rowEnds.size(); row++)
+    {
+      columns = std::max(columns, rowLength(row));
+    }
+    for (size_t row = first; row <= rowEnds.size(); row++)
+    {
+      padding += columns-rowLength(row);
+    }
+    if (padding == 0)
+    {
+      rowEnds.resize(first);
+      return;
+    }
+    reportError(ErrorTypes::JAGGEDMATRIX, {opening, std::min(pos+1, input.size())});
+    // Every row end moves once, from the last one to the first, leaving room for the padding in front of it
+    spans.resize(tokens.size(), TextRange{pos, pos});
+    size_t source = tokens.size();
+    tokens.resize(tokens.size()+2*padding, ASTLeaf(AuxiliaryTypes::COMMA));
+    spans.resize(tokens.size());
+    size_t target = tokens.size();
+    for (size_t row = rowEnds.size()+1; row-- > first;)
+    {
+      const size_t end = row < rowEnds.size() ? rowEnds[row].token : source;
+      while (source > end)
+      {
+        source--;
+        target--;
+        tokens[target] = tokens[source];
+        spans[target] = spans[source];
+      }
+      const TextRange at = row < rowEnds.size() ? TextRange{spans[target].begin, spans[target].begin} : TextRange{pos, pos};
+      for (size_t column = rowLength(row); column < columns; column++)
+      {
+        tokens[--target] = ASTLeaf(AtomicTypes::NULLTYPE);
+        spans[target] = at;
+        tokens[--target] = ASTLeaf(AuxiliaryTypes::COMMA);
+        spans[target] = at;
+      }
+    }
+    std::get<int>(tokens[matrix].value) += (int)padding;
+    rowEnds.resize(first);
+  }
+
+  // Index of the oldest token a pending construct may still modify, SIZE_MAX if there is none
+  size_t heldFrom() const
+  {
+    return contexts.back().heldFrom;
+  }
+
+  size_t heldBelow() const
+  {
+    return contexts.size() > 1 ? contexts[contexts.size()-2].heldFrom : SIZE_MAX;
+  }
+
+  void setPending(const PendingConstructs construct, const size_t token)
+  {
+    dropFrac();
+    DepthContext& context = contexts.back();
+    context.pending = construct;
+    context.token = token;
+    // \frac only inserts tokens, it never modifies an existing one
+    context.heldFrom = construct == PendingConstructs::FRAC ? heldBelow() : std::min(token, heldBelow());
+  }
+
+  // A \frac of this level still waiting for its numerator group where the level ends or another construct takes over
+  //   gets no arguments at all, and builds nothing
+  void dropFrac()
+  {
+    if (contexts.back().pending == PendingConstructs::FRAC)
+    {
+      const size_t command = contexts.back().command;
+      reportError(ErrorTypes::MISSINGOPERAND, {command, command+5});
+    }
+  }
+
+  void clearPending()
+  {
+    DepthContext& context = contexts.back();
+    context.pending = PendingConstructs::NONE;
+    context.heldFrom = heldBelow();
+  }
+
+  // Whether the last token completes an operand, so that an operand starting right after it is multiplied by it, as in
+  //   2x, (a+b)(a-b) or \sin(x)\cos(x). A group is no operand while its function still takes more of them (\sqrt[3]{x},
+  //   \choose{n}{k}, the row counter of \matrix before its group), and neither are the scripts of a big operator
+  bool endsOperand() const
+  {
+    if (tokens.empty())
+    {
+      return false;
+    }
+    const ASTLeaf& last = tokens.back();
+    switch (last.type.index())
+    {
+      case 0:
+      return contexts.back().groups == 0;
+      case 1:
+      return getFunctionType(std::get<Functions>(last.type)) == FunctionTypes::UNARYRIGHT;
+      case 2:
+      return isClosingGrouper(std::get<AuxiliaryTypes>(last.type)) && contexts.back().groups == 0
+        && contexts.back().pending != PendingConstructs::BIGOPERATOR;
+    }
+    return false;
+  }
+
+  void multiplyImplicitly()
+  {
+    if (endsOperand())
+    {
+      tokens.emplace_back(Functions::MULTIPLICATION);
+    }
+  }
+
+  // Argument groups a prefix function reads after its token, e.g. two for \choose{n}{k} and \sqrt[3]{x}. Big operators
+  //   count only their content, since their scripts never end an operand
+  static size_t getArgumentGroups(const Functions function, const ASTLeaf& token)
+  {
+    if (isInfix(function))
+    {
+      return 0;
+    }
+    switch (getFunctionType(function))
+    {
+      case FunctionTypes::UNARYLEFT:
+      case FunctionTypes::BIGOPERATOR:
+      case FunctionTypes::ARRAYARGUMENTS:
+      case FunctionTypes::MATRIXARGUMENTS:
+      case FunctionTypes::INTERVAL:
+      return 1;
+      case FunctionTypes::BINARY:
+      return 2;
+      case FunctionTypes::OPTIONALARGUMENTS:
+      return (size_t)std::get<int>(token.value)+1;
+      default:
+      return 0;
+    }
+  }
+
+  // Multi-argument operator owning the group at the current level, if any
+  const DepthContext* groupOwner() const
+  {
+    if (contexts.size() > 1 && contexts[contexts.size()-2].pending == PendingConstructs::MULTIARGUMENT)
+    {
+      return &contexts[contexts.size()-2];
+    }
+    return nullptr;
+  }
+
+  void reportError(const ErrorTypes type, const TextRange span)
+  {
+    TRACE(TraceCategories::TOKENIZE, TraceLevels::FAILURE, span.begin, "error", getName(type));
+    diagnostics.report(type, span);
+  }
+
+  void traceLookups() const
+  {
+    for (size_t level = 0; level < contexts.size(); level++)
+    {
+      const DepthContext& context = contexts[level];
+      if (context.pending != PendingConstructs::NONE)
+      {
+        Trace::emit(TraceCategories::TOKENIZE, TraceLevels::VERBOSE, pos, "pending construct", std::to_string(level) + " " + std::to_string((int)context.pending) + " " + std::to_string(context.token));
+      }
+    }
+  }
+
+  bool isEmpty()
+  {
+    return pos < input.size() && input[pos] == ' ';
+  }
+
+  void consumeEmpty()
+  {
+    while (isEmpty())
+    {
+      pos++;
+    }
+  }
+
+  void parseCommand() {
+    size_t startPos = ++pos;
+    while (pos < input.size() && std::isalnum((unsigned char)input[pos])) {
+      pos++;
+    }
+    std::string_view command(input.data() + startPos, pos - startPos);
+    TRACE(TraceCategories::TOKENIZE, TraceLevels::DEBUG, startPos, "command", command);
+    const Functions func = findCommand(command);
+    const Constants constant = func == Functions::NULLOPERATOR ? findConstant(command) : Constants::NULLCONST;
+    if (func != Functions::NULLOPERATOR)
+    {
+      // Add a * if the token before the function ends an operand, unless the function takes it as its left operand
+      if (!isInfix(func))
+      {
+        multiplyImplicitly();
+      }
+      switch(getFunctionType(func))
+      {
+        case FunctionTypes::BIGOPERATOR:
+        consumeEmpty();
+        if (pos < input.size() && isOpeningGrouper(getGrouper(input[pos])))
+        {
+          // Big operator instantly followed by a '{': there are no scripts to count
+          tokens.emplace_back(func);
+          break;
+        }
+        // Track the position of the big operator to modify its value later according to the amount of arguments
+        setPending(PendingConstructs::BIGOPERATOR, tokens.size());
+        tokens.emplace_back(func);
+        break;
+        case FunctionTypes::OPTIONALARGUMENTS:
+        consumeEmpty();
+        if (pos < input.size() && input[pos] == '[')
+        {
+          tokens.emplace_back(func,1);
+        }
+        else
+        {
+          tokens.emplace_back(func);
+        }
+        break;
+        case FunctionTypes::ARRAYARGUMENTS:
+        // Track the position of the multi-argument operator to modify its value later according to the amount of arguments
+        setPending(PendingConstructs::MULTIARGUMENT, tokens.size());
+        tokens.emplace_back(func);
+        break;
+        case FunctionTypes::MATRIXARGUMENTS:
+        // Track the position of the multi-argument operator to modify its value later according to the amount of columns
+        setPending(PendingConstructs::MULTIARGUMENT, tokens.size());
+        tokens.emplace_back(func);
+        // Adds an extra number that keeps track of the amount of rows
+        tokens.emplace_back(AtomicTypes::INTEGER);
+        break;
+        case FunctionTypes::INTERVAL:
+        consumeEmpty();
+        setPending(PendingConstructs::INTERVAL, tokens.size());
+        tokens.emplace_back(func);
+        break;
+        default:
+        tokens.emplace_back(func);
+        break;
+      }
+      contexts.back().groups = getArgumentGroups(func, tokens.back());
+    }
+    else if (constant != Constants::NULLCONST)
+    {
+      // A constant next to an operand means multiplication
+      multiplyImplicitly();
+      contexts.back().groups = 0;
+      tokens.emplace_back(constant);
+    } else if (command == "frac") {
+      multiplyImplicitly();
+      setPending(PendingConstructs::FRAC, tokens.size());
+      contexts.back().command = startPos-1;
+    } else if (command == "cdot") {
+      contexts.back().groups = 0;
+      tokens.emplace_back(Functions::MULTIPLICATION);
+    } else {
+      // Dropped, so that its arguments still parse, e.g. \ln(x) as (x)
+      reportError(ErrorTypes::UNKNOWNCOMMAND, {startPos-1, pos});
+    }
+  }
+
+  ASTLeaf parseVariable()
+  {
+    const char &current = input[pos];
+    pos++;
+    // A variable next to an operand means multiplication
+    multiplyImplicitly();
+    return ASTLeaf(AtomicTypes::VARIABLE,(int)current);
+  }
+
+  // Integers become ints, int64_t values past INT_MAX, and big integers only past 64 bits. Decimals keep their exact
+  //   value as a Decimal when it fits one and are rounded once into a double otherwise. Nothing here allocates or
+  //   throws unless a literal is too large for 64 bits
+  ASTLeaf parseNumber() {
+    const size_t startPos = pos;
+    size_t point = std::string_view::npos;
+    while (pos < input.size() && (std::isdigit((unsigned char)input[pos]) || (input[pos] == '.' && point == std::string_view::npos))) {
+      if (input[pos] == '.')
+      {
+        point = pos;
+      }
+      pos++;
+    }
+    const std::string_view number(input.data() + startPos, pos - startPos);
+    if (pos < input.size() && input[pos] == '.')
+    {
+      // A second decimal point, e.g. 1.2.3: the rest of the run is skipped
+      while (pos < input.size() && (std::isdigit((unsigned char)input[pos]) || input[pos] == '.'))
+      {
+        pos++;
+      }
+      reportError(ErrorTypes::MALFORMEDNUMBER, {startPos, pos});
+    }
+    if (point == std::string_view::npos)
+    {
+      int small;
+      const auto [end, status] = std::from_chars(number.data(), number.data() + number.size(), small);
+      if (status == std::errc() && end == number.data() + number.size())
+      {
+        return ASTLeaf(AtomicTypes::INTEGER, small);
+      }
+      int64_t large;
+      if (std::from_chars(number.data(), number.data() + number.size(), large).ec == std::errc())
+      {
+        return ASTLeaf(AtomicTypes::INTEGER, large);
+      }
+      integers.push_back(std::make_unique<BigInteger>());
+      BigInteger::parse(number, *integers.back());
+      return ASTLeaf(AtomicTypes::INTEGER, integers.back().get());
+    }
+    if (number.size() == 1)
+    {
+      reportError(ErrorTypes::MALFORMEDNUMBER, {startPos, pos});
+      return ASTLeaf(AtomicTypes::UNDEFINED);
+    }
+    // Trailing zeros of the fraction don't change the value, and leading zeros don't change the significand
+    size_t last = number.size();
+    while (last > point - startPos + 1 && number[last-1] == '0')
+    {
+      last--;
+    }
+    int64_t significand = 0;
+    bool exact = true;
+    for (size_t i = 0; i < last && exact; i++)
+    {
+      if (number[i] != '.')
+      {
+        significand = significand*10 + (number[i]-'0');
+        exact = significand < Decimal::significandLimit;
+      }
+    }
+    const uint32_t scale = (uint32_t)(last - (point - startPos) - 1);
+    Decimal decimal;
+    if (exact && Decimal::make(significand, scale, decimal))
+    {
+      return ASTLeaf(AtomicTypes::REAL, decimal);
+    }
+    double value = 0;
+    std::from_chars(number.data(), number.data() + number.size(), value);
+    return ASTLeaf(AtomicTypes::REAL, value);
+  }
+
+};
+
+#endif
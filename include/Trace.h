@@ -0,0 +1,198 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+// Tracing is compiled in for debug builds and compiled out (every TRACE expands to dead code) when NDEBUG is defined.
+//   Defining MATHSOLVER_TRACE as 0 or 1 overrides that default
+#ifndef MATHSOLVER_TRACE
+#ifdef NDEBUG
+#define MATHSOLVER_TRACE 0
+#else
+#define MATHSOLVER_TRACE 1
+#endif
+#endif
+
+enum class TraceLevels
+{
+  NONE,
+  FAILURE,
+  INFO,
+  DEBUG,
+  VERBOSE, // Dumps whole internal states, only meant for short inputs
+};
+
+// Categories are bit flags so any combination of them can be enabled at once
+enum class TraceCategories : uint8_t
+{
+  TOKENIZE = 1,
+  SHUNTINGYARD = 2,
+  ASTBUILD = 4,
+  SERIALIZE = 8,
+};
+
+struct TraceRecord
+{
+  TraceCategories category;
+  TraceLevels level;
+  size_t position; // Character position for the tokenizer, token position for the later stages
+  std::string_view event;
+  std::string_view detail;
+};
+
+using TraceSink = void (*)(const TraceRecord& record, void* userData);
+
+class Trace
+{
+  public:
+  static constexpr bool compiled = MATHSOLVER_TRACE;
+
+  static bool enabled(const TraceCategories category, const TraceLevels level)
+  {
+    return compiled && (categories & (uint8_t)category) && level <= maxLevel;
+  }
+
+  static void emit(const TraceCategories category, const TraceLevels level, const size_t position, const std::string_view event, const std::string_view detail = {})
+  {
+    sink(TraceRecord{category, level, position, event, detail}, sinkData);
+  }
+
+  static void enable(const TraceCategories category, const TraceLevels level = TraceLevels::DEBUG)
+  {
+    categories |= (uint8_t)category;
+    maxLevel = level;
+  }
+
+  static void disable()
+  {
+    categories = 0;
+    maxLevel = TraceLevels::NONE;
+  }
+
+  // Passing a null sink restores the default one, which writes a JSON line per record to the FILE* given as user data (stderr if none)
+  static void setSink(const TraceSink newSink, void* userData = nullptr)
+  {
+    sink = newSink ? newSink : writeJSONLine;
+    sinkData = userData;
+  }
+
+  // Parses specifications like "tokenize,shunting-yard:verbose" or "all:debug"; the level defaults to debug
+  static bool configure(std::string_view specification)
+  {
+    TraceLevels level = TraceLevels::DEBUG;
+    size_t colon = specification.find(':');
+    if (colon != std::string_view::npos)
+    {
+      std::string_view levelName = specification.substr(colon + 1);
+      if (levelName == "failure") level = TraceLevels::FAILURE;
+      else if (levelName == "info") level = TraceLevels::INFO;
+      else if (levelName == "debug") level = TraceLevels::DEBUG;
+      else if (levelName == "verbose") level = TraceLevels::VERBOSE;
+      else return false;
+      specification = specification.substr(0, colon);
+    }
+    uint8_t selected = 0;
+    while (!specification.empty())
+    {
+      size_t comma = specification.find(',');
+      std::string_view name = specification.substr(0, comma);
+      if (name == "tokenize") selected |= (uint8_t)TraceCategories::TOKENIZE;
+      else if (name == "shunting-yard") selected |= (uint8_t)TraceCategories::SHUNTINGYARD;
+      else if (name == "ast") selected |= (uint8_t)TraceCategories::ASTBUILD;
+      else if (name == "serialize") selected |= (uint8_t)TraceCategories::SERIALIZE;
+      else if (name == "all") selected = 0xFF;
+      else return false;
+      specification = comma == std::string_view::npos ? std::string_view() : specification.substr(comma + 1);
+    }
+    categories = selected;
+    maxLevel = level;
+    return true;
+  }
+
+  static std::string_view categoryName(const TraceCategories category)
+  {
+    switch (category)
+    {
+      case TraceCategories::TOKENIZE:
+      return "tokenize";
+      case TraceCategories::SHUNTINGYARD:
+      return "shunting-yard";
+      case TraceCategories::ASTBUILD:
+      return "ast";
+      case TraceCategories::SERIALIZE:
+      return "serialize";
+    }
+    return "unknown";
+  }
+
+  static std::string_view levelName(const TraceLevels level)
+  {
+    switch (level)
+    {
+      case TraceLevels::NONE:
+      return "none";
+      case TraceLevels::FAILURE:
+      return "failure";
+      case TraceLevels::INFO:
+      return "info";
+      case TraceLevels::DEBUG:
+      return "debug";
+      case TraceLevels::VERBOSE:
+      return "verbose";
+    }
+    return "unknown";
+  }
+
+  static void writeJSONLine(const TraceRecord& record, void* userData)
+  {
+    FILE* file = userData ? (FILE*)userData : stderr;
+    std::string_view category = categoryName(record.category);
+    std::string_view level = levelName(record.level);
+    std::fprintf(file, "{\"category\":\"%.*s\",\"level\":\"%.*s\",\"position\":%zu,\"event\":\"", (int)category.size(), category.data(), (int)level.size(), level.data(), record.position);
+    writeEscaped(file, record.event);
+    std::fputs("\",\"detail\":\"", file);
+    writeEscaped(file, record.detail);
+    std::fputs("\"}\n", file);
+  }
+
+  private:
+  inline static uint8_t categories = 0;
+  inline static TraceLevels maxLevel = TraceLevels::NONE;
+  inline static TraceSink sink = writeJSONLine;
+  inline static void* sinkData = nullptr;
+
+  static void writeEscaped(FILE* file, const std::string_view text)
+  {
+    for (const char c : text)
+    {
+      if (c == '"' || c == '\\')
+      {
+        std::fputc('\\', file);
+        std::fputc(c, file);
+      }
+      else if ((unsigned char)c < 0x20)
+      {
+        std::fprintf(file, "\\u%04x", (unsigned)c);
+      }
+      else
+      {
+        std::fputc(c, file);
+      }
+    }
+  }
+};
+
+// The detail argument is only evaluated when the record is actually emitted, so it may build strings freely
+#define TRACE(category, level, position, event, detail) \
+  do \
+  { \
+    if (Trace::enabled(category, level)) \
+    { \
+      Trace::emit(category, level, position, event, detail); \
+    } \
+  } while (false)
+
+#endif
@@ -0,0 +1,249 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../include/Parser.h"
+#include "../include/Evaluator.h"
+#include "../include/Bytecode.h"
+#include "../include/BatchEvaluator.h"
+#include "../include/Gradient.h"
+#include "../include/Differentiator.h"
+
+// Compares tree-walking evaluation, compiled bytecode and batched column evaluation over the same variable assignments,
+//   and times the gradient of every expression in forward and reverse mode.
+//   Every timing is single-threaded, so the batch throughput is per core
+//   Usage: Benchmark [assignments] [expression ...]
+
+static const char* defaultExpressions[] = {
+  "x+y",
+  "3x^2+2x y-\\frac{y}{2}+1",
+  "\\sin{x}*\\cos{y}+\\sqrt{x^2+y^2}",
+  "\\frac{1+2*3}{4}*x+\\frac{\\pi}{2}*y-\\log{10}",
+  "(x+1)*(x+2)*(x+3)*(x+4)*(x+5)*(x+6)*(x+7)*(x+8)",
+  "\\abs{x-y}+\\gcd(12,18)*x-5!/y",
+};
+
+template <typename Evaluate>
+static double measure(const size_t assignments, Bindings& bindings, double& checksum, Evaluate&& evaluate)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < assignments; i++)
+  {
+    bindings.set('x', 0.001*(double)i);
+    bindings.set('y', 1+0.0005*(double)i);
+    const Evaluation value = evaluate();
+    checksum += value.isError() ? 0 : value.value;
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now()-start;
+  return elapsed.count()/(double)assignments;
+}
+
+// Evaluates nodes with more operands than 16 bits can count, a \gcd as parsed and a sum as the simplifier flattens it,
+//   through the evaluator, the bytecode and the batch evaluator at a few assignments. Returns the number of results that
+//   differ from the evaluator's
+static size_t checkWideNodes(Parser& parser)
+{
+  constexpr size_t width = 70000;
+  std::string gcd = "\\gcd(1";
+  for (size_t i = 1; i < width; i++)
+  {
+    gcd += ",x";
+  }
+  gcd += ')';
+  AST sum;
+  const NodeId x = sum.addLeaf(ASTLeaf(AtomicTypes::VARIABLE, (int)'x'));
+  const std::vector<NodeId> terms(width, x);
+  sum.root = sum.addNode(Functions::ADDITION, terms.data(), (uint32_t)terms.size());
+
+  Evaluator evaluator;
+  BytecodeCompiler compiler;
+  BytecodeInterpreter interpreter;
+  BatchEvaluator batchEvaluator;
+  Bindings bindings;
+  const double xs[] = {1, 2.5, 6};
+  double value;
+  AtomicTypes type;
+  size_t mismatches = 0;
+  for (const AST& ast : {AST(parser.Parse(gcd)), sum})
+  {
+    const Bytecode bytecode = compiler.compile(ast);
+    for (const double at : xs)
+    {
+      bindings.set('x', at);
+      BatchBindings columns;
+      columns.set('x', &at);
+      const Evaluation tree = evaluator.evaluate(ast, bindings);
+      const Evaluation compiled = interpreter.run(bytecode, bindings);
+      batchEvaluator.evaluate(bytecode, columns, 1, &value, &type);
+      mismatches += compiled.type != tree.type || (!tree.isError() && compiled.value != tree.value);
+      mismatches += type != tree.type || (!tree.isError() && value != tree.value);
+    }
+  }
+  return mismatches;
+}
+
+// Derives a product of 64 factors up to the fourth order. Every order must stay within a constant factor of the first
+//   one for each order taken, as a DAG that keeps its shared products does. Returns the number of orders that don't
+static size_t checkDerivativeGrowth(Parser& parser)
+{
+  std::string product = "(x+1)";
+  for (int i = 2; i <= 64; i++)
+  {
+    product += "*(x+" + std::to_string(i) + ")";
+  }
+  const AST source = parser.Parse(product);
+  Differentiator differentiator;
+  AST derivative;
+  differentiator.differentiate(source, 'x', derivative, 1);
+  const size_t first = derivative.args.size();
+  size_t failures = 0;
+  for (unsigned order = 2; order <= 4; order++)
+  {
+    differentiator.differentiate(source, 'x', derivative, order);
+    failures += derivative.args.size() > 2*order*first;
+  }
+  return failures;
+}
+
+int main(int argc, char** argv)
+{
+  size_t assignments = 1000000;
+  if (argc > 1)
+  {
+    assignments = std::strtoull(argv[1], nullptr, 10);
+    if (assignments == 0) assignments = 1;
+  }
+  std::vector<std::string> expressions;
+  for (int i = 2; i < argc; i++)
+  {
+    expressions.emplace_back(argv[i]);
+  }
+  if (expressions.empty())
+  {
+    expressions.assign(std::begin(defaultExpressions), std::end(defaultExpressions));
+  }
+
+  Parser parser;
+  BytecodeCompiler compiler;
+  Evaluator evaluator;
+  BytecodeInterpreter interpreter;
+  BatchEvaluator batchEvaluator;
+  GradientEvaluator gradientEvaluator;
+  Bindings bindings;
+
+  // Batches reuse the same columns, which are kept small enough to stay in cache alongside the output
+  const size_t columnLength = std::min<size_t>(assignments, 1 << 14);
+  std::vector<double> xColumn(columnLength), yColumn(columnLength), batchValues(columnLength);
+  std::vector<AtomicTypes> batchTypes(columnLength);
+  for (size_t i = 0; i < columnLength; i++)
+  {
+    xColumn[i] = 0.001*(double)i;
+    yColumn[i] = 1+0.0005*(double)i;
+  }
+  BatchBindings columns;
+  columns.set('x', xColumn.data());
+  columns.set('y', yColumn.data());
+
+  std::printf("SIMD: %s\n", getSIMDLevelName(batchEvaluator.getSIMDLevel()));
+  if (const size_t wideMismatches = checkWideNodes(parser); wideMismatches != 0)
+  {
+    std::printf("ERROR: Nodes with more than 65535 operands evaluate differently (%zu mismatches)\n", wideMismatches);
+    return 1;
+  }
+  if (const size_t growthFailures = checkDerivativeGrowth(parser); growthFailures != 0)
+  {
+    std::printf("ERROR: Higher derivatives grow faster than linearly (%zu orders)\n", growthFailures);
+    return 1;
+  }
+  std::printf("%-50s %6s %6s %6s %12s %12s %12s %14s %12s %12s\n", "expression", "nodes", "code", "pool", "tree ns", "bytecode ns", "batch ns", "batch eval/s",
+    "forward ns", "reverse ns");
+  for (const std::string& expression : expressions)
+  {
+    const AST& ast = parser.Parse(expression);
+    const Bytecode bytecode = compiler.compile(ast);
+
+    // Both paths must agree on every assignment before their timings mean anything
+    size_t mismatches = 0, gradientMismatches = 0;
+    for (size_t i = 0; i < 1000; i++)
+    {
+      bindings.set('x', 0.37*(double)i-50);
+      bindings.set('y', 0.11*(double)i-20);
+      const Evaluation tree = evaluator.evaluate(ast, bindings);
+      const Evaluation compiled = interpreter.run(bytecode, bindings);
+      if (tree.type != compiled.type || (!tree.isError() && tree.value != compiled.value))
+      {
+        mismatches++;
+      }
+      // Both modes sum the same products in a different order, so their derivatives only agree up to rounding
+      const Gradient forward = gradientEvaluator.evaluate(ast, bindings, DifferentiationModes::FORWARD);
+      const Gradient& reverse = gradientEvaluator.evaluate(ast, bindings, DifferentiationModes::REVERSE);
+      if (forward.value.type != tree.type || reverse.value.type != tree.type || (!tree.isError() && reverse.value.value != tree.value))
+      {
+        gradientMismatches++;
+        continue;
+      }
+      for (size_t k = 0; k < reverse.derivatives.size(); k++)
+      {
+        const Evaluation a = forward.derivatives[k], b = reverse.derivatives[k];
+        if (a.type != b.type || (!a.isError() && std::fabs(a.value-b.value) > 1e-9*std::max(1.0, std::fabs(a.value))))
+        {
+          gradientMismatches++;
+        }
+      }
+    }
+
+    double treeChecksum = 0, bytecodeChecksum = 0;
+    const double treeTime = measure(assignments, bindings, treeChecksum, [&]() { return evaluator.evaluate(ast, bindings); });
+    const double bytecodeTime = measure(assignments, bindings, bytecodeChecksum, [&]() { return interpreter.run(bytecode, bindings); });
+    double gradientChecksum = 0;
+    const double forwardTime = measure(assignments, bindings, gradientChecksum,
+      [&]() { return gradientEvaluator.evaluate(ast, bindings, DifferentiationModes::FORWARD).value; });
+    const double reverseTime = measure(assignments, bindings, gradientChecksum,
+      [&]() { return gradientEvaluator.evaluate(ast, bindings, DifferentiationModes::REVERSE).value; });
+
+    // Lanes are checked against the evaluator once, before timing
+    size_t batchMismatches = 0;
+    batchEvaluator.evaluate(bytecode, columns, columnLength, batchValues.data(), batchTypes.data());
+    for (size_t i = 0; i < columnLength; i++)
+    {
+      bindings.set('x', xColumn[i]);
+      bindings.set('y', yColumn[i]);
+      const Evaluation tree = evaluator.evaluate(ast, bindings);
+      if (tree.type != batchTypes[i] || (!tree.isError() && tree.value != batchValues[i]))
+      {
+        batchMismatches++;
+      }
+    }
+    const size_t batches = (assignments+columnLength-1)/columnLength;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t batch = 0; batch < batches; batch++)
+    {
+      batchEvaluator.evaluate(bytecode, columns, columnLength, batchValues.data(), batchTypes.data());
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now()-start;
+    const double batchTime = elapsed.count()/(double)(batches*columnLength);
+
+    std::printf("%-50.50s %6zu %6zu %6zu %12.2f %12.2f %12.2f %14.3g %12.2f %12.2f\n", expression.c_str(), ast.size(), bytecode.code.size(), bytecode.pool.size(),
+      treeTime, bytecodeTime, batchTime, 1e9/batchTime, forwardTime, reverseTime);
+    if (mismatches != 0 || treeChecksum != bytecodeChecksum)
+    {
+      std::printf("ERROR: Bytecode and tree-walking results differ (%zu mismatches)\n", mismatches);
+      return 1;
+    }
+    if (batchMismatches != 0)
+    {
+      std::printf("ERROR: Batch and tree-walking results differ (%zu mismatches)\n", batchMismatches);
+      return 1;
+    }
+    if (gradientMismatches != 0)
+    {
+      std::printf("ERROR: Forward and reverse gradients differ (%zu mismatches)\n", gradientMismatches);
+      return 1;
+    }
+  }
+  return 0;
+}
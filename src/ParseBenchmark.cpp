@@ -0,0 +1,570 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../include/Tokenizer.h"
+#include "../include/Parser.h"
+#include "../include/CorpusGenerator.h"
+#include "../include/BinaryAST.h"
+#include "../include/JSONWriter.h"
+#include "../include/ParseSession.h"
+#include "../include/AllocationHooks.h"
+
+// Measures every stage of the parse pipeline (Tokenizer -> Parser::RPN -> Parser::RPN2AST -> JSONWriter) on generated
+//   corpora, plus the streaming Parser::Parse that fuses the first three, Parser::Validate and the binary format (writing
+//   a record, walking it in place and loading it back into an AST), and prints the results as JSON on stdout. The edit
+//   stage changes one digit near the middle of each expression through a ParseSession, whose latency should not grow
+//   with the corpus size. Before timing, every AST is checked to load back from its binary record unchanged, and an edit
+//   of each expression against a full re-parse of the edited text, and the diagnostics of each expression, as generated
+//   and with an error inserted, are checked; any mismatch is reported on stderr and fails the run.
+//   Usage: ParseBenchmark [--shape name]... [--sizes 16,256,...] [--count N] [--repetitions N] [--seed N]
+//          ParseBenchmark --corpus shape size [count]   prints a corpus, one expression per line, e.g. for --batch
+
+enum class Stages : uint8_t
+{
+  TOKENIZE,
+  RPN,
+  RPN2AST,
+  INTERNED, // RPN2AST with hash-consing
+  TOJSON,
+  PARSE,
+  TOBINARY,
+  WALKBINARY,
+  LOADBINARY,
+  VALIDATE, // Parser::Validate, the diagnostics without the AST
+  EDIT, // One digit changed through ParseSession::edit
+};
+
+constexpr size_t stageCount = (size_t)Stages::EDIT + 1;
+
+static const char* getStageName(const Stages stage)
+{
+  switch (stage)
+  {
+    case Stages::TOKENIZE:
+    return "tokenize";
+    case Stages::RPN:
+    return "rpn";
+    case Stages::RPN2AST:
+    return "rpn2ast";
+    case Stages::INTERNED:
+    return "rpn2ast-interned";
+    case Stages::TOJSON:
+    return "json";
+    case Stages::TOBINARY:
+    return "binary";
+    case Stages::WALKBINARY:
+    return "binary-walk";
+    case Stages::LOADBINARY:
+    return "binary-load";
+    case Stages::VALIDATE:
+    return "validate";
+    case Stages::EDIT:
+    return "edit";
+    default:
+    return "parse";
+  }
+}
+
+struct StageResult
+{
+  double nanoseconds = 0; // Over every timed repetition of every expression
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  uint64_t firstAllocations = 0; // Made by the first pass, with buffers that still have to grow
+  uint64_t firstBytes = 0;
+};
+
+struct CorpusResult
+{
+  CorpusShapes shape;
+  size_t size = 0;
+  size_t expressions = 0;
+  size_t repetitions = 0;
+  size_t characters = 0;
+  size_t tokens = 0;
+  size_t nodes = 0;
+  size_t internedNodes = 0;
+  size_t jsonBytes = 0;
+  size_t binaryBytes = 0;
+  size_t binaryMismatches = 0; // ASTs, plain or interned, that do not load back from their record with the same JSON
+  size_t editMismatches = 0; // Session edits whose AST or diagnostics differ from a full re-parse of the same text
+  size_t recoveryMismatches = 0; // Expressions, plain or corrupted, whose diagnostics are missing, out of range or not those of Validate
+  StageResult stages[stageCount];
+};
+
+// Keeps the work of every stage observable so none of it is optimized away
+static size_t sink = 0;
+
+// Times repetitions runs of run and charges them, with their allocations, to result
+template <typename Run>
+static void measure(StageResult& result, const size_t repetitions, Run&& run)
+{
+  const AllocationCounters before = Allocations::thread();
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < repetitions; i++)
+  {
+    run();
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now()-start;
+  const AllocationCounters used = Allocations::thread()-before;
+  result.nanoseconds += elapsed.count();
+  result.allocations += used.allocations;
+  result.bytes += used.bytes;
+}
+
+template <typename Run>
+static void measureFirst(StageResult& result, Run&& run)
+{
+  const AllocationCounters before = Allocations::thread();
+  run();
+  const AllocationCounters used = Allocations::thread()-before;
+  result.firstAllocations += used.allocations;
+  result.firstBytes += used.bytes;
+}
+
+// Edits made by checkEdits at evenly spaced offsets, every one undone right after. Some keep the text well formed, the
+//   others break it and leave the session parsing in full until the undo
+struct CheckedEdit
+{
+  size_t removed;
+  const char* inserted;
+};
+
+static constexpr CheckedEdit checkedEdits[] = {{1, "7"}, {0, "+1"}, {0, "(x)"}, {0, "\\frac{1}{y}"}, {1, ""}, {0, ","}, {0, "("}};
+
+// Edits the expressions of corpus through a session and compares its AST after each edit with that of a full re-parse of
+//   the text, and with Parser::Parse when the text is well formed. Its diagnostics must always be those of Parser::Parse.
+//   Returns the number of edits that differ
+static size_t checkEdits(const std::vector<std::string>& corpus)
+{
+  ParseSession session;
+  ParseSession reference;
+  Parser parser;
+  JSONWriter jsonWriter;
+  std::string expected, actual, reported, parsedErrors;
+  size_t mismatches = 0;
+  const auto compare = [&]()
+  {
+    actual.clear();
+    jsonWriter.write(session.getAST(), actual);
+    bool same = true;
+    // An edit that fell back to a full parse already did what the reference would
+    if (!session.getStatistics().fullParse)
+    {
+      const AST& full = reference.reset(session.getText());
+      expected.clear();
+      jsonWriter.write(full, expected);
+      same = actual == expected && session.isIncremental() == reference.isIncremental();
+    }
+    const AST& parsed = parser.Parse(session.getText());
+    reported.clear();
+    JSONWriter::appendDiagnostics(session.getDiagnostics(), reported);
+    parsedErrors.clear();
+    JSONWriter::appendDiagnostics(parser.getDiagnostics(), parsedErrors);
+    same = same && reported == parsedErrors;
+    if (same && session.isIncremental())
+    {
+      expected.clear();
+      jsonWriter.write(parsed, expected);
+      same = actual == expected;
+    }
+    if (!same)
+    {
+      mismatches++;
+      // Starts over, so the undo is checked on its own
+      session.reset(session.getText());
+    }
+  };
+  // One edit per expression, the next one of the list each time, so a corpus of at least as many expressions as edits
+  //   goes through all of them at a cost of about four parses per expression
+  for (size_t i = 0; i < corpus.size(); i++)
+  {
+    const std::string& expression = corpus[i];
+    const CheckedEdit& edit = checkedEdits[i % std::size(checkedEdits)];
+    const size_t offset = (i % std::size(checkedEdits)+1)*expression.size()/(std::size(checkedEdits)+1);
+    const std::string removed = expression.substr(offset, edit.removed);
+    session.reset(expression);
+    session.edit(offset, removed.size(), edit.inserted);
+    compare();
+    session.edit(offset, std::strlen(edit.inserted), removed);
+    compare();
+  }
+  return mismatches;
+}
+
+// Malformed text inserted by checkRecovery, and the error each one must be reported as
+struct CheckedError
+{
+  const char* inserted;
+  ErrorTypes type;
+};
+
+static constexpr CheckedError checkedErrors[] = {{"@", ErrorTypes::UNIDENTIFIEDCHARACTER}, {"\\ln", ErrorTypes::UNKNOWNCOMMAND},
+  {"1.2.3", ErrorTypes::MALFORMEDNUMBER}};
+
+// Whether Parser::Parse and Parser::Validate report the same diagnostics for input, all within it
+static bool recovers(Parser& parser, const std::string& input, std::string& parsed, std::string& validated)
+{
+  parser.Parse(input);
+  parsed.clear();
+  JSONWriter::appendDiagnostics(parser.getDiagnostics(), parsed);
+  validated.clear();
+  JSONWriter::appendDiagnostics(parser.Validate(input), validated);
+  for (const Diagnostic& diagnostic : parser.getDiagnostics())
+  {
+    if (diagnostic.span.begin > diagnostic.span.end || diagnostic.span.end > input.size())
+    {
+      return false;
+    }
+  }
+  return parsed == validated;
+}
+
+// Parses the expressions of corpus, which must have no errors, then again with malformed text inserted before an operator
+//   or a grouper, where the previous token has ended. The insertion must be reported over the bytes it took, and
+//   Parser::Validate must agree with Parser::Parse on both texts. Returns the number of expressions that fail
+static size_t checkRecovery(const std::vector<std::string>& corpus)
+{
+  Parser parser;
+  std::string parsed, validated, corrupted;
+  size_t mismatches = 0;
+  for (size_t i = 0; i < corpus.size(); i++)
+  {
+    const std::string& expression = corpus[i];
+    if (!recovers(parser, expression, parsed, validated) || !parser.getDiagnostics().empty())
+    {
+      mismatches++;
+      continue;
+    }
+    const CheckedError& error = checkedErrors[i % std::size(checkedErrors)];
+    size_t offset = (i % std::size(checkedErrors)+1)*expression.size()/(std::size(checkedErrors)+1);
+    while (offset < expression.size() && std::strchr("+-*/^(){}[]", expression[offset]) == nullptr)
+    {
+      offset++;
+    }
+    const size_t end = offset+std::strlen(error.inserted);
+    corrupted.assign(expression).insert(offset, error.inserted);
+    bool reported = false;
+    if (recovers(parser, corrupted, parsed, validated))
+    {
+      for (const Diagnostic& diagnostic : parser.getDiagnostics())
+      {
+        reported |= diagnostic.type == error.type && diagnostic.span.begin < end && diagnostic.span.end > offset;
+      }
+    }
+    mismatches += !reported;
+  }
+  return mismatches;
+}
+
+static CorpusResult benchmark(const CorpusShapes shape, const size_t size, const std::vector<std::string>& corpus, size_t repetitions)
+{
+  CorpusResult result;
+  result.shape = shape;
+  result.size = size;
+  result.expressions = corpus.size();
+  result.editMismatches = checkEdits(corpus);
+  result.recoveryMismatches = checkRecovery(corpus);
+
+  // Fresh objects for every corpus, so the first pass shows what a cold parser allocates
+  Tokenizer tokenizer;
+  Parser parser;
+  Parser interningParser;
+  interningParser.setInterning(true);
+  AST ast;
+  AST internedAST;
+  std::vector<ASTLeaf> tokens;
+  std::string json;
+  JSONWriter jsonWriter;
+  BinaryASTWriter writer;
+  BinaryASTView view;
+  std::string binary;
+  AST loaded;
+  const auto toBinary = [&]()
+  {
+    binary.clear();
+    writer.write(ast, binary);
+    view.open(binary);
+  };
+  const auto walkBinary = [&]()
+  {
+    view.rewind();
+    BinaryASTEntry entry;
+    while (view.next(entry))
+    {
+      sink += entry.argCount;
+    }
+  };
+  // Buffers of the round-trip check, apart from those the binary stages are timed on
+  BinaryASTView checkView;
+  std::string checkBinary;
+  std::string checkJSON;
+  // Whether source makes a record that loads back into an AST writing the JSON expected, and that with the kind of one
+  //   of its first entries changed is either rejected or loads only nodes with an argument count their function takes
+  const auto roundTrips = [&](const AST& source, const std::string& expected)
+  {
+    checkBinary.clear();
+    writer.write(source, checkBinary);
+    if (!checkView.open(checkBinary) || !checkView.read(loaded))
+    {
+      return false;
+    }
+    checkJSON.clear();
+    jsonWriter.write(loaded, checkJSON);
+    if (checkJSON != expected)
+    {
+      return false;
+    }
+    for (size_t bit = 8*BinaryASTFormat::headerSize; bit < std::min(checkBinary.size(), (size_t)32)*8; bit += bit%8 == 0 ? 1 : 7)
+    {
+      checkBinary[bit/8] ^= (char)(1 << bit%8);
+      const bool accepted = checkView.open(checkBinary) && checkView.read(loaded);
+      checkBinary[bit/8] ^= (char)(1 << bit%8);
+      for (NodeId id = 0; accepted && id < loaded.size(); id++)
+      {
+        const size_t argCount = loaded.getArgs(id).size();
+        if (!loaded.isLeaf(id) && (argCount < BinaryASTFormat::minimumArity(loaded.getType(id))
+          || argCount > BinaryASTFormat::maximumArity(loaded.getType(id))))
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  ParseSession session;
+  // Switches the digit nearest the middle of the session's text between two values
+  const auto editDigit = [&]()
+  {
+    const std::string& text = session.getText();
+    for (size_t distance = 0; distance <= text.size()/2; distance++)
+    {
+      for (const size_t at : {text.size()/2-distance, text.size()/2+distance})
+      {
+        if (at < text.size() && text[at] >= '0' && text[at] <= '9')
+        {
+          const char digit = text[at] == '1' ? '2' : '1';
+          sink += session.edit(at, 1, std::string_view(&digit, 1)).size();
+          return;
+        }
+      }
+    }
+  };
+  const auto tokenize = [&](const std::string& expression)
+  {
+    tokenizer.reset(expression);
+    tokens.clear();
+    ASTLeaf token;
+    while (tokenizer.next(token))
+    {
+      tokens.push_back(token);
+    }
+  };
+
+  for (const std::string& expression : corpus)
+  {
+    const std::vector<ASTLeaf>* rpn = nullptr;
+    measureFirst(result.stages[(size_t)Stages::TOKENIZE], [&]() { tokenize(expression); });
+    measureFirst(result.stages[(size_t)Stages::RPN], [&]() { rpn = &parser.RPN(tokens); });
+    measureFirst(result.stages[(size_t)Stages::RPN2AST], [&]() { parser.RPN2AST(*rpn, ast); });
+    measureFirst(result.stages[(size_t)Stages::INTERNED], [&]() { interningParser.RPN2AST(*rpn, internedAST); });
+    measureFirst(result.stages[(size_t)Stages::TOJSON], [&]() { json.clear(); jsonWriter.write(ast, json); });
+    measureFirst(result.stages[(size_t)Stages::PARSE], [&]() { parser.Parse(expression); });
+    parser.RPN2AST(*rpn, ast);
+    measureFirst(result.stages[(size_t)Stages::TOBINARY], toBinary);
+    measureFirst(result.stages[(size_t)Stages::WALKBINARY], walkBinary);
+    measureFirst(result.stages[(size_t)Stages::LOADBINARY], [&]() { view.read(loaded); });
+    measureFirst(result.stages[(size_t)Stages::VALIDATE], [&]() { parser.Validate(expression); });
+    // The interned AST writes its shared nodes as references, which must load back as copies
+    result.binaryMismatches += !roundTrips(ast, json);
+    result.binaryMismatches += !roundTrips(internedAST, json);
+    session.reset(expression);
+    measureFirst(result.stages[(size_t)Stages::EDIT], editDigit);
+    result.jsonBytes += json.size();
+    result.binaryBytes += binary.size();
+    result.characters += expression.size();
+    result.tokens += tokens.size();
+    result.nodes += ast.size();
+    result.internedNodes += internedAST.size();
+  }
+
+  // Enough repetitions for every stage to go through about a million tokens per corpus
+  if (repetitions == 0)
+  {
+    repetitions = result.tokens ? (1000000+result.tokens-1)/result.tokens : 1;
+  }
+  result.repetitions = repetitions;
+
+  for (const std::string& expression : corpus)
+  {
+    measure(result.stages[(size_t)Stages::TOKENIZE], repetitions, [&]() { tokenize(expression); });
+    const std::vector<ASTLeaf>* rpn = nullptr;
+    measure(result.stages[(size_t)Stages::RPN], repetitions, [&]() { rpn = &parser.RPN(tokens); });
+    measure(result.stages[(size_t)Stages::RPN2AST], repetitions, [&]() { parser.RPN2AST(*rpn, ast); });
+    measure(result.stages[(size_t)Stages::INTERNED], repetitions, [&]() { interningParser.RPN2AST(*rpn, internedAST); });
+    measure(result.stages[(size_t)Stages::TOJSON], repetitions, [&]() { json.clear(); jsonWriter.write(ast, json); sink += json.size(); });
+    measure(result.stages[(size_t)Stages::PARSE], repetitions, [&]() { sink += parser.Parse(expression).size(); });
+    parser.RPN2AST(*rpn, ast);
+    measure(result.stages[(size_t)Stages::TOBINARY], repetitions, toBinary);
+    measure(result.stages[(size_t)Stages::WALKBINARY], repetitions, walkBinary);
+    measure(result.stages[(size_t)Stages::LOADBINARY], repetitions, [&]() { view.read(loaded); sink += loaded.size(); });
+    measure(result.stages[(size_t)Stages::VALIDATE], repetitions, [&]() { sink += parser.Validate(expression).size(); });
+    session.reset(expression);
+    measure(result.stages[(size_t)Stages::EDIT], repetitions, editDigit);
+  }
+  return result;
+}
+
+static void printResult(const CorpusResult& result, const bool last)
+{
+  const double expressions = (double)result.expressions;
+  const double runs = expressions*(double)result.repetitions;
+  std::printf("    {\"shape\": \"%s\", \"size\": %zu, \"expressions\": %zu, \"repetitions\": %zu, ", getCorpusShapeName(result.shape),
+    result.size, result.expressions, result.repetitions);
+  std::printf("\"charactersPerExpression\": %.1f, \"tokensPerExpression\": %.1f, \"nodesPerExpression\": %.1f, \"internedNodesPerExpression\": %.1f, ",
+    result.characters/expressions, result.tokens/expressions, result.nodes/expressions, result.internedNodes/expressions);
+  std::printf("\"jsonBytesPerExpression\": %.1f, \"binaryBytesPerExpression\": %.1f, \"binaryMismatches\": %zu, \"editMismatches\": %zu, \"recoveryMismatches\": %zu,\n      \"stages\": {\n",
+    result.jsonBytes/expressions, result.binaryBytes/expressions, result.binaryMismatches, result.editMismatches, result.recoveryMismatches);
+  for (size_t stage = 0; stage < stageCount; stage++)
+  {
+    const StageResult& timing = result.stages[stage];
+    std::printf("        \"%s\": {\"nsPerToken\": %.3f, \"nsPerExpression\": %.1f, \"allocationsPerExpression\": %.3f, \"bytesPerExpression\": %.1f, "
+      "\"firstPassAllocationsPerExpression\": %.3f, \"firstPassBytesPerExpression\": %.1f}%s\n", getStageName((Stages)stage),
+      timing.nanoseconds/(runs*result.tokens/expressions), timing.nanoseconds/runs, timing.allocations/runs, timing.bytes/runs,
+      timing.firstAllocations/expressions, timing.firstBytes/expressions, stage+1 < stageCount ? "," : "");
+  }
+  std::printf("      }\n    }%s\n", last ? "" : ",");
+}
+
+static bool parseSizes(const char* list, std::vector<size_t>& sizes)
+{
+  sizes.clear();
+  while (*list)
+  {
+    char* end;
+    const size_t size = std::strtoull(list, &end, 10);
+    if (end == list || size == 0)
+    {
+      return false;
+    }
+    sizes.push_back(size);
+    list = *end == ',' ? end+1 : end;
+  }
+  return !sizes.empty();
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<CorpusShapes> shapes;
+  std::vector<size_t> sizes = {16, 256, 4096};
+  size_t count = 8;
+  size_t repetitions = 0;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    const bool hasValue = i+1 < argc;
+    if (std::strcmp(argv[i], "--corpus") == 0 && i+2 < argc)
+    {
+      CorpusShapes shape;
+      if (!getCorpusShape(argv[i+1], shape))
+      {
+        std::fprintf(stderr, "ERROR: Unknown shape '%s'\n", argv[i+1]);
+        return 1;
+      }
+      const size_t size = std::strtoull(argv[i+2], nullptr, 10);
+      const size_t lines = i+3 < argc ? std::strtoull(argv[i+3], nullptr, 10) : 1;
+      CorpusGenerator generator(seed);
+      for (size_t line = 0; line < lines; line++)
+      {
+        const std::string expression = generator.generate(shape, size);
+        std::fwrite(expression.data(), 1, expression.size(), stdout);
+        std::fputc('\n', stdout);
+      }
+      return 0;
+    }
+    else if (std::strcmp(argv[i], "--shape") == 0 && hasValue)
+    {
+      CorpusShapes shape;
+      if (!getCorpusShape(argv[++i], shape))
+      {
+        std::fprintf(stderr, "ERROR: Unknown shape '%s'\n", argv[i]);
+        return 1;
+      }
+      shapes.push_back(shape);
+    }
+    else if (std::strcmp(argv[i], "--sizes") == 0 && hasValue)
+    {
+      if (!parseSizes(argv[++i], sizes))
+      {
+        std::fprintf(stderr, "ERROR: Invalid size list '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (std::strcmp(argv[i], "--count") == 0 && hasValue)
+    {
+      count = std::strtoull(argv[++i], nullptr, 10);
+      if (count == 0) count = 1;
+    }
+    else if (std::strcmp(argv[i], "--repetitions") == 0 && hasValue)
+    {
+      repetitions = std::strtoull(argv[++i], nullptr, 10);
+    }
+    else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+    {
+      seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+    }
+    else
+    {
+      std::fprintf(stderr, "ERROR: Unknown argument '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (shapes.empty())
+  {
+    for (size_t shape = 0; shape < corpusShapeCount; shape++)
+    {
+      shapes.push_back((CorpusShapes)shape);
+    }
+  }
+
+  size_t binaryMismatches = 0, editMismatches = 0, recoveryMismatches = 0;
+  std::printf("{\n  \"countAllocations\": %s,\n  \"seed\": %u,\n  \"results\": [\n", Allocations::compiled ? "true" : "false", seed);
+  for (size_t i = 0; i < shapes.size(); i++)
+  {
+    for (size_t j = 0; j < sizes.size(); j++)
+    {
+      // Every corpus has its own generator, so adding a shape or a size leaves the other corpora unchanged
+      CorpusGenerator generator(seed+(uint32_t)shapes[i]*1000003u+(uint32_t)sizes[j]);
+      const std::vector<std::string> corpus = generator.generate(shapes[i], sizes[j], count);
+      const CorpusResult result = benchmark(shapes[i], sizes[j], corpus, repetitions);
+      binaryMismatches += result.binaryMismatches;
+      editMismatches += result.editMismatches;
+      recoveryMismatches += result.recoveryMismatches;
+      printResult(result, i+1 == shapes.size() && j+1 == sizes.size());
+      std::fflush(stdout);
+    }
+  }
+  std::printf("  ],\n  \"checksum\": %zu\n}\n", sink);
+  if (binaryMismatches != 0)
+  {
+    std::fprintf(stderr, "ERROR: binary records load back into ASTs other than the ones written, or accept argument counts their function can't take (%zu mismatches)\n", binaryMismatches);
+    return 1;
+  }
+  if (editMismatches != 0)
+  {
+    std::fprintf(stderr, "ERROR: Incremental edits and full re-parses differ (%zu mismatches)\n", editMismatches);
+    return 1;
+  }
+  if (recoveryMismatches != 0)
+  {
+    std::fprintf(stderr, "ERROR: Malformed expressions are not reported as expected (%zu mismatches)\n", recoveryMismatches);
+    return 1;
+  }
+  return 0;
+}
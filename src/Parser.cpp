@@ -1,985 +1,241 @@
 #include <iostream>
-#include <variant>
-#include <memory>
-#include <vector>
-#include <unordered_map>
-#include <algorithm>
 #include <cstdlib>
-#include <stack>
-#include <queue>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <string_view>
 
-#include "../include/AtomicTypes.h"
-#include "../include/Functions.h"
-#include "../include/Constants.h"
-#include "../include/AuxiliaryTypes.h"
-#include "../include/FunctionTypes.h"
-
-static int numOfHeapAllocations = 0;
-constexpr int CCIntervalIndex = (int)Functions::CCINTV;
-
-void* operator new(size_t size)
-{
-    numOfHeapAllocations++;
-    return malloc(size);
-}
-
-std::unordered_map<char,AuxiliaryTypes> groupers =
-{
-  {'{',AuxiliaryTypes::LEFTKEY},
-  {'}',AuxiliaryTypes::RIGHTKEY},
-  {'[',AuxiliaryTypes::LEFTBRACKET},
-  {']',AuxiliaryTypes::RIGHTBRACKET},
-  {'(',AuxiliaryTypes::LEFTPARENTHESIS},
-  {')',AuxiliaryTypes::RIGHTPARENTHESIS}
-};
-
-// The following four functions can be optimized and reduced to a single line if the auxiliaryTypes enumeration keeps
-//   the opening and closing characters in an alternate order: ('(',')','[',']','{','}')
-//   however this implementation was selected because it allows the header file to be organized in any way
-
-bool isOpeningGrouper(const AuxiliaryTypes x)
-{
-  switch(x)
-  {
-    case AuxiliaryTypes::LEFTKEY:
-    case AuxiliaryTypes::LEFTBRACKET:
-    case AuxiliaryTypes::LEFTPARENTHESIS:
-    return true;
-  }
-  return false;
-}
-
-bool isClosingGrouper(const AuxiliaryTypes x)
-{
-  switch(x)
-  {
-    case AuxiliaryTypes::RIGHTKEY:
-    case AuxiliaryTypes::RIGHTBRACKET:
-    case AuxiliaryTypes::RIGHTPARENTHESIS:
-    return true;
-  }
-  return false;
-}
-
-char getOppositeGrouper(const char c)
-{
-  switch (c)
-  {
-    case '(':
-    return ')';
-    case ')':
-    return '(';
-    case '[':
-    return ']';
-    case ']':
-    return '[';
-    case '{':
-    return '}';
-    case '}':
-    return '{';
-  }
-  throw std::invalid_argument("Argument isn't an implemented grouper");
-  return '@';
-}
-
-AuxiliaryTypes getOppositeGrouper(const AuxiliaryTypes x)
-{
-  switch (x)
-  {
-    case AuxiliaryTypes::LEFTPARENTHESIS:
-    return AuxiliaryTypes::RIGHTPARENTHESIS;
-    case AuxiliaryTypes::RIGHTPARENTHESIS:
-    return AuxiliaryTypes::LEFTPARENTHESIS;
-    case AuxiliaryTypes::LEFTBRACKET:
-    return AuxiliaryTypes::RIGHTBRACKET;
-    case AuxiliaryTypes::RIGHTBRACKET:
-    return AuxiliaryTypes::LEFTBRACKET;
-    case AuxiliaryTypes::LEFTKEY:
-    return AuxiliaryTypes::RIGHTKEY;
-    case AuxiliaryTypes::RIGHTKEY:
-    return AuxiliaryTypes::LEFTKEY;
-  }
-  throw std::invalid_argument("Argument isn't an implemented grouper");
-  return AuxiliaryTypes::NULLAUX;
-}
-
-
-std::unordered_map<char,Functions> operators =
-{
-  {'+',Functions::ADDITION},
-  {'-',Functions::SUBTRACTION},
-  {'*',Functions::MULTIPLICATION},
-  {'/',Functions::DIVISION},
-  {'^',Functions::EXPONENTIATION},
-  {'!',Functions::FACTORIAL},
-  {'#',Functions::PRIMORIAL},
-  {'=',Functions::EQUALS}
-};
-
-std::unordered_map<std::string_view,Functions> commands =
-{
-  {"sqrt",Functions::SQRT},
-  {"abs",Functions::ABS},
-
-  {"choose",Functions::CHOOSE},
-
-  {"gt",Functions::GT},
-  {"lt",Functions::LT},
-  {"ge",Functions::GE},
-  {"le",Functions::LE},
-
-  {"int",Functions::INT},
-  {"lim",Functions::LIMIT},
-  {"sum",Functions::SUM},
-  {"prod",Functions::PROD},
+#include "../include/Diagnostics.h"
+#include "../include/ErrorTypes.h"
+#include "../include/Trace.h"
+#include "../include/Tokenizer.h"
+#include "../include/Parser.h"
+#include "../include/Evaluator.h"
+#include "../include/Simplifier.h"
+#include "../include/Differentiator.h"
+#include "../include/Gradient.h"
+#include "../include/BatchParser.h"
+#include "../include/ExpressionCache.h"
+#include "../include/JSONWriter.h"
+#include "../include/AllocationHooks.h"
 
-  {"gcd",Functions::GCD},
-  {"lcm",Functions::LCM},
-  {"vec",Functions::VEC},
-
-  {"matrix",Functions::MATRIX},
-
-  {"interval",Functions::INTERVAL},
-};
-
-std::unordered_map<Functions,std::string_view> intervals =
-{
-  {Functions::CCINTV,"cc interval"},
-  {Functions::COINTV,"co interval"},
-  {Functions::OCINTV,"oc interval"},
-  {Functions::OOINTV,"oo interval"}
-};
-
-std::unordered_map<std::string_view,Constants> constants =
-{
-  {"pi",Constants::PI},
-  {"e",Constants::e},
-  {"i",Constants::i},
-  {"phi",Constants::PHI}
-};
-
-constexpr size_t getPriority(Functions f)
+// Batch mode: Parser --batch [--threads N] [--cache MiB] [--binary | --validate] [file], reading stdin when no file is
+//   given. --binary writes one BinaryAST record per line instead of JSON lines, and --validate the JSON array of the
+//   errors of each line
+static int runBatch(int argc, char** argv)
 {
-  switch(f) {
-    case Functions::ADDITION:
-    case Functions::SUBTRACTION:
-      return 20;
-    case Functions::MULTIPLICATION:
-    case Functions::DIVISION:
-    case Functions::MODULO:
-      return 30;
-    case Functions::EXPONENTIATION:
-      return 40;
-    case Functions::TETRATION:
-      return 50;
-    case Functions::PRIMORIAL:
-      return 60;
-    case Functions::UNSUBTRACTION:
-      return 70;
-    case Functions::FACTORIAL:
-      return 110;
-    case Functions::EQUALS:
-    case Functions::GT:
-    case Functions::LT:
-    case Functions::GE:
-    case Functions::LE:
-      return 10;
-    case Functions::NULLOPERATOR:
-      return 200;
-    default:
-      return 255;
-  }
-};
-
-constexpr size_t getArgType()
-{
-  return 0;
-};
-
-// Some functions aren't present because their behaviour depends on context and so are hard-coded during the parsing process
-std::unordered_map<Functions,FunctionTypes>properties =
-{
-  {Functions::ADDITION,FunctionTypes::BINARY},
-  {Functions::SUBTRACTION,FunctionTypes::BINARY},
-  {Functions::MULTIPLICATION,FunctionTypes::BINARY},
-  {Functions::DIVISION,FunctionTypes::BINARY},
-  {Functions::EXPONENTIATION,FunctionTypes::BINARY},
-  
-  {Functions::CHOOSE,FunctionTypes::BINARY},
-  {Functions::FKSTIRLING,FunctionTypes::BINARY},
-  {Functions::UNGSTIRLING,FunctionTypes::BINARY},
-  {Functions::SKSTIRLING,FunctionTypes::BINARY},
-  
-  {Functions::FACTORIAL,FunctionTypes::UNARYRIGHT},
-  {Functions::PRIMORIAL,FunctionTypes::UNARYLEFT},
-  {Functions::UNSUBTRACTION,FunctionTypes::UNARYLEFT},
-  
-  {Functions::EQUALS,FunctionTypes::BINARY},
-
-  {Functions::LIMIT,FunctionTypes::BIGOPERATOR},
-  {Functions::INT,FunctionTypes::BIGOPERATOR},
-  {Functions::SUM,FunctionTypes::BIGOPERATOR},
-  {Functions::PROD,FunctionTypes::BIGOPERATOR},
-
-  {Functions::SQRT,FunctionTypes::OPTIONALARGUMENTS},
-
-  {Functions::LCM,FunctionTypes::ARRAYARGUMENTS},
-  {Functions::GCD,FunctionTypes::ARRAYARGUMENTS},
-  {Functions::VEC,FunctionTypes::ARRAYARGUMENTS},
-
-  {Functions::MATRIX,FunctionTypes::MATRIXARGUMENTS},
-
-  {Functions::INTERVAL,FunctionTypes::INTERVAL},
-
-  {Functions::CCINTV,FunctionTypes::INTERVAL},
-  {Functions::COINTV,FunctionTypes::INTERVAL},
-  {Functions::OCINTV,FunctionTypes::INTERVAL},
-  {Functions::OOINTV,FunctionTypes::INTERVAL},
-};
-
-struct ASTLeaf
-{
-  std::variant<AtomicTypes, Functions, AuxiliaryTypes> type;
-  std::variant<int,double> value; // Value may be interpreted in different forms (double, bool, ...) depending on the type
-  std::string toString() const
+  size_t threads = std::thread::hardware_concurrency();
+  size_t cacheMiB = 0;
+  BatchFormats format = BatchFormats::JSON;
+  const char* path = nullptr;
+  for (int i = 2; i < argc; i++)
   {
-    std::string result;
-    if (std::holds_alternative<AtomicTypes>(type))
+    if (std::strcmp(argv[i], "--threads") == 0 && i+1 < argc)
     {
-      switch (std::get<AtomicTypes>(type))
-      {
-        case AtomicTypes::REAL:
-        return std::to_string(std::get<double>(value));
-        case AtomicTypes::INTEGER:
-        return std::to_string(std::get<int>(value));
-        case AtomicTypes::CONSTANT:
-        for (const auto& [key, val] : constants)
-        {
-          if (val == (Constants)std::get<int>(value))
-          {
-            return (std::string)key;
-          }
-        }
-        std::cout << "ERROR: Constant string representation not found (Constant nº " << std::get<int>(value) << ")\n";
-        return "#";
-        case AtomicTypes::VARIABLE:
-        result = "Variable '";
-        result += (char)std::get<int>(value);
-        return result + '\'';
-      }
+      threads = std::strtoul(argv[++i], nullptr, 10);
     }
-    else if (std::holds_alternative<Functions>(type))
+    else if (std::strcmp(argv[i], "--cache") == 0 && i+1 < argc)
     {
-      result += "(f|" +  std::to_string((int)std::get<Functions>(type)) + "|";
+      cacheMiB = std::strtoul(argv[++i], nullptr, 10);
     }
-    else
+    else if (std::strcmp(argv[i], "--binary") == 0)
     {
-      result +=  "(x|" +  std::to_string((int)std::get<AuxiliaryTypes>(type)) + "|";
+      format = BatchFormats::BINARY;
     }
-    if (std::holds_alternative<int>(value))
+    else if (std::strcmp(argv[i], "--validate") == 0)
     {
-      return result + std::to_string(std::get<int>(value)) + ")";
+      format = BatchFormats::DIAGNOSTICS;
     }
     else
     {
-      return result + std::to_string(std::get<double>(value)) + ")";
+      path = argv[i];
     }
   }
-  ASTLeaf(std::variant<AtomicTypes,Functions,AuxiliaryTypes> type) : type(type){};
-  ASTLeaf(Constants constant) : type(AtomicTypes::CONSTANT)
+  FILE* input = path ? std::fopen(path, "rb") : stdin;
+  if (!input)
   {
-    value = (int)constant;
-  };
-  ASTLeaf(std::variant<AtomicTypes,Functions,AuxiliaryTypes> type,std::variant<int,double> value) : type(type), value(value){};
-  ASTLeaf() {};
-};
-
-struct AST
-{
-  std::vector<std::variant<ASTLeaf,AST>> args;
-  Functions type;
-  std::string toString() const
+    std::cerr << "ERROR: Unable to open '" << path << "'\n";
+    return 1;
+  }
+  std::unique_ptr<ExpressionCache> cache(cacheMiB ? new ExpressionCache(cacheMiB << 20) : nullptr);
+  BatchParser batch(threads, cache.get(), format);
+  // Every chunk is written whole, so stdout needs no buffer of its own and each chunk takes a single write call
+  std::setvbuf(stdout, nullptr, _IONBF, 0);
+  const BatchStatistics statistics = batch.run(input, stdout);
+  if (path)
   {
-    std::string res = "{["+std::to_string((int)type)+"] ";
-    for (auto arg:args)
-    {
-      if (arg.index() == 0)
-      {
-        res += std::get<ASTLeaf>(arg).toString();
-      }
-      else
-      {
-        res += std::get<AST>(arg).toString();
-      }
-      res+=' ';
-    }
-    return res + '}';
+    std::fclose(input);
   }
-  AST(Functions type,std::vector<std::variant<ASTLeaf,AST>> args) : type(type), args(args){};
-
-  std::string toJSON()
+  std::fprintf(stderr, "Parsed %zu expressions (%zu failed) in %.3f s with %zu threads: %.0f expressions/s, %llu heap allocations (%llu bytes)\n",
+    statistics.lines, statistics.failures, statistics.seconds, batch.getThreadCount(), statistics.lines/statistics.seconds,
+    (unsigned long long)statistics.allocations, (unsigned long long)statistics.allocatedBytes);
+  if (cache)
   {
-    std::string res = "";
-    
-    // Managing operators
-    for (const auto& [key,val] : operators)
-    {
-      if (val == type)
-      {
-        res = "\"";
-        res += key;
-        res += "\":{";
-        for (int i = 0; i < args.size(); i++)
-        {
-          auto& arg = args[i];
-          if (std::holds_alternative<ASTLeaf>(arg))
-          {
-            res += std::get<ASTLeaf>(arg).toString();
-          } else {
-            res += std::get<AST>(arg).toJSON();
-          }
-          if (i != args.size()-1)
-          {
-            res+=",";
-          }
-        }
-        return res+="}";
-      }
-    }
-
-    // Managing commands
-    if (type == Functions::IDENTITY) {
-      if (std::holds_alternative<ASTLeaf>(args.at(0))) {
-          return std::get<ASTLeaf>(args.at(0)).toString();
-      } else {
-          return std::get<AST>(args.at(0)).toJSON();
-      }
-    }
-    switch (properties.at(type))
-    {
-      case FunctionTypes::BINARY:
-      case FunctionTypes::ARRAYARGUMENTS:
-      case FunctionTypes::MATRIXARGUMENTS:
-      case FunctionTypes::UNARYLEFT:
-      case FunctionTypes::UNARYRIGHT:
-      for (const auto& [key,val] : commands)
-      {
-        if (val == type)
-        {
-          res = "\"";
-          res += key;
-          res += "\":{";
-          for (int i = 0; i < args.size(); i++)
-          {
-            auto& arg = args[i];
-            if (std::holds_alternative<ASTLeaf>(arg))
-            {
-              res += std::get<ASTLeaf>(arg).toString();
-            } else {
-              res += std::get<AST>(arg).toJSON();
-            }
-            if (i != args.size()-1)
-            {
-              res+=",";
-            }
-          }
-          return res+="}";
-        }
-      }
-      break;
-      case FunctionTypes::INTERVAL:
-      auto& key = intervals.at(type);
-      std::cout << "cmd found: " << key << " \n";
-      res = "\"";
-      res += key;
-      res += "\":{";
-      for (int i = 0; i < args.size(); i++)
-      {
-        auto& arg = args[i];
-        if (std::holds_alternative<ASTLeaf>(arg))
-        {
-          res += std::get<ASTLeaf>(arg).toString();
-        } else {
-          res += std::get<AST>(arg).toJSON();
-        }
-        if (i != args.size()-1)
-        {
-          res+=",";
-        }
-      }
-      return res+="}";
-    }
-    return "Unable to translate to JSON";
+    const ExpressionCacheStatistics cached = cache->getStatistics();
+    std::fprintf(stderr, "Cache: %llu hits, %llu misses, %llu evictions, %llu uncacheable, %zu entries (%zu bytes)\n",
+      (unsigned long long)cached.hits, (unsigned long long)cached.misses, (unsigned long long)cached.evictions,
+      (unsigned long long)cached.uncacheable, cached.entries, cached.bytes);
   }
-};
+  return statistics.failures == 0 ? 0 : 2;
+}
 
-struct Environment
+static std::string toJSON(const AST& ast)
 {
-  std::vector<AST> expressions;
-};
+  JSONWriter writer;
+  std::string json;
+  writer.write(ast, json);
+  return json;
+}
 
-std::string printAST(std::variant<ASTLeaf,AST> ast)
-{
-  if (ast.index() == 0)
-  {
-    return std::get<ASTLeaf>(ast).toString();
-  } else {
-    return std::get<AST>(ast).toJSON();
+static void printEvaluation(const Evaluation& value)
+{
+  switch (value.type)
+  {
+    case AtomicTypes::REAL:
+    std::cout << value.value << '\n';
+    break;
+    case AtomicTypes::PROPOSITION:
+    std::cout << (value.value != 0 ? "true" : "false") << '\n';
+    break;
+    case AtomicTypes::UNDEFINED:
+    std::cout << "undefined\n";
+    break;
+    case AtomicTypes::UNDETERMINED:
+    std::cout << "undetermined\n";
+    break;
+    default:
+    std::cout << "does not exist\n";
+    break;
   }
 }
 
-class Tokenizer
+// Derivative mode: Parser --derive variable [order], reading one expression from stdin
+static int runDerivative(int argc, char** argv)
 {
-  public:
-  Tokenizer(const std::string_view& input) : input(input){
-    tokens.reserve(input.size()/5);
-  }
-  std::vector<ASTLeaf> Tokenize()
-  {
-    std::cout << '\'' << input << "'\n";
-    std::cout << input.size() << '\n';
-    while (pos < input.size())
-    {
-      std::cout << "Position " << pos << ", character '" << input[pos] << "'\n";
-      std::cout << "Tokens: \n";
-      for (auto t: tokens)
-      {
-        std::cout << t.toString() << '\n';
-      }
-      std::cout << "Big operators lookup:\n";
-      for (auto [key, pair] : bigOperators)
-      {
-        std::cout << key << " " << pair << "\n";
-      }
-      std::cout << "Multi-argument operators lookup:\n";
-      for (auto [key, pair] : multiArgumentOperators)
-      {
-        std::cout << key << " " << pair << "\n";
-      }
-      std::cout << "Interval lookup:\n";
-      for (auto [key, pair] : intervalLookup)
-      {
-        std::cout << key << " " << pair << "\n";
-      }
-      const char& current = input[pos];
-      if (current == '\\')
-      {
-        std::cout << "a\n";
-        parseCommand();
-      } else if (groupers.find(current) != groupers.end()) {
-        std::cout << "b\n";
-        switch (current)
-        {
-          case '(':
-          case '[':
-          case '{':
-          if (bigOperators.find(depth) != bigOperators.end())
-          {
-            // Having a closing character before the opening character while having to complete a large operator must mean that the following group introduces
-            //   the big operator's expression, therefore the lookup shall be removed
-            std::cout << "Closing bracket with lookup\n";
-            if (tokens.back().type.index() == 2 && std::get<AuxiliaryTypes>(tokens.back().type) == AuxiliaryTypes::RIGHTKEY)
-            {
-              std::cout << "Erase lookup " << depth << '\n';
-              bigOperators.erase(depth);
-            }
-          } else if (intervalLookup.find(depth) != intervalLookup.end()) {
-            // Having a closing character before the opening character while having to complete an interval must mean that the following group introduces
-            //   the big operator's expression, therefore the lookup shall be removed
-            std::cout << "Opening parenthesis with lookup\n";
-            if (current == '(')
-            {
-              std::get<int>(tokens[intervalLookup[depth]].value)+=2;
-            }
-          }
-          depth++;
-          break;
-          case ')':
-          case ']':
-          case '}':
-          depth--;
-          if (multiArgumentOperators.find(depth) != multiArgumentOperators.end())
-          {
-            // A closing grouper at the corresponding level as an opening grouper that came after a multiArgumentOperator must close this operator:
-            // e.g. --> gcd(a,b,c)
-            //             └─────┴─── These parentheses are in the same level so they limit the amount of arguments
-            // This is also the reason why the depth decrements before checking the depht
-            multiArgumentOperators.erase(depth);
-          } else if (intervalLookup.find(depth) != intervalLookup.end()) {
-            // Having a closing character before the opening character while having to complete an interval must mean that the following group introduces
-            //   the big operator's expression, therefore the lookup shall be removed
-            std::cout << "Closing parenthesis with lookup\n";
-            if (current == ')')
-            {
-              ++std::get<int>(tokens[intervalLookup[depth]].value);
-              bigOperators.erase(depth);
-            }
-          } else if (fracLookup.find(depth) != fracLookup.end()) {
-            tokens.emplace_back(ASTLeaf(groupers[current]));
-            tokens.emplace_back(ASTLeaf(Functions::DIVISION));
-            fracLookup.erase(depth);
-            pos++;
-            continue;
-          }
-          break;
-        }
-        tokens.emplace_back(ASTLeaf(groupers[current]));
-        pos++;
-      } else if (std::isdigit(current)||current == '.') {
-        std::cout << "c\n";
-        tokens.emplace_back(parseNumber());
-        std::cout << "c2\n";
-      } else if (std::isalpha(current)) {
-        std::cout << "d\n";
-        tokens.emplace_back(parseVariable());
-      } else if (operators.find(current) != operators.end()) {
-        std::cout << "e\n";
-        // Hard code unary subtraction
-        if (current == '-')
-        {
-          if (tokens.empty() || tokens.back().type.index() == 2 && (std::get<AuxiliaryTypes>(tokens.back().type) == AuxiliaryTypes::COMMA || isOpeningGrouper(std::get<AuxiliaryTypes>(tokens.back().type))) || tokens.back().type.index() == 1 && !(properties.at(std::get<Functions>(tokens.back().type)) == FunctionTypes::UNARYRIGHT))
-          {
-            tokens.emplace_back(ASTLeaf(Functions::UNSUBTRACTION));
-            pos++;
-            continue;
-          }
-        }
-        else if (current == '^')
-        {
-          // Check if ^ is used to express the superscript of a big operator
-          if (bigOperators.find(depth) != bigOperators.end())
-          {
-            tokens[bigOperators.at(depth)].value = 2;
-            tokens.emplace_back(AuxiliaryTypes::SUPERSCRIPT);
-            pos++;
-            continue;
-          }
-        }
-        tokens.emplace_back(ASTLeaf(operators[current]));
-        pos++;
-      } else if (current == '_') {
-        std::cout << "f\n";
-        // Check if _ is used to express the subscript of a big operator
-        if (bigOperators.find(depth) != bigOperators.end())
-        {
-          tokens[bigOperators.at(depth)].value = 1;
-          tokens.emplace_back(AuxiliaryTypes::SUBSCRIPT);
-          pos++;
-          continue;
-        }
-        pos++;
-      } else if (isEmpty()) {
-        std::cout << "Consumed empty space\n";
-        consumeEmpty();
-      } else if (current == ','){
-        // Add up the counter of arguments of a multi-argument operator when finding a comma
-        if (multiArgumentOperators.count(depth-1) != 0)
-        {
-          std::get<int>(tokens.at(multiArgumentOperators[depth-1]).value)++;
-        }
-        tokens.emplace_back(AuxiliaryTypes::COMMA);
-        pos++;
-      } else if (current == ';'){
-        std::get<int>(tokens[multiArgumentOperators[depth-1]].value)++;
-        std::get<int>(tokens[multiArgumentOperators[depth-1]+1].value)++;
-        // Shortcut: commas have the same sintactic and semantic meaning as semicolons
-        tokens.emplace_back(AuxiliaryTypes::COMMA);
-        pos++;
-      } else {
-        std::cout << "ERROR: Unidentified charcater during tokenization '" << current << "' at position " << pos;
-      }
-    }
-    return tokens;
-  }
-  private:
-  const std::string_view input;
-  std::vector<ASTLeaf> tokens;
-  // An element here represents the presence of a big operator. The key is the group depth (Brace depth) where the big operator was found and the value is the position of that operator
-  std::unordered_map<uint64_t,size_t> bigOperators;
-  std::unordered_map<uint64_t,size_t> multiArgumentOperators;
-  std::unordered_map<uint64_t,size_t> intervalLookup;
-  std::unordered_map<uint64_t,size_t> fracLookup;
-  uint64_t depth = 0;
-
-  size_t pos = 0;
-
-  bool isEmpty()
+  if (argc < 3 || std::strlen(argv[2]) != 1)
   {
-    return input[pos] == ' ';
+    std::cerr << "ERROR: --derive takes a single letter variable\n";
+    return 1;
   }
+  const char variable = argv[2][0];
+  const unsigned order = argc > 3 ? (unsigned)std::strtoul(argv[3], nullptr, 10) : 1;
+  std::string input;
+  std::getline(std::cin, input);
+  Parser p;
+  const AST& ast = p.Parse(input);
+  Differentiator differentiator;
+  const AST derivative = differentiator.differentiate(ast, variable, order);
+  const DifferentiationStatistics& statistics = differentiator.getStatistics();
+  std::cout << input << '\n';
+  std::cout << "Derivative:\n" << toJSON(derivative) << '\n';
+  std::cout << "Nodes: " << statistics.nodesBefore << " -> " << statistics.nodesAfter << ", " << statistics.unsupported << " without a derivative rule\n";
+  return 0;
+}
 
-  void consumeEmpty()
+// Gradient mode: Parser --gradient [--forward] name=value..., reading one expression from stdin
+static int runGradient(int argc, char** argv)
+{
+  Bindings bindings;
+  DifferentiationModes mode = DifferentiationModes::REVERSE;
+  for (int i = 2; i < argc; i++)
   {
-    while (isEmpty())
+    if (std::strcmp(argv[i], "--forward") == 0)
     {
-      std::cout << "Consumed\n";
-      pos++;
-    }
-  }
-
-  void parseCommand() {
-    std::cout << "parse command\n";
-    size_t startPos = ++pos;
-    while (pos < input.size() && std::isalnum(input[pos])) {
-      pos++;
+      mode = DifferentiationModes::FORWARD;
     }
-    std::string_view command(input.data() + startPos, pos - startPos);
-    if (commands.find(command) != commands.end())
+    else if (std::strlen(argv[i]) > 2 && argv[i][1] == '=')
     {
-      Functions func = commands[command];
-      // Add a * if the token before the function was an atomic type
-      if (!tokens.empty() && std::holds_alternative<AtomicTypes>(tokens.back().type))
-      {
-        tokens.emplace_back(Functions::MULTIPLICATION);
-      }
-      switch(properties.at(func))
-      {
-        case FunctionTypes::BIGOPERATOR:
-        consumeEmpty();
-        if (groupers.find(input[pos]) != groupers.end() && isOpeningGrouper(groupers.at(input[pos])))
-        {
-          // Big operator instantly followed by a '{'
-          tokens.emplace_back(func);
-        }
-        // Track the position of the big operator to modify its value later according to the amount of arguments
-        bigOperators[depth] = tokens.size();
-        tokens.emplace_back(func);
-        break;
-        case FunctionTypes::OPTIONALARGUMENTS:
-        consumeEmpty();
-        if (input[pos] == '[')
-        {
-          tokens.emplace_back(func,1);
-        }
-        else
-        {
-          tokens.emplace_back(func);
-        }
-        break;
-        case FunctionTypes::ARRAYARGUMENTS:
-        // Track the position of the multi-argument operator to modify its value later according to the amount of arguments
-        multiArgumentOperators[depth] = tokens.size();
-        tokens.emplace_back(func);
-        break;
-        case FunctionTypes::MATRIXARGUMENTS:
-        // Track the position of the multi-argument operator to modify its value later according to the amount of columns
-        multiArgumentOperators[depth] = tokens.size();
-        tokens.emplace_back(func);
-        // Adds an extra number that keeps track of the amount of rows
-        tokens.emplace_back(AtomicTypes::INTEGER);
-        break;
-        case FunctionTypes::INTERVAL:
-        consumeEmpty();
-        intervalLookup[depth] = tokens.size();
-        tokens.emplace_back(func);
-        break;
-        default:
-        tokens.emplace_back(func);
-        break;
-      }
+      bindings.set(argv[i][0], std::strtod(argv[i]+2, nullptr));
     }
-    else if (constants.find(command) != constants.end())
+    else
     {
-      // A constant next to an atomic type means multiplication
-      if (!tokens.empty() && std::holds_alternative<AtomicTypes>(tokens.back().type))
-      {
-        tokens.emplace_back(Functions::MULTIPLICATION);
-      }
-      tokens.emplace_back(constants[command]);
-    } else if (command == "frac") {
-      fracLookup[depth] = tokens.size();
+      std::cerr << "ERROR: Invalid binding '" << argv[i] << "', expected name=value\n";
+      return 1;
     }
   }
-
-  ASTLeaf parseVariable()
+  std::string input;
+  std::getline(std::cin, input);
+  Parser p;
+  GradientEvaluator evaluator; // Owns the result
+  const Gradient& result = evaluator.evaluate(p.Parse(input), bindings, mode);
+  std::cout << input << '\n';
+  std::cout << "Value: ";
+  printEvaluation(result.value);
+  for (size_t i = 0; i < result.variables.size(); i++)
   {
-    const char &current = input[pos];
-    pos++;
-    // A variable next to an atomic type means multiplication
-    if (!tokens.empty() && std::holds_alternative<AtomicTypes>(tokens.back().type))
-    {
-      tokens.emplace_back(Functions::MULTIPLICATION);
-    }
-    return ASTLeaf(AtomicTypes::VARIABLE,(int)current);
+    std::cout << "d/d" << result.variables[i] << ": ";
+    printEvaluation(result.derivatives[i]);
   }
+  return 0;
+}
 
-  ASTLeaf parseNumber() {
-    size_t startPos = pos;
-    bool decimal = false;
-    while (pos < input.size() && (std::isdigit(input[pos]) || input[pos] == '.')) {
-      pos++;
-      if (input[pos] == '.')
-      {
-        decimal = true;
-      }
-    }
-    std::string_view number(input.data() + startPos, pos - startPos);
-    if (decimal)
-    {
-      auto ast = ASTLeaf(AtomicTypes::REAL);
-      ast.value = std::stod(std::string(number));
-      return ast;
-    }
-    else
-    {
-      auto ast = ASTLeaf(AtomicTypes::INTEGER);
-      ast.value = std::stoi(std::string(number));
-      return ast;
-    }
-  }
-};
-
-
-
-class Parser
+int main(int argc, char** argv)
 {
-  public:
-  // Converts a vector of ASTLeafs into reverse-polish notation
-  std::queue<ASTLeaf> RPN(std::vector<ASTLeaf> nodes)
+  // Tracing can be switched on at runtime in debug builds, e.g. MATHSOLVER_TRACE=tokenize,shunting-yard:verbose
+  if (const char* specification = std::getenv("MATHSOLVER_TRACE"))
   {
-    // Using the shunting-yard algorithm
-    std::stack<ASTLeaf> operatorStack;
-    std::queue<ASTLeaf> output;
-    for (ASTLeaf leaf : nodes)
+    if (!Trace::configure(specification))
     {
-      std::cout << "[+] Current token: " << leaf.toString() << "\n";
-
-      auto stackCopy = operatorStack;
-      size_t stackSize = operatorStack.size();
-      ASTLeaf operatorArray[stackSize];
-      for (int i = stackSize-1; i >= 0; i--)
-      {
-        operatorArray[i] = stackCopy.top();
-        stackCopy.pop();
-      }
-      std::cout << "\t[+] Operator Stack:\n";
-      for (auto leaf : operatorArray)
-      {
-        std::cout << "\t  " << leaf.toString() << '\n';
-      }
-
-      auto queueCopy = output;
-      std::cout << "\t[+] Output queue:\n";
-      while (!queueCopy.empty())
-      {
-        std::cout << "\t  " << queueCopy.front().toString() << '\n';
-        queueCopy.pop();
-      }
-
-      switch (leaf.type.index())
-      {
-        case 0: // AtomicTypes
-        {
-          
-          output.emplace(leaf);
-        }
-        break;
-        case 1: // Functions
-        {
-          Functions& newFunction = std::get<Functions>(leaf.type);
-          while (!operatorStack.empty())
-          {
-            ASTLeaf& top = operatorStack.top();
-            if (top.type.index() == 1 && getPriority(std::get<Functions>(top.type)) >= getPriority(newFunction))
-            {
-              output.emplace(top);
-              operatorStack.pop();
-              continue;
-            }
-            break;
-          }
-          operatorStack.emplace(leaf);
-        }
-        break;
-        case 2: // AuxiliaryTypes
-        {
-          std::cout << "\t[+] Detected auxiliary type\n";
-          AuxiliaryTypes& currentType = std::get<AuxiliaryTypes>(leaf.type);
-          if (isOpeningGrouper(currentType))
-          {
-            operatorStack.emplace(leaf);
-          }
-          // Empty stack and transfer to queue
-          else if (isClosingGrouper(currentType)) {
-            AuxiliaryTypes openingGrouper = getOppositeGrouper(currentType);
-            while (true)
-            {
-              ASTLeaf& top = operatorStack.top();
-              // Check for opening groupers and commas since they both enclose well formed formulas preceding closing groupers:
-              // (... , ...) (...)
-              //      ^ ___  ^___       WFFs represented by underscores and triple dots, parse delimiters represented by carrets
-              if (top.type.index() == 2 && (std::get<AuxiliaryTypes>(top.type) == openingGrouper || std::get<AuxiliaryTypes>(top.type) == AuxiliaryTypes::COMMA))
-              {
-                operatorStack.pop();
-                break;
-              }
-              output.emplace(top);
-              operatorStack.pop();
-            }
-          } else if (currentType == AuxiliaryTypes::COMMA) {
-            // Check for opening groupers and commas since they both enclose well formed formulas preceding other commas:
-            // (... , ...) (...)
-            // ^___        ^___       WFFs represented by underscores and triple dots, parse delimiters represented by carrets
-            while (true)
-            {
-              ASTLeaf& top = operatorStack.top();
-              if (top.type.index() == 2 && (isOpeningGrouper(std::get<AuxiliaryTypes>(top.type)) || std::get<AuxiliaryTypes>(top.type) == AuxiliaryTypes::COMMA))
-              {
-                operatorStack.pop();
-                break;
-              }
-              output.emplace(top);
-              operatorStack.pop();
-            }
-            operatorStack.emplace(AuxiliaryTypes::COMMA);
-          }
-        }
-        break;
-      };
+      std::cerr << "ERROR: Invalid trace specification '" << specification << "'\n";
     }
-    while (!operatorStack.empty())
-    {
-      output.emplace(operatorStack.top());
-      operatorStack.pop();
-    }
-    return output;
   }
 
-  std::variant<ASTLeaf,AST> RPN2AST(std::queue<ASTLeaf> queue)
+  if (argc > 1 && std::strcmp(argv[1], "--batch") == 0)
   {
-    std::stack<std::variant<ASTLeaf,AST>> ASTStack;
-    while (!queue.empty())
-    {
-      const ASTLeaf &current = queue.front();
-      switch (current.type.index())
-      {
-        case 0: // Atomic Type
-        ASTStack.emplace(current);
-        queue.pop();
-        break;
-        case 1: // Function
-        {
-          switch (properties.at(std::get<Functions>(current.type)))
-          {
-            case FunctionTypes::BINARY:
-            {
-              auto arg2 = ASTStack.top();
-              ASTStack.pop();
-              auto arg1 = ASTStack.top();
-              ASTStack.pop();
-              std::vector<std::variant<ASTLeaf,AST>> vec = {arg1,arg2};
-              ASTStack.emplace(AST(std::get<Functions>(current.type),vec));
-              break;
-            }
-            case FunctionTypes::UNARYLEFT:
-            case FunctionTypes::UNARYRIGHT:
-            {
-              std::vector<std::variant<ASTLeaf,AST>> vec = {ASTStack.top()};
-              ASTStack.pop();
-              ASTStack.emplace(AST(std::get<Functions>(current.type),vec));
-              break;
-            }
-            case FunctionTypes::BIGOPERATOR:
-            case FunctionTypes::OPTIONALARGUMENTS:
-            case FunctionTypes::ARRAYARGUMENTS:
-            {
-              int argNum = std::get<int>(current.value);
-              std::vector<std::variant<ASTLeaf,AST>> vec(argNum+1);
-              while(argNum>=0)
-              {
-                vec[argNum] = ASTStack.top();
-                ASTStack.pop();
-                argNum--;
-              }
-              ASTStack.emplace(AST(std::get<Functions>(current.type),vec));
-              break;
-            }
-            case FunctionTypes::MATRIXARGUMENTS:
-            {
-              size_t argNum = std::get<int>(current.value)+1;
-              std::stack<std::variant<ASTLeaf,AST>> args;
-              for (int i = 0; i < argNum; i++)
-              {
-                args.push(ASTStack.top());
-                ASTStack.pop();
-              }
-              size_t rowNum = std::get<int>(std::get<ASTLeaf>(ASTStack.top()).value)+1;
-              size_t rowLength = argNum/rowNum;
-              std::vector<std::variant<ASTLeaf,AST>> rows(rowNum);
-              for (int row = 0; row < rowNum; row++)
-              {
-                std::vector<std::variant<ASTLeaf,AST>> vec(rowLength);
-                for (int column = 0; column < rowLength; column++)
-                {
-                  vec[column] = args.top();
-                  args.pop();
-                }
-                auto ast = AST(Functions::VEC,vec);
-                rows[row] = AST(Functions::VEC,vec);
-
-              }
-              ASTStack.emplace(AST(std::get<Functions>(current.type),rows));
-              break;
-            }
-            case FunctionTypes::INTERVAL:
-            {
-              auto arg2 = ASTStack.top();
-              ASTStack.pop();
-              auto arg1 = ASTStack.top();
-              ASTStack.pop();
-              std::vector<std::variant<ASTLeaf,AST>> vec = {arg1,arg2};
-              ASTStack.emplace(AST((Functions)(CCIntervalIndex+std::get<int>(current.value)),vec));
-              break;
-            }
-          }
-          queue.pop();
-        }
-        break;
-      }
-    }
-    if (ASTStack.top().index() == 0)
-    {
-      std::vector<std::variant<ASTLeaf,AST>> vec = {std::get<ASTLeaf>(ASTStack.top())};
-      return AST(Functions::IDENTITY,vec);
-    }
-    return ASTStack.top();
+    return runBatch(argc, argv);
+  }
+  if (argc > 1 && std::strcmp(argv[1], "--derive") == 0)
+  {
+    return runDerivative(argc, argv);
+  }
+  if (argc > 1 && std::strcmp(argv[1], "--gradient") == 0)
+  {
+    return runGradient(argc, argv);
   }
-};
 
-int main()
-{
-  std::cout << "Heap allocations: " << numOfHeapAllocations << "\n";
 
   std::string input;
   std::getline(std::cin, input);
-  Tokenizer t = Tokenizer(input);
-  auto tokens = t.Tokenize();
-  std::cout << "Tokenized" << std::endl;
-  for (auto t: tokens)
-  {
-    std::cout << t.toString() << '\n';
-  }
-  std::cout << '\n';
   Parser p;
-  auto RPN = p.RPN(tokens);
-  auto copy = RPN;
-  std::cout << "Reverse Polish Notation\n";
-  while (!copy.empty())
+  Allocations::resetPeak();
+  const AllocationSnapshot before = Allocations::snapshot();
+  const AST& ast = p.Parse(input);
+  for (const Diagnostic& diagnostic : p.getDiagnostics())
   {
-    std::cout << copy.front().toString() << "\n";
-    copy.pop();
+    std::cout << "ERROR: " << getName(diagnostic.type) << " at [" << diagnostic.span.begin << ", " << diagnostic.span.end << "): '"
+      << std::string_view(input).substr(diagnostic.span.begin, diagnostic.span.end-diagnostic.span.begin) << "'\n";
   }
   std::cout << input << '\n';
-  //auto ast = p.ParseRPN(RPN);
 
-  //std::cout << ast.toString() << "\n";
+  std::cout << "AST:\n" << ast.toString() << '\n';
 
-  auto ast = std::get<AST>(p.RPN2AST(RPN));
+  std::cout << "JSON:\n" << toJSON(ast) << '\n';
 
-  std::cout << "AST:\n" << ast.toString() << '\n';
+  Simplifier simplifier;
+  const AST simplified = simplifier.simplify(ast);
+  std::cout << "Simplified: " << toJSON(simplified) << " (" << simplifier.getStatistics().removed << " nodes removed)\n";
+
+  // Variables are left unbound, so any expression containing one evaluates to UNDETERMINED
+  const Evaluation value = evaluate(ast, Bindings());
+  std::cout << "Value: ";
+  printEvaluation(value);
+
+  const ParseStatistics& statistics = p.getStatistics();
+  std::cout << "Parse: " << statistics.tokens << " tokens, " << statistics.rpnLength << " in RPN, " << statistics.nodes << " nodes, "
+    << statistics.tokenTransfers << " token transfers, " << statistics.allocations << " heap allocations\n";
 
-  std::cout << "JSON:\n" << ast.toJSON() << '\n';
+  if (Allocations::compiled)
+  {
+    // Everything since parsing started, including both serializations
+    const AllocationSnapshot used = Allocations::snapshot()-before;
+    std::cout << "Allocations:";
+    for (size_t phase = 1; phase < allocationPhaseCount; phase++)
+    {
+      std::cout << ' ' << Allocations::phaseName((AllocationPhases)phase) << ' ' << used.phases[phase].allocations << " (" << used.phases[phase].bytes << " bytes),";
+    }
+    std::cout << " peak " << used.total.peakLiveBytes << " live bytes\n";
+  }
   
   return 0;
 };